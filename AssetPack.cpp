@@ -0,0 +1,229 @@
+#include "AssetPack.hpp"
+#include "Hash.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+
+
+static const uint32_t ASSET_PACK_MAGIC = 0x4B41504B;   // "KPAK"
+static const uint32_t ASSET_PACK_VERSION = 1;
+static const uint64_t ENTRY_ALIGNMENT = 64;
+
+static AssetPack mountedPack;
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                    ASSET PACK                                    */
+/* -------------------------------------------------------------------------------- */
+
+AssetPack::AssetPack()
+{
+	header = NULL;
+	entries = NULL;
+}
+
+
+string AssetPack::normalizePath(const string &path)
+{
+	string normalized = path;
+	replace(normalized.begin(), normalized.end(), '\\', '/');
+	while (normalized.compare(0, 2, "./") == 0)
+		normalized.erase(0, 2);
+	return normalized;
+}
+
+
+bool AssetPack::open(const string &packPath)
+{
+	header = NULL;
+	entries = NULL;
+
+	if (! file.open(packPath))
+		return false;
+
+	const AssetPackHeader *packHeader = (const AssetPackHeader*)file.data();
+	if (file.size() < sizeof(AssetPackHeader) ||
+		packHeader->magic != ASSET_PACK_MAGIC ||
+		packHeader->version != ASSET_PACK_VERSION ||
+		packHeader->tocOffset + (uint64_t)packHeader->nrEntries * sizeof(AssetPackEntry) > file.size())
+	{
+		std::cerr << "ERROR::ASSET_PACK::INVALID_HEADER: " << packPath << endl;
+		file.close();
+		return false;
+	}
+
+	// Check that every entry lies within the file
+	const AssetPackEntry *packEntries = (const AssetPackEntry*)(file.data() + packHeader->tocOffset);
+	for (uint32_t i = 0; i < packHeader->nrEntries; i++)
+	{
+		const AssetPackEntry &entry = packEntries[i];
+		if (entry.path[ASSET_PATH_LENGTH - 1] != '\0' || entry.offset + entry.size > file.size())
+		{
+			std::cerr << "ERROR::ASSET_PACK::INVALID_ENTRY: " << packPath << endl;
+			file.close();
+			return false;
+		}
+	}
+
+	header = packHeader;
+	entries = packEntries;
+	return true;
+}
+
+
+const AssetPackEntry *AssetPack::find(const string &path) const
+{
+	if (! header)
+		return NULL;
+
+	// The table of contents is sorted by path
+	string normalized = normalizePath(path);
+	const AssetPackEntry *end = entries + header->nrEntries;
+	const AssetPackEntry *entry = lower_bound(entries, end, normalized,
+		[](const AssetPackEntry &entry, const string &path) { return strcmp(entry.path, path.c_str()) < 0; });
+
+	if (entry == end || normalized != entry->path)
+		return NULL;
+	return entry;
+}
+
+
+bool AssetPack::build(const string &packPath, const vector<string> &paths)
+{
+	// Read all files
+	vector<AssetPackEntry> packEntries;
+	vector<string> contents;
+	for (const string &path : paths)
+	{
+		string normalized = normalizePath(path);
+		if (normalized.size() >= ASSET_PATH_LENGTH)
+		{
+			std::cerr << "ERROR::ASSET_PACK::PATH_TOO_LONG: " << path << endl;
+			return false;
+		}
+
+		ifstream in(path, ios::binary);
+		if (! in)
+		{
+			std::cerr << "ERROR::ASSET_PACK::FILE_COULD_NOT_BE_READ: " << path << endl;
+			return false;
+		}
+		stringstream stream;
+		stream << in.rdbuf();
+
+		AssetPackEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.path, normalized.c_str(), normalized.size() + 1);
+		contents.push_back(stream.str());
+		entry.size = contents.back().size();
+		entry.hash = hashString(contents.back());
+		entry.offset = contents.size() - 1;   // Index into contents until the layout is known
+		packEntries.push_back(entry);
+	}
+
+	// Sort the table of contents by path for binary search and drop duplicates
+	sort(packEntries.begin(), packEntries.end(),
+		[](const AssetPackEntry &a, const AssetPackEntry &b) { return strcmp(a.path, b.path) < 0; });
+	packEntries.erase(unique(packEntries.begin(), packEntries.end(),
+		[](const AssetPackEntry &a, const AssetPackEntry &b) { return strcmp(a.path, b.path) == 0; }), packEntries.end());
+
+	// Lay out the file: header, table of contents, aligned entries
+	AssetPackHeader packHeader;
+	memset(&packHeader, 0, sizeof(packHeader));
+	packHeader.magic = ASSET_PACK_MAGIC;
+	packHeader.version = ASSET_PACK_VERSION;
+	packHeader.nrEntries = static_cast<uint32_t>(packEntries.size());
+	packHeader.tocOffset = sizeof(AssetPackHeader);
+	packHeader.contentHash = HASH_SEED;
+
+	vector<size_t> contentIndices;
+	uint64_t offset = packHeader.tocOffset + packEntries.size() * sizeof(AssetPackEntry);
+	for (AssetPackEntry &entry : packEntries)
+	{
+		contentIndices.push_back((size_t)entry.offset);
+		offset = (offset + ENTRY_ALIGNMENT - 1) / ENTRY_ALIGNMENT * ENTRY_ALIGNMENT;
+		entry.offset = offset;
+		offset += entry.size;
+		packHeader.contentHash = hashBytes(entry.path, strlen(entry.path), packHeader.contentHash);
+		packHeader.contentHash = hashBytes(&entry.hash, sizeof(entry.hash), packHeader.contentHash);
+	}
+
+	// Write to a temporary file first, so a running game never maps a half written pack
+	string tempPath = packPath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (! out)
+		{
+			std::cerr << "ERROR::ASSET_PACK::FILE_COULD_NOT_BE_WRITTEN: " << packPath << endl;
+			return false;
+		}
+
+		out.write((const char*)&packHeader, sizeof(packHeader));
+		out.write((const char*)packEntries.data(), packEntries.size() * sizeof(AssetPackEntry));
+		for (size_t i = 0; i < packEntries.size(); i++)
+		{
+			static const char padding[ENTRY_ALIGNMENT] = {};
+			out.write(padding, packEntries[i].offset - out.tellp());
+			out.write(contents[contentIndices[i]].data(), packEntries[i].size);
+		}
+
+		if (! out)
+		{
+			std::cerr << "ERROR::ASSET_PACK::FILE_COULD_NOT_BE_WRITTEN: " << packPath << endl;
+			return false;
+		}
+	}
+
+	return replaceFile(tempPath, packPath);
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                    ASSET FILE                                    */
+/* -------------------------------------------------------------------------------- */
+
+bool AssetFile::open(const string &path)
+{
+	const AssetPackEntry *entry = mountedPack.find(path);
+	if (entry)
+	{
+		bytes = mountedPack.data(*entry);
+		length = (size_t)entry->size;
+		hash = entry->hash;
+		return true;
+	}
+
+	if (! looseFile.open(path))
+		return false;
+	bytes = looseFile.data();
+	length = looseFile.size();
+	hash = 0;
+	return true;
+}
+
+
+uint64_t AssetFile::contentHash()
+{
+	if (hash == 0 && bytes)
+		hash = hashBytes(bytes, length);
+	return hash;
+}
+
+
+
+bool mountAssetPack(const string &packPath)
+{
+	return mountedPack.open(packPath);
+}
+
+
+const AssetPack &mountedAssetPack()
+{
+	return mountedPack;
+}
\ No newline at end of file
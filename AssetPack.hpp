@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "FileSystem.hpp"
+
+using namespace std;
+
+
+
+// An asset pack bundles all asset files into one archive:
+//   header | table of contents (sorted by path) | entries (each starting on an aligned offset)
+// The pack is memory mapped, so assets are accessed in place without any further file I/O.
+const int ASSET_PATH_LENGTH = 64;
+
+struct AssetPackHeader {
+	uint32_t magic;
+	uint32_t version;      // Version of the pack format
+	uint32_t nrEntries;
+	uint32_t reserved;
+	uint64_t tocOffset;    // Offset of the table of contents from the start of the file in bytes
+	uint64_t contentHash;  // Hash over all entry hashes, identifies the packed content
+};
+
+struct AssetPackEntry {
+	char path[ASSET_PATH_LENGTH];   // Normalized path (without a leading "./"), null-terminated
+	uint64_t offset;
+	uint64_t size;
+	uint64_t hash;   // Hash of the entry's contents
+};
+
+
+
+class AssetPack
+{
+	private:
+		MappedFile file;
+		const AssetPackHeader *header;
+		const AssetPackEntry *entries;
+
+	public:
+		AssetPack();
+
+		// Map the pack and validate its header and table of contents
+		bool open(const string &packPath);
+
+		// Find the entry of the given asset, NULL if it isn't in the pack
+		const AssetPackEntry *find(const string &path) const;
+		const unsigned char *data(const AssetPackEntry &entry) const { return file.data() + entry.offset; }
+
+		bool isOpen() const { return header != NULL; }
+		uint32_t size() const { return header ? header->nrEntries : 0; }
+		uint64_t contentHash() const { return header ? header->contentHash : 0; }
+
+		// Pack the given files into a new pack at packPath
+		static bool build(const string &packPath, const vector<string> &paths);
+
+		// Paths are stored without a leading "./"
+		static string normalizePath(const string &path);
+};
+
+
+
+// Contents of one asset, either a view into the mounted asset pack or a mapping of the loose file
+class AssetFile
+{
+	private:
+		const unsigned char *bytes;
+		size_t length;
+		uint64_t hash;          // 0 until known
+		MappedFile looseFile;   // Only used if the asset isn't in the pack
+
+	public:
+		AssetFile() : bytes(NULL), length(0), hash(0) {}
+
+		// Open the asset, preferring the mounted pack over the loose file
+		bool open(const string &path);
+
+		const unsigned char *data() const { return bytes; }
+		size_t size() const { return length; }
+
+		// Hash of the contents (stored in the pack, computed for loose files)
+		uint64_t contentHash();
+};
+
+
+
+// Make the assets of the given pack available to AssetFile, returns false if it can't be opened
+bool mountAssetPack(const string &packPath);
+const AssetPack &mountedAssetPack();
\ No newline at end of file
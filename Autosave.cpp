@@ -0,0 +1,234 @@
+#include "Autosave.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+
+
+// Number of evicted chunks that starts an autosave before the interval has passed
+static const size_t EVICTED_SAVE_THRESHOLD = 64;
+
+
+
+Autosave::Autosave(WorldStorage &storage, double interval, EditJournal *journal) : storage(storage)
+{
+	this->journal = journal;
+	this->interval = interval;
+	lastSaveTime = 0.0;
+	writing = false;
+	stopping = false;
+	pendingSequence = 0;
+	nrChunksWritten = 0;
+	nrLastWritten = 0;
+
+	writer = thread(&Autosave::writerLoop, this);
+}
+
+
+Autosave::~Autosave()
+{
+	{
+		lock_guard<mutex> lock(writerMutex);
+		stopping = true;
+	}
+	writerCondition.notify_one();
+	writer.join();
+}
+
+
+void Autosave::update(World &world, double time)
+{
+	// Evicted chunks are only held in memory until they're saved, so many of them start a save early
+	if ((time - lastSaveTime >= interval || evicted.size() >= EVICTED_SAVE_THRESHOLD) && start(world, false))
+		lastSaveTime = time;
+}
+
+
+void Autosave::addEvicted(const ChunkSnapshot &snapshot)
+{
+	lock_guard<mutex> lock(writerMutex);
+	evicted.push_back(snapshot);
+}
+
+
+shared_ptr<const ChunkBlocks> Autosave::takeUnsaved(ivec3 chunkPos, bool &modified)
+{
+	lock_guard<mutex> lock(writerMutex);
+
+	// Snapshots waiting for a save are handed back
+	vector<ChunkSnapshot> *waiting[] = { &evicted, &failed };
+	for (vector<ChunkSnapshot> *snapshots : waiting)
+	{
+		for (size_t i = 0; i < snapshots->size(); i++)
+		{
+			if ((*snapshots)[i].pos == chunkPos)
+			{
+				shared_ptr<const ChunkBlocks> blocks = (*snapshots)[i].blocks;
+				(*snapshots)[i] = snapshots->back();
+				snapshots->pop_back();
+				modified = true;
+				return blocks;
+			}
+		}
+	}
+
+	// Snapshots being written stay with the writer, the region files contain them afterwards
+	if (writing)
+	{
+		for (const ChunkSnapshot &snapshot : pending)
+		{
+			if (snapshot.pos == chunkPos)
+			{
+				modified = false;
+				return snapshot.blocks;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+
+size_t Autosave::saveNow(World &world)
+{
+	finish(world);
+	{
+		lock_guard<mutex> lock(writerMutex);
+		nrLastWritten = 0;
+	}
+	start(world, true);
+	finish(world);
+
+	lock_guard<mutex> lock(writerMutex);
+	return nrLastWritten;
+}
+
+
+// Returns false if the writer is still busy
+bool Autosave::start(World &world, bool wait)
+{
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	// The main thread doesn't wait for the writer to release the lock unless asked to
+	unique_lock<mutex> lock(writerMutex, defer_lock);
+	if (wait)
+		lock.lock();
+	else if (! lock.try_lock())
+		return false;
+	if (writing)
+		return false;
+
+	// Snapshots only add a reference to the chunk's blocks, they are copied when the chunk is
+	// modified while the writer still holds the snapshot. Chunks the last autosave couldn't write
+	// and evicted chunks are saved as well.
+	pending.clear();
+	retryFailed(world);
+	pending.swap(failed);
+	pending.insert(pending.end(), evicted.begin(), evicted.end());
+	evicted.clear();
+	world.snapshotModifiedChunks(pending);
+	pendingSequence = journal ? journal->lastSequence() : 0;
+
+	// Without modified chunks the region files already contain all edits
+	if (pending.empty())
+	{
+		if (journal)
+			journal->compact(pendingSequence);
+		return true;
+	}
+
+	writing = true;
+	lock.unlock();
+
+	// Measured before waking the writer, with a single core the writer would run first
+	handoffTimes.add(chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count());
+	writerCondition.notify_one();
+	return true;
+}
+
+
+bool Autosave::isWriting() const
+{
+	lock_guard<mutex> lock(writerMutex);
+	return writing;
+}
+
+
+void Autosave::finish(World &world)
+{
+	unique_lock<mutex> lock(writerMutex);
+	writerCondition.wait(lock, [this] { return ! writing; });
+	retryFailed(world);
+}
+
+
+void Autosave::retryFailed(World &world)
+{
+	// Chunks still in the world are saved again from their current blocks, the snapshots of the
+	// others are kept for the next save
+	for (size_t i = 0; i < failed.size(); )
+	{
+		Chunk *chunk = world.getChunk(failed[i].pos);
+		if (chunk)
+		{
+			chunk->modified = true;
+			failed[i] = failed.back();
+			failed.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+
+void Autosave::writerLoop()
+{
+	unique_lock<mutex> lock(writerMutex);
+	while (true)
+	{
+		writerCondition.wait(lock, [this] { return writing || stopping; });
+		if (! writing)
+			return;
+
+		// Write without holding the lock, the main thread doesn't touch the pending snapshots
+		// while writing is set
+		lock.unlock();
+		chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+		vector<ivec3> failedChunks;
+		size_t nrWritten = storage.commitChunks(pending, failedChunks);
+		double writeTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+		lock.lock();
+
+		// Release the snapshots, so later edits don't have to copy the blocks anymore
+		for (const ChunkSnapshot &snapshot : pending)
+		{
+			if (find(failedChunks.begin(), failedChunks.end(), snapshot.pos) != failedChunks.end())
+				failed.push_back(snapshot);
+		}
+		pending.clear();
+		nrChunksWritten += nrWritten;
+		nrLastWritten = nrWritten;
+
+		// The journal only has to keep the edits made after the snapshots
+		if (journal && failedChunks.empty())
+			journal->compact(pendingSequence);
+		writeTimes.add(writeTime);
+		writing = false;
+		writerCondition.notify_all();
+	}
+}
+
+
+void Autosave::printStats() const
+{
+	lock_guard<mutex> lock(writerMutex);
+	std::cout << "Autosave: " << writeTimes.count() << " saves, " << nrChunksWritten << " chunks written" << endl;
+	if (writeTimes.count() > 0)
+	{
+		handoffTimes.print("  handoff (main thread)", "us");
+		writeTimes.print("  write (writer thread)", "ms");
+	}
+}
\ No newline at end of file
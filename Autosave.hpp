@@ -0,0 +1,77 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "World.hpp"
+#include "WorldStorage.hpp"
+#include "EditJournal.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// Periodically saves the modified chunks of a world on a writer thread. The main thread only takes
+// copy-on-write snapshots of the modified chunks and hands them over, so the world can be changed
+// while the writer serializes the frozen versions. Regions are written atomically (temp file and rename).
+// After a successful autosave the edit journal is compacted to the edits made after the snapshots.
+class Autosave
+{
+	private:
+		WorldStorage &storage;
+		EditJournal *journal;
+		double interval;       // Seconds between autosaves
+		double lastSaveTime;
+
+		thread writer;
+		mutable mutex writerMutex;
+		condition_variable writerCondition;
+		vector<ChunkSnapshot> pending;   // Snapshots handed over to the writer
+		uint32_t pendingSequence;        // Last journal edit contained in the snapshots
+		vector<ChunkSnapshot> evicted;   // Modified chunks removed from the world, saved with the next autosave
+		vector<ChunkSnapshot> failed;    // Snapshots the writer couldn't save
+		bool writing;
+		bool stopping;
+
+		// Statistics
+		LatencyStats handoffTimes;   // us
+		LatencyStats writeTimes;     // ms
+		size_t nrChunksWritten;
+		size_t nrLastWritten;
+
+		bool start(World &world, bool wait);
+		void retryFailed(World &world);
+		void writerLoop();
+
+	public:
+		// The journal may be NULL
+		Autosave(WorldStorage &storage, double interval, EditJournal *journal = NULL);
+		~Autosave();
+
+		// Called every frame on the main thread, starts an autosave when the interval has passed
+		// (or many chunks were evicted) and the previous one has finished
+		void update(World &world, double time);
+
+		// Save a modified chunk that is removed from the world with the next autosave
+		void addEvicted(const ChunkSnapshot &snapshot);
+
+		// Blocks of the chunk if they aren't in the region files yet (evicted or still being written),
+		// NULL otherwise. modified tells whether the chunk still has to be saved; in that case the
+		// caller takes over saving it by marking the restored chunk as modified.
+		shared_ptr<const ChunkBlocks> takeUnsaved(ivec3 chunkPos, bool &modified);
+
+		// Whether the writer thread is currently saving
+		bool isWriting() const;
+
+		// Wait until the current autosave has finished and mark chunks that couldn't be saved
+		// as modified again
+		void finish(World &world);
+
+		// Save all modified chunks now and wait for it, returns the number of chunks written
+		size_t saveNow(World &world);
+
+		void printStats() const;
+};
\ No newline at end of file
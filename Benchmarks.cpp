@@ -0,0 +1,2474 @@
+#include "Benchmarks.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "World.hpp"
+#include "WorldStorage.hpp"
+#include "Autosave.hpp"
+#include "EditJournal.hpp"
+#include "ChunkStreamer.hpp"
+#include "TerrainGenerator.hpp"
+#include "ChunkCompressor.hpp"
+#include "FixedTimestep.hpp"
+#include "SimulationThread.hpp"
+#include "SnapshotBuffer.hpp"
+#include "TickScheduler.hpp"
+#include "FluidSimulation.hpp"
+#include "ChunkTicker.hpp"
+#include "JobSystem.hpp"
+#include "PlayerPhysics.hpp"
+#include "RayCaster.hpp"
+#include "Entities.hpp"
+#include "TextureLoader.hpp"
+#include "AssetPack.hpp"
+#include "Hash.hpp"
+#include "Profiling.hpp"
+
+
+
+static double elapsedMs(chrono::steady_clock::time_point since)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+
+// Test world of about a million blocks: layered terrain with random inclusions, so the chunk
+// payloads aren't trivially compressible
+static void generateTestWorld(World &world, int size, unsigned int seed)
+{
+	mt19937 random(seed);
+	for (int y = 0; y < size; y++)
+	{
+		for (int z = 0; z < size; z++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				BlockId id = (BlockId)(1 + (y / 8) % 8);
+				if (random() % 10 == 0)
+					id = (BlockId)(1 + random() % 10);
+				world.setBlock(ivec3(x - size / 2, y, z - size / 2), id);
+			}
+		}
+	}
+}
+
+
+static bool worldsEqual(const World &a, const World &b)
+{
+	for (const ChunkMap::value_type &entry : a.getChunks())
+	{
+		const Chunk *other = b.getChunk(entry.first);
+		if (entry.second->isEmpty() && ! other)
+			continue;
+		if (! other || memcmp(entry.second->blocks(), other->blocks(), CHUNK_VOLUME) != 0)
+			return false;
+	}
+	return a.nrChunks() == b.nrChunks();
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                     WORLD I/O                                    */
+/* -------------------------------------------------------------------------------- */
+
+// Start from an empty directory: remove the region files the world would be saved to
+static void removeSavedWorld(const string &directory, const World &world)
+{
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		ivec3 regionPos = RegionFile::regionPosOf(entry.first);
+		remove((directory + "/r." + to_string(regionPos.x) + "." + to_string(regionPos.y) + "." +
+			to_string(regionPos.z) + ".region").c_str());
+	}
+	remove((directory + "/level.dat").c_str());
+}
+
+
+static int benchWorldIO()
+{
+	const string directory = "./benchworld";
+	const int size = 100;   // 100^3 = 1M blocks
+	const long long nrBlocks = (long long)size * size * size;
+
+	World world;
+	generateTestWorld(world, size, 42);
+
+	removeSavedWorld(directory, world);
+
+	// Full save
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	size_t nrSaved;
+	{
+		WorldStorage storage(directory);
+		nrSaved = storage.saveWorld(world);
+	}
+	double saveTime = elapsedMs(startTime);
+
+	// Full load
+	World loaded;
+	startTime = chrono::steady_clock::now();
+	WorldStorage storage(directory);
+	size_t nrLoaded = storage.loadWorld(loaded);
+	double loadTime = elapsedMs(startTime);
+
+	if (nrLoaded != nrSaved || ! worldsEqual(world, loaded))
+	{
+		std::cerr << "ERROR::BENCHMARK::WORLD_IO::ROUND_TRIP_MISMATCH" << endl;
+		return 1;
+	}
+
+	// Incremental save after a few edits
+	mt19937 random(7);
+	for (int i = 0; i < 100; i++)
+		loaded.setBlock(ivec3(random() % size - size / 2, random() % size, random() % size - size / 2), (BlockId)(random() % 11));
+	startTime = chrono::steady_clock::now();
+	size_t nrIncremental = storage.saveWorld(loaded);
+	double incrementalTime = elapsedMs(startTime);
+
+	// Random access loads of single chunks
+	vector<ivec3> chunkPositions;
+	for (const ChunkMap::value_type &entry : loaded.getChunks())
+		chunkPositions.push_back(entry.first);
+	Chunk chunk;
+	startTime = chrono::steady_clock::now();
+	for (int i = 0; i < 1000; i++)
+	{
+		ivec3 chunkPos = chunkPositions[random() % chunkPositions.size()];
+		if (! storage.loadChunk(chunkPos, chunk) || memcmp(chunk.blocks(), loaded.getChunk(chunkPos)->blocks(), CHUNK_VOLUME) != 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::WORLD_IO::RANDOM_ACCESS_MISMATCH" << endl;
+			return 1;
+		}
+	}
+	double randomAccessTime = elapsedMs(startTime);
+
+	std::cout << "World I/O with " << nrBlocks << " blocks in " << nrSaved << " chunks (round trip verified)" << endl;
+	std::cout << "  full save:        " << saveTime << " ms (" << nrBlocks / saveTime / 1000.0 << " M blocks/s)" << endl;
+	std::cout << "  full load:        " << loadTime << " ms (" << nrBlocks / loadTime / 1000.0 << " M blocks/s)" << endl;
+	std::cout << "  incremental save: " << incrementalTime << " ms for " << nrIncremental << " modified chunks" << endl;
+	std::cout << "  random access:    " << randomAccessTime << " us per chunk" << endl;   // ms for 1000 chunks
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                     AUTOSAVE                                     */
+/* -------------------------------------------------------------------------------- */
+
+static int benchAutosave()
+{
+	const string directory = "./benchworld";
+	const int size = 100;
+	const int nrFrames = 600;                 // 10 s of simulated frames at 60 fps
+	const double frameDuration = 1.0 / 60.0;
+
+	World world;
+	generateTestWorld(world, size, 42);
+	removeSavedWorld(directory, world);
+
+	// Reference: saving on the main thread stalls the frame for the whole save
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	size_t nrSaved;
+	{
+		WorldStorage storage(directory);
+		nrSaved = storage.saveWorld(world);
+	}
+	double stallTime = elapsedMs(startTime);
+
+	// Frames editing the world while it is autosaved every second, all chunks are modified again
+	// every 5 seconds so the writer has plenty of work while the edits force copies of the snapshots
+	WorldStorage storage(directory);
+	LatencyStats frameTimes, autosaveFrameTimes;
+	mt19937 random(7);
+	{
+		Autosave autosave(storage, 1.0);
+		bool autosaveRunning = false;
+		for (int frame = 0; frame < nrFrames; frame++)
+		{
+			startTime = chrono::steady_clock::now();
+
+			if (frame % 300 == 0)
+			{
+				for (const ChunkMap::value_type &entry : world.getChunks())
+					entry.second->modified = true;
+			}
+			for (int i = 0; i < 500; i++)
+				world.setBlock(ivec3(random() % size - size / 2, random() % size, random() % size - size / 2), (BlockId)(random() % 11));
+			autosave.update(world, frame * frameDuration);
+
+			double frameTime = elapsedMs(startTime);
+			if (autosaveRunning)
+				autosaveFrameTimes.add(frameTime);
+			else
+				frameTimes.add(frameTime);
+			autosaveRunning = autosave.isWriting();
+		}
+
+		autosave.finish(world);
+		storage.saveWorld(world);
+		std::cout << "Autosave of " << nrSaved << " chunks while editing " << nrFrames << " frames (result verified)" << endl;
+		std::cout << "  save on the main thread: " << stallTime << " ms stall" << endl;
+		autosave.printStats();
+	}
+
+	// The saved world has to match the final state
+	World loaded;
+	WorldStorage reloaded(directory);
+	reloaded.loadWorld(loaded);
+	if (! worldsEqual(world, loaded))
+	{
+		std::cerr << "ERROR::BENCHMARK::AUTOSAVE::SAVED_WORLD_MISMATCH" << endl;
+		return 1;
+	}
+
+	frameTimes.print("  frame work without autosave", "ms");
+	autosaveFrameTimes.print("  frame work during autosave ", "ms");
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                   EDIT JOURNAL                                   */
+/* -------------------------------------------------------------------------------- */
+
+static int benchJournal()
+{
+	const string directory = "./benchworld";
+	const string journalPath = directory + "/edits.journal";
+	const int size = 100;
+	const int nrEdits = 1000000;
+
+	World world;
+	generateTestWorld(world, size, 42);
+	removeSavedWorld(directory, world);
+	remove(journalPath.c_str());
+	WorldStorage storage(directory);
+	storage.saveWorld(world);
+
+	// Sustained edits, the main thread only appends them to the journal
+	EditJournal journal;
+	journal.open(journalPath, world);
+	mt19937 random(7);
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	for (int i = 0; i < nrEdits; i++)
+	{
+		ivec3 pos(random() % size - size / 2, random() % size, random() % size - size / 2);
+		BlockId id = (BlockId)(random() % 11);
+		journal.append(pos, world.getBlock(pos), id);
+		world.setBlock(pos, id);
+	}
+	double appendTime = elapsedMs(startTime);
+	if (! journal.sync())
+	{
+		std::cerr << "ERROR::BENCHMARK::JOURNAL::SYNC_FAILED" << endl;
+		return 1;
+	}
+	double durableTime = elapsedMs(startTime);
+
+	// Crash without saving: the saved world plus the replayed journal has to match the edited world
+	journal.close();
+	World recovered;
+	storage.loadWorld(recovered);
+	EditJournal recoveredJournal;
+	chrono::steady_clock::time_point replayStartTime = chrono::steady_clock::now();
+	recoveredJournal.open(journalPath, recovered);
+	double replayTime = elapsedMs(replayStartTime);
+	if (recoveredJournal.getNrReplayed() != (size_t)nrEdits || ! worldsEqual(world, recovered))
+	{
+		std::cerr << "ERROR::BENCHMARK::JOURNAL::REPLAY_MISMATCH" << endl;
+		return 1;
+	}
+
+	// Saving the world compacts the journal to nothing
+	size_t nrSaved;
+	{
+		Autosave autosave(storage, 30.0, &recoveredJournal);
+		nrSaved = autosave.saveNow(recovered);
+	}
+	recoveredJournal.close();
+	ifstream journalFile(journalPath, ios::binary | ios::ate);
+	size_t compactedSize = (size_t)journalFile.tellg();
+
+	// Reference: making every edit durable by rewriting its chunk
+	const int nrChunkEdits = 100;
+	startTime = chrono::steady_clock::now();
+	for (int i = 0; i < nrChunkEdits; i++)
+	{
+		ivec3 pos(random() % size - size / 2, random() % size, random() % size - size / 2);
+		recovered.setBlock(pos, (BlockId)(random() % 11));
+		vector<ChunkSnapshot> snapshots;
+		vector<ivec3> failedChunks;
+		recovered.snapshotModifiedChunks(snapshots);
+		storage.commitChunks(snapshots, failedChunks);
+	}
+	double chunkEditTime = elapsedMs(startTime);
+
+	std::cout << "Edit journal with " << nrEdits << " edits (replay verified)" << endl;
+	std::cout << "  append:           " << appendTime << " ms (" << nrEdits / appendTime / 1000.0 << " M edits/s)" << endl;
+	std::cout << "  durable:          " << durableTime << " ms (" << nrEdits / durableTime / 1000.0 << " M edits/s, " <<
+		nrEdits * sizeof(JournalRecord) / 1024 << " KB)" << endl;
+	std::cout << "  replay:           " << replayTime << " ms" << endl;
+	std::cout << "  compaction:       " << nrSaved << " chunks saved, journal compacted to " << compactedSize << " bytes" << endl;
+	std::cout << "  chunk rewrite:    " << chunkEditTime / nrChunkEdits << " ms per durable edit without the journal" << endl;
+	journal.printStats();
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                  CHUNK STREAMING                                 */
+/* -------------------------------------------------------------------------------- */
+
+static int benchStreaming()
+{
+	const string directory = "./benchworld";
+	const int size = 256;          // 16^3 chunks
+	const int nrFrames = 1200;     // 20 s at 60 fps
+	const int loadRadius = 4, unloadRadius = 6;
+
+	World reference;
+	generateTestWorld(reference, size, 42);
+	removeSavedWorld(directory, reference);
+	{
+		WorldStorage storage(directory);
+		storage.saveWorld(reference);
+	}
+
+	// Fly diagonally through the world, editing the blocks around the camera
+	WorldStorage storage(directory);
+	World world;
+	size_t maxResident = 0, maxMemory = 0;
+	double updateTime = 0.0;
+	{
+		Autosave autosave(storage, 10.0);
+		ChunkStreamer streamer(storage, autosave, loadRadius, unloadRadius);
+		mt19937 random(7);
+		for (int frame = 0; frame < nrFrames; frame++)
+		{
+			float t = (float)frame / nrFrames;
+			vec3 cameraPos = mix(vec3(-size / 2, 40.0f, -size / 2), vec3(size / 2 - 1, 200.0f, size / 2 - 1), t);
+
+			chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+			streamer.update(world, cameraPos, normalize(vec3(1.0f)), frame / 60.0);
+			updateTime += elapsedMs(startTime);
+
+			for (int i = 0; i < 20; i++)
+			{
+				ivec3 pos = cellOf(cameraPos) + ivec3(random() % 9 - 4, random() % 9 - 4, random() % 9 - 4);
+				BlockId id = (BlockId)(random() % 11);
+				if (pos.y >= 0 && world.getChunk(chunkPosOf(pos)))
+				{
+					world.setBlock(pos, id);
+					reference.setBlock(pos, id);
+				}
+			}
+			autosave.update(world, frame / 60.0);
+
+			// The rest of the frame, which leaves time to the I/O threads
+			this_thread::sleep_for(chrono::milliseconds(2));
+
+			maxResident = std::max(maxResident, world.nrChunks());
+			maxMemory = std::max(maxMemory, streamer.memoryUsage(world));
+		}
+
+		streamer.waitForLoads(world);
+		autosave.saveNow(world);
+		std::cout << "Streaming through " << reference.nrChunks() << " chunks in " << nrFrames << " frames (saved world verified)" << endl;
+		std::cout << "  max resident:     " << maxResident << " chunks (" << maxMemory / 1024 << " KB)" << endl;
+		std::cout << "  update:           " << updateTime / nrFrames << " ms per frame" << endl;
+		streamer.printStats(world);
+	}
+
+	// Evicted chunks were written back, so the saved world has to contain all edits
+	World saved;
+	WorldStorage reloaded(directory);
+	reloaded.loadWorld(saved);
+	if (! worldsEqual(reference, saved))
+	{
+		std::cerr << "ERROR::BENCHMARK::STREAMING::SAVED_WORLD_MISMATCH" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                     PREFETCH                                     */
+/* -------------------------------------------------------------------------------- */
+
+// Flies fast through generated terrain and returns the percentage of visible chunks that weren't ready
+static double flyThroughTerrain(bool prefetch)
+{
+	const string directory = "./benchworld";
+	const int nrFrames = 360;              // 6 s at 60 fps
+	const float speed = 100.0f;            // Blocks per second
+	const vec3 startPos(0.0f, 70.0f, 0.0f);
+
+	// No saved chunks, every chunk is generated with a simulated cold disk read
+	removeSavedWorld(directory, World());
+	WorldStorage storage(directory);
+	Autosave autosave(storage, 1e9);
+	ChunkStreamer streamer(storage, autosave, 6, 8);
+	streamer.setPrefetch(prefetch);
+	streamer.setGenerator([](ivec3 chunkPos, BlockId *blocks) {
+		this_thread::sleep_for(chrono::milliseconds(2));
+		for (int i = 0; i < CHUNK_VOLUME; i++)
+		{
+			ivec3 pos = blockPosOf(chunkPos, i);
+			int height = 64 + (int)(8.0f * sin(pos.x * 0.05f) * cos(pos.z * 0.05f));
+			blocks[i] = pos.y <= height ? (BlockId)(1 + pos.y % 8) : AIR;
+		}
+	});
+
+	World world;
+	streamer.update(world, startPos, vec3(1.0f, 0.0f, 0.0f), 0.0);
+	streamer.waitForLoads(world);
+
+	// Straight ahead, then a turn to the side halfway
+	vec3 cameraPos = startPos;
+	for (int frame = 1; frame <= nrFrames; frame++)
+	{
+		vec3 front = frame < nrFrames / 2 ? vec3(1.0f, 0.0f, 0.0f) : normalize(vec3(0.3f, 0.0f, 1.0f));
+		cameraPos += front * speed / 60.0f;
+		streamer.update(world, cameraPos, front, frame / 60.0);
+		this_thread::sleep_for(chrono::microseconds(16667));
+	}
+
+	std::cout << (prefetch ? "With prefetch:" : "Without prefetch:") << endl;
+	streamer.printStats(world);
+	return streamer.notReadyRate();
+}
+
+
+static int benchPrefetch()
+{
+	double withoutRate = flyThroughTerrain(false);
+	double withRate = flyThroughTerrain(true);
+	std::cout << "Chunks not ready when visible: " << withoutRate << " % without prefetch, " << withRate << " % with prefetch" << endl;
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                 TERRAIN GENERATION                               */
+/* -------------------------------------------------------------------------------- */
+
+static int benchTerrain()
+{
+	// 16 x 6 x 16 chunks covering the whole height of the terrain
+	vector<ivec3> chunkPositions;
+	for (int y = 0; y < 6; y++)
+	{
+		for (int z = -8; z < 8; z++)
+		{
+			for (int x = -8; x < 8; x++)
+				chunkPositions.push_back(ivec3(x, y, z));
+		}
+	}
+
+	TerrainGenerator generator(12345);
+	int maxThreads = std::max((int)thread::hardware_concurrency(), 1);
+	std::cout << "Terrain generation of " << chunkPositions.size() << " chunks (seed " << generator.getSeed() << ")" << endl;
+
+	// The output has to be bit-identical for any number of threads, also checked with more threads
+	// than cores
+	vector<int> threadCounts;
+	for (int nrThreads = 1; nrThreads < std::max(maxThreads, 4); nrThreads *= 2)
+		threadCounts.push_back(nrThreads);
+	threadCounts.push_back(std::max(maxThreads, 4));
+
+	uint64_t referenceHash = 0;
+	for (int nrThreads : threadCounts)
+	{
+		vector<ChunkBlocks> chunks;
+		JobSystem jobs(nrThreads);
+		chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+		generator.generateChunks(chunkPositions, chunks, jobs);
+		double time = elapsedMs(startTime);
+
+		uint64_t hash = hashBytes(chunks.data(), chunks.size() * sizeof(ChunkBlocks));
+		if (nrThreads == 1)
+			referenceHash = hash;
+		else if (hash != referenceHash)
+		{
+			std::cerr << "ERROR::BENCHMARK::TERRAIN::OUTPUT_DIFFERS_WITH_" << nrThreads << "_THREADS" << endl;
+			return 1;
+		}
+
+		double chunksPerSecond = chunkPositions.size() / time * 1000.0;
+		std::cout << "  " << nrThreads << " threads: " << time << " ms, " << chunksPerSecond << " chunks/s, " <<
+			chunksPerSecond / std::min(nrThreads, maxThreads) << " chunks/s per core" << endl;
+	}
+
+	// A second generator with the same seed produces the same terrain
+	vector<ChunkBlocks> chunks;
+	TerrainGenerator(12345).generateChunks(chunkPositions, chunks);
+	if (hashBytes(chunks.data(), chunks.size() * sizeof(ChunkBlocks)) != referenceHash)
+	{
+		std::cerr << "ERROR::BENCHMARK::TERRAIN::NOT_DETERMINISTIC" << endl;
+		return 1;
+	}
+	std::cout << "  output identical for all thread counts (hash " << hex << referenceHash << dec << ")" << endl;
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                    NOISE KERNELS                                 */
+/* -------------------------------------------------------------------------------- */
+
+static int benchNoise()
+{
+	// Random sample positions over a range of lattice cells, including negative coordinates
+	const int NR_SAMPLES = 1 << 16;
+	mt19937 random(7);
+	uniform_real_distribution<float> coordinate(-300.0f, 300.0f);
+	vector<float> x(NR_SAMPLES), y(NR_SAMPLES), z(NR_SAMPLES);
+	for (int i = 0; i < NR_SAMPLES; i++)
+	{
+		x[i] = coordinate(random);
+		y[i] = coordinate(random);
+		z[i] = coordinate(random);
+	}
+
+	GradientNoise noise(12345);
+	std::cout << "Noise kernels, " << NR_SAMPLES << " samples per pass (best backend: " << noiseBackendName(bestNoiseBackend()) << ")" << endl;
+
+	// Scalar reference values
+	vector<float> reference2(NR_SAMPLES), reference3(NR_SAMPLES), referenceFractal(NR_SAMPLES);
+	for (int i = 0; i < NR_SAMPLES; i++)
+	{
+		reference2[i] = noise.noise2(x[i], y[i]);
+		reference3[i] = noise.noise3(x[i], y[i], z[i]);
+		referenceFractal[i] = noise.fractal3(x[i], y[i], z[i], 4);
+	}
+
+	const float TOLERANCE = 1e-5f;
+	const int NR_PASSES = 20;
+	vector<float> out(NR_SAMPLES);
+	for (NoiseBackend backend : { NoiseBackend::SCALAR, NoiseBackend::SSE2, NoiseBackend::AVX2 })
+	{
+		if (! isNoiseBackendSupported(backend))
+		{
+			std::cout << "  " << noiseBackendName(backend) << ": not supported by this CPU" << endl;
+			continue;
+		}
+		noise.setBackend(backend);
+
+		// Count of samples per second of a kernel and the largest difference to the scalar reference
+		float maxError = 0.0f;
+		auto measure = [&](const function<void()> &kernel, const vector<float> &reference, int nrSamplesPerValue)
+		{
+			kernel();
+			for (int i = 0; i < NR_SAMPLES; i++)
+				maxError = std::max(maxError, fabs(out[i] - reference[i]));
+
+			chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+			for (int pass = 0; pass < NR_PASSES; pass++)
+				kernel();
+			return (double)NR_SAMPLES * NR_PASSES * nrSamplesPerValue / elapsedMs(startTime) / 1000.0;
+		};
+
+		double rate2 = measure([&]() { noise.noise2(x.data(), y.data(), out.data(), NR_SAMPLES); }, reference2, 1);
+		double rate3 = measure([&]() { noise.noise3(x.data(), y.data(), z.data(), out.data(), NR_SAMPLES); }, reference3, 1);
+		double rateFractal = measure([&]() { noise.fractal3(x.data(), y.data(), z.data(), out.data(), NR_SAMPLES, 4); }, referenceFractal, 4);
+
+		std::cout << "  " << noiseBackendName(backend) << ": noise2 " << rate2 << " M samples/s, noise3 " << rate3 <<
+			" M samples/s, fractal3 " << rateFractal << " M samples/s (octaves), max difference " << maxError << endl;
+		if (maxError > TOLERANCE)
+		{
+			std::cerr << "ERROR::BENCHMARK::NOISE::" << noiseBackendName(backend) << "_DIFFERS_FROM_SCALAR" << endl;
+			return 1;
+		}
+	}
+
+	// Partial vectors at the end of a batch
+	noise.setBackend(bestNoiseBackend());
+	for (int count = 1; count <= 17; count++)
+	{
+		noise.noise3(x.data(), y.data(), z.data(), out.data(), count);
+		for (int i = 0; i < count; i++)
+		{
+			if (fabs(out[i] - reference3[i]) > TOLERANCE)
+			{
+				std::cerr << "ERROR::BENCHMARK::NOISE::BATCH_OF_" << count << "_DIFFERS_FROM_SCALAR" << endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                  SHARED STORAGE                                  */
+/* -------------------------------------------------------------------------------- */
+
+static void printSharing(const char *name, const World &world, double time)
+{
+	size_t nrChunks = world.nrChunks(), nrStorageBlocks = world.nrStorageBlocks();
+	std::cout << "  " << name << ": " << nrChunks << " chunks in " << nrStorageBlocks << " storage blocks, deduplication ratio " <<
+		(double)nrChunks / nrStorageBlocks << ", " << nrChunks * sizeof(ChunkBlocks) / 1024 << " KB -> " <<
+		nrStorageBlocks * sizeof(ChunkBlocks) / 1024 << " KB (" << (nrChunks - nrStorageBlocks) * sizeof(ChunkBlocks) / 1024 <<
+		" KB saved), " << time * 1000.0 / nrChunks << " us per chunk added" << endl;
+}
+
+
+static int benchSharing()
+{
+	std::cout << "Shared storage of identical chunks" << endl;
+
+	// Superflat world: bedrock, concrete, pavement and grass on top, 32 x 32 chunk columns
+	World flat;
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	for (int cz = -16; cz < 16; cz++)
+	{
+		for (int cx = -16; cx < 16; cx++)
+		{
+			for (int cy = 0; cy < 3; cy++)
+			{
+				unique_ptr<Chunk> chunk(new Chunk());
+				BlockId *blocks = chunk->mutableBlocks();
+				for (int i = 0; i < CHUNK_VOLUME; i++)
+				{
+					int y = blockPosOf(ivec3(cx, cy, cz), i).y;
+					blocks[i] = y == 0 ? 8 : y < 40 ? 5 : y < 43 ? 6 : y == 43 ? 1 : AIR;
+				}
+				flat.setChunk(ivec3(cx, cy, cz), std::move(chunk));
+			}
+		}
+	}
+	printSharing("superflat", flat, elapsedMs(startTime));
+	if (flat.nrStorageBlocks() != 3)
+	{
+		std::cerr << "ERROR::BENCHMARK::SHARING::SUPERFLAT_NOT_SHARED" << endl;
+		return 1;
+	}
+
+	// An edit copies the storage of the edited chunk only, snapshots keep the old blocks
+	shared_ptr<const ChunkBlocks> before = flat.getChunk(ivec3(0, 2, 0))->snapshot();
+	flat.setBlock(ivec3(3, 44, 3), 2);
+	const Chunk *neighbour = flat.getChunk(ivec3(1, 2, 0));
+	if (flat.getBlock(ivec3(3, 44, 3)) != 2 || neighbour->get(blockIndexOf(ivec3(3, 44, 3))) != AIR ||
+		before->ids[blockIndexOf(ivec3(3, 44, 3))] != AIR || flat.nrStorageBlocks() != 4 || neighbour->storage() != before.get())
+	{
+		std::cerr << "ERROR::BENCHMARK::SHARING::COPY_ON_WRITE_FAILED" << endl;
+		return 1;
+	}
+	std::cout << "  edit: copied the storage of the edited chunk only" << endl;
+
+	// Generated terrain: the solid chunks below the caves are identical
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < 6; cy++)
+	{
+		for (int cz = -8; cz < 8; cz++)
+		{
+			for (int cx = -8; cx < 8; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	vector<ChunkBlocks> generated;
+	TerrainGenerator(12345).generateChunks(chunkPositions, generated);
+
+	World terrain;
+	startTime = chrono::steady_clock::now();
+	for (size_t i = 0; i < chunkPositions.size(); i++)
+	{
+		unique_ptr<Chunk> chunk(new Chunk());
+		memcpy(chunk->mutableBlocks(), generated[i].ids, CHUNK_VOLUME);
+		if (! chunk->isEmpty())
+			terrain.setChunk(chunkPositions[i], std::move(chunk));
+	}
+	printSharing("terrain", terrain, elapsedMs(startTime));
+
+	for (size_t i = 0; i < chunkPositions.size(); i++)
+	{
+		const Chunk *chunk = terrain.getChunk(chunkPositions[i]);
+		if (chunk && memcmp(chunk->blocks(), generated[i].ids, CHUNK_VOLUME) != 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::SHARING::TERRAIN_DIFFERS" << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                  CHUNK SUMMARIES                                 */
+/* -------------------------------------------------------------------------------- */
+
+// Compare the incrementally updated summary with one counted from scratch and with a brute-force scan
+static bool summaryConsistent(const Chunk &chunk)
+{
+	ChunkSummary expected;
+	expected.compute(chunk.blocks());
+	const ChunkSummary &summary = chunk.summary();
+	if (memcmp(summary.counts, expected.counts, sizeof(expected.counts)) != 0 ||
+		memcmp(summary.layerCounts, expected.layerCounts, sizeof(expected.layerCounts)) != 0 ||
+		memcmp(summary.occupancy, expected.occupancy, sizeof(expected.occupancy)) != 0 ||
+		summary.occupiedBricks != expected.occupiedBricks)
+		return false;
+
+	int nrNonAir = 0, minY = -1, maxY = -1;
+	for (int i = 0; i < CHUNK_VOLUME; i++)
+	{
+		if (chunk.get(i) == AIR)
+			continue;
+		int y = i >> 8;
+		nrNonAir++;
+		minY = (minY < 0) ? y : std::min(minY, y);
+		maxY = std::max(maxY, y);
+	}
+	for (int i = 0; i < CHUNK_VOLUME; i++)
+	{
+		if (summary.isOccupied(i) != (chunk.get(i) != AIR))
+			return false;
+	}
+	return summary.nrNonAir() == nrNonAir && summary.minY() == minY && summary.maxY() == maxY &&
+		summary.isEmpty() == (nrNonAir == 0) && summary.isFull() == (nrNonAir == CHUNK_VOLUME);
+}
+
+
+static int benchSummary()
+{
+	const int NR_EDITS = 1000000;
+	mt19937 random(7);
+	ChunkPool pool;
+	Chunk chunk;
+	vector<shared_ptr<const ChunkBlocks>> snapshots;
+	std::cout << "Chunk summaries under " << NR_EDITS << " random edits" << endl;
+
+	// Single edits mixed with the operations that replace the blocks as a whole: bulk writes, restoring
+	// snapshots and sharing the storage. Edits are clustered in a few layers and block types, so the
+	// chunk passes through empty, full and uniform states.
+	for (int n = 0; n < NR_EDITS; n++)
+	{
+		int op = random() % 1000;
+		if (op == 0)
+		{
+			BlockId id = (BlockId)(random() % 3);
+			BlockId *blocks = chunk.mutableBlocks();
+			int start = (random() % CHUNK_SIZE) * CHUNK_SIZE * CHUNK_SIZE;
+			for (int i = start; i < CHUNK_VOLUME; i++)
+				blocks[i] = id;
+		}
+		else if (op == 1)
+		{
+			snapshots.push_back(chunk.snapshot());
+		}
+		else if (op == 2 && ! snapshots.empty())
+		{
+			chunk.restore(snapshots[random() % snapshots.size()]);
+		}
+		else if (op == 3)
+		{
+			chunk.share(pool);
+		}
+		else
+		{
+			int layer = (random() % 4 == 0) ? random() % CHUNK_SIZE : 7 + random() % 2;
+			int index = layer * CHUNK_SIZE * CHUNK_SIZE + random() % (CHUNK_SIZE * CHUNK_SIZE);
+			BlockId id = (random() % 2 == 0) ? AIR : (BlockId)(1 + random() % 3);
+			chunk.set(index, id);
+		}
+
+		if (n % 997 == 0 && ! summaryConsistent(chunk))
+		{
+			std::cerr << "ERROR::BENCHMARK::SUMMARY::INCONSISTENT_AFTER_" << n << "_EDITS" << endl;
+			return 1;
+		}
+	}
+	if (! summaryConsistent(chunk))
+	{
+		std::cerr << "ERROR::BENCHMARK::SUMMARY::INCONSISTENT" << endl;
+		return 1;
+	}
+	std::cout << "  consistent with a full recount after every 997th edit" << endl;
+
+	// Cost of an edit with the summary kept up to date
+	Chunk timed;
+	timed.summary();
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	for (int n = 0; n < NR_EDITS; n++)
+		timed.set((int)(random() % CHUNK_VOLUME), (BlockId)(random() % 4));
+	double editTime = elapsedMs(startTime) * 1000000.0 / NR_EDITS;
+
+	// Skipping a world of chunks: the summary query against scanning the blocks
+	World world;
+	generateTestWorld(world, 64, 7);
+	for (int n = 0; n < 64; n++)
+		world.getOrCreateChunk(ivec3(n, 10, 0));   // Empty chunks
+	volatile size_t nrEmpty = 0;
+	startTime = chrono::steady_clock::now();
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		bool empty = true;
+		for (int i = 0; i < CHUNK_VOLUME && empty; i++)
+			empty = entry.second->get(i) == AIR;
+		nrEmpty += empty;
+	}
+	double scanTime = elapsedMs(startTime);
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		entry.second->summary();
+	startTime = chrono::steady_clock::now();
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		nrEmpty += entry.second->summary().isEmpty();
+	double queryTime = elapsedMs(startTime);
+
+	std::cout << "  edit with summary update: " << editTime << " ns" << endl;
+	std::cout << "  empty check of " << world.nrChunks() << " chunks: " << scanTime * 1000.0 << " us scanning, " <<
+		queryTime * 1000.0 << " us with the summaries" << endl;
+	return 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                 CHUNK COMPRESSION                                */
+/* -------------------------------------------------------------------------------- */
+
+static int benchCompression()
+{
+	// Generated terrain of 32 x 32 chunk columns
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < 6; cy++)
+	{
+		for (int cz = -16; cz < 16; cz++)
+		{
+			for (int cx = -16; cx < 16; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	vector<ChunkBlocks> generated;
+	TerrainGenerator(12345).generateChunks(chunkPositions, generated);
+
+	World world;
+	for (size_t i = 0; i < chunkPositions.size(); i++)
+	{
+		unique_ptr<Chunk> chunk(new Chunk());
+		memcpy(chunk->mutableBlocks(), generated[i].ids, CHUNK_VOLUME);
+		if (! chunk->isEmpty())
+			world.setChunk(chunkPositions[i], std::move(chunk));
+	}
+
+	const size_t BUDGET = 4 << 20;
+	const double COLD_AGE = 2.0;
+	ChunkCompressor compressor(BUDGET, COLD_AGE);
+	std::cout << "Chunk compression of " << world.nrChunks() << " chunks (" << ChunkCompressor::uncompressedBytes(world) / 1024 <<
+		" KB), " << BUDGET / 1024 << " KB budget, compressed after " << COLD_AGE << " s without access" << endl;
+
+	// 20 seconds at 60 frames per second: a camera walking across the terrain reads the blocks around
+	// it and edits some, so the chunks behind it go cold and those ahead of it are decompressed
+	mt19937 random(7);
+	for (int frame = 0; frame < 1200; frame++)
+	{
+		double time = frame / 60.0;
+		compressor.update(world, time);
+
+		ivec3 camera((int)(-200.0 + time * 20.0), 48, 0);
+		for (int n = 0; n < 2000; n++)
+		{
+			ivec3 pos = camera + ivec3(random() % 96, random() % 48, random() % 96) - ivec3(48, 24, 48);
+			world.getBlock(pos);
+		}
+		for (int n = 0; n < 4; n++)
+		{
+			ivec3 pos = camera + ivec3(random() % 32, random() % 16, random() % 32) - ivec3(16, 8, 16);
+			BlockId id = (BlockId)(random() % 3);
+			if (world.getChunk(chunkPosOf(pos)))
+			{
+				world.setBlock(pos, id);
+				size_t i = find(chunkPositions.begin(), chunkPositions.end(), chunkPosOf(pos)) - chunkPositions.begin();
+				generated[i].ids[blockIndexOf(pos)] = id;
+			}
+		}
+	}
+	compressor.printStats(world);
+
+	// Compressed or not, the chunks still contain the generated terrain with the edits
+	for (size_t i = 0; i < chunkPositions.size(); i++)
+	{
+		const Chunk *chunk = world.getChunk(chunkPositions[i]);
+		if (chunk && memcmp(chunk->blocks(), generated[i].ids, CHUNK_VOLUME) != 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::COMPRESSION::CHUNK_DIFFERS" << endl;
+			return 1;
+		}
+	}
+	std::cout << "  all chunks verified after decompression" << endl;
+	return 0;
+}
+
+
+
+// Falling blocks above a stone floor, following the gravity rule of the game loop: a falling block
+// moves down at a constant speed and lands on the first free cell above the ground below it
+struct GravityScene
+{
+	World world;
+	vector<vec3> falling;
+	size_t nrTicks;
+};
+
+
+static void initGravityScene(GravityScene &scene)
+{
+	for (int z = 0; z < 64; z++)
+	{
+		for (int x = 0; x < 64; x++)
+			scene.world.setBlock(ivec3(x, 0, z), 1);
+	}
+	scene.falling.clear();
+	scene.nrTicks = 0;
+}
+
+
+static void gravityTick(GravityScene &scene, float dt)
+{
+	// Four blocks are dropped per tick, at columns depending on the tick number only
+	mt19937 random((unsigned int)scene.nrTicks);
+	for (int n = 0; n < 4; n++)
+		scene.falling.push_back(vec3((float)(random() % 64), 40.0f, (float)(random() % 64)));
+
+	for (size_t i = 0; i < scene.falling.size(); )
+	{
+		vec3 &position = scene.falling[i];
+		ivec3 cell = cellOf(position);
+		int targetY = 0;
+		for (int y = (int)ceil(position.y) - 1; y >= 0; y--)
+		{
+			if (scene.world.getBlock(ivec3(cell.x, y, cell.z)) != AIR)
+			{
+				targetY = y + 1;
+				break;
+			}
+		}
+
+		position.y -= 4.25f * dt;
+		if (position.y <= targetY)
+		{
+			cell.y = targetY;
+			while (scene.world.getBlock(cell) != AIR)
+				cell.y++;
+			scene.world.setBlock(cell, 2);
+			scene.falling[i] = scene.falling.back();
+			scene.falling.pop_back();
+			continue;
+		}
+		i++;
+	}
+	scene.nrTicks++;
+}
+
+
+static uint64_t hashGravityScene(const GravityScene &scene)
+{
+	uint64_t hash = HASH_SEED;
+	for (int y = 0; y < 64; y++)
+	{
+		for (int z = 0; z < 64; z++)
+		{
+			for (int x = 0; x < 64; x++)
+			{
+				BlockId id = scene.world.getBlock(ivec3(x, y, z));
+				hash = hashBytes(&id, sizeof(id), hash);
+			}
+		}
+	}
+	return hashBytes(scene.falling.data(), scene.falling.size() * sizeof(vec3), hash);
+}
+
+
+static int benchTimestep()
+{
+	struct FramePattern
+	{
+		const char *name;
+		function<double(int, mt19937&)> frameTime;   // Seconds, by frame number
+	};
+
+	// 20 s of frames each, the frame times are simulated so the stalls don't take real time
+	const FramePattern patterns[] = {
+		{ "60 fps", [](int, mt19937&) { return 1.0 / 60.0; } },
+		{ "144 fps", [](int, mt19937&) { return 1.0 / 144.0; } },
+		{ "30 fps", [](int, mt19937&) { return 1.0 / 30.0; } },
+		{ "jittery 25-250 fps", [](int, mt19937 &random) { return (4 + random() % 37) / 1000.0; } },
+		{ "60 fps, 100 ms stall every 2 s", [](int frame, mt19937&) { return frame % 120 == 119 ? 0.1 : 1.0 / 60.0; } },
+		{ "60 fps, one 1 s stall", [](int frame, mt19937&) { return frame == 300 ? 1.0 : 1.0 / 60.0; } }
+	};
+
+	std::cout << "Fixed timestep of 60 ticks per second, at most 8 ticks per frame" << endl;
+	for (const FramePattern &pattern : patterns)
+	{
+		GravityScene scene;
+		initGravityScene(scene);
+		FixedTimestep clock(60.0, 8);
+		mt19937 random(3);
+
+		double time = 0.0;
+		for (int frame = 0; time < 20.0; frame++)
+		{
+			int nrTicks = clock.advance(time);
+			for (int tick = 0; tick < nrTicks; tick++)
+			{
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				gravityTick(scene, (float)clock.getTickLength());
+				clock.addTickTime(elapsedMs(start));
+			}
+
+			if (clock.alpha() < 0.0f || clock.alpha() >= 1.0f)
+			{
+				std::cerr << "ERROR::BENCHMARK::TIMESTEP::ALPHA_OUT_OF_RANGE" << endl;
+				return 1;
+			}
+			time += pattern.frameTime(frame, random);
+		}
+
+		std::cout << pattern.name << ": " << scene.falling.size() << " blocks falling" << endl;
+		clock.printStats();
+
+		// The outcome only depends on the number of ticks, not on the frame times they ran in
+		GravityScene reference;
+		initGravityScene(reference);
+		while (reference.nrTicks < scene.nrTicks)
+			gravityTick(reference, (float)clock.getTickLength());
+		if (hashGravityScene(reference) != hashGravityScene(scene))
+		{
+			std::cerr << "ERROR::BENCHMARK::TIMESTEP::STATE_DIFFERS" << endl;
+			return 1;
+		}
+	}
+	std::cout << "  all runs match the uninterrupted simulation of the same number of ticks" << endl;
+	return 0;
+}
+
+
+
+// Falling blocks of a gravity scene as the render thread sees them
+struct GravitySnapshot
+{
+	size_t tick;
+	vector<vec3> falling;
+	uint64_t checksum;   // Of the positions, to catch snapshots changed while they're read
+};
+
+
+// Stand-in for drawing a frame: the model and transformation matrices of the visible blocks and the
+// falling ones, with the frame presented at the next vertical blank of a 60 Hz display
+static double renderFrame(const vector<vec3> &blocks, const vector<vec3> &falling, chrono::steady_clock::time_point &nextVblank)
+{
+	mat4 projectionView = perspective(radians(45.0f), 1.75f, 0.1f, 160.0f) * lookAt(vec3(32.0f, 60.0f, -20.0f), vec3(32.0f, 0.0f, 32.0f), vec3(0.0f, 1.0f, 0.0f));
+	float sum = 0.0f;
+	for (const vector<vec3> *positions : { &blocks, &falling })
+	{
+		for (const vec3 &position : *positions)
+		{
+			mat4 transform = projectionView * translate(mat4(1.0f), position);
+			sum += transform[3][2];
+		}
+	}
+
+	chrono::steady_clock::duration vblank = chrono::microseconds(16667);
+	while (nextVblank < chrono::steady_clock::now())
+		nextVblank += vblank;
+	this_thread::sleep_until(nextVblank);
+	nextVblank += vblank;
+	return sum;
+}
+
+
+static int benchSimulationThread()
+{
+	// The heavy simulation: falling blocks, and every half second a sweep over the whole scene that
+	// takes far longer than a tick (like a pass of block updates)
+	const int SWEEP_INTERVAL = 30;
+	const int NR_SWEEPS = 4;
+	auto simulate = [](GravityScene &scene, uint64_t &sweepHash, float dt)
+	{
+		gravityTick(scene, dt);
+		if (scene.nrTicks % SWEEP_INTERVAL == 0)
+		{
+			for (int i = 0; i < NR_SWEEPS; i++)
+			{
+				uint64_t sceneHash = hashGravityScene(scene);
+				sweepHash = hashBytes(&sceneHash, sizeof(sceneHash), sweepHash);
+			}
+		}
+	};
+	GravityScene scene;
+	uint64_t sweepHash = HASH_SEED;
+	function<void(float)> tick = [&](float dt) { simulate(scene, sweepHash, dt); };
+
+	vector<vec3> blocks;
+	for (int i = 0; i < 40000; i++)
+		blocks.push_back(vec3(i % 64, (i / 4096) % 16, (i / 64) % 64));
+
+	const double DURATION = 6.0;
+	std::cout << "Render loop at 60 frames per second for " << DURATION << " s with a heavy simulation at 60 ticks per second" << endl;
+
+	// The drawn transformations are summed up so they aren't optimized away, and checked to be finite
+	bool finite = true;
+
+	// Simulation in the render loop
+	initGravityScene(scene);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		FixedTimestep clock(60.0, 8);
+		LatencyStats frameTimes;
+		chrono::steady_clock::time_point nextVblank = chrono::steady_clock::now();
+		chrono::steady_clock::time_point lastFrame = nextVblank;
+		double sum = 0.0;
+		while (elapsedMs(start) < DURATION * 1000.0)
+		{
+			int nrTicks = clock.advance(elapsedMs(start) / 1000.0);
+			for (int i = 0; i < nrTicks; i++)
+			{
+				chrono::steady_clock::time_point tickStart = chrono::steady_clock::now();
+				tick((float)clock.getTickLength());
+				clock.addTickTime(elapsedMs(tickStart));
+			}
+			sum += renderFrame(blocks, scene.falling, nextVblank);
+			frameTimes.add(elapsedMs(lastFrame));
+			lastFrame = chrono::steady_clock::now();
+		}
+		finite = std::isfinite(sum);
+		std::cout << "In the render loop (" << scene.nrTicks << " ticks):" << endl;
+		frameTimes.print("  frame times", "ms");
+		std::cout << "  standard deviation " << frameTimes.stddev() << " ms" << endl;
+		clock.printStats();
+	}
+
+	size_t loopTicks = scene.nrTicks;
+	uint64_t loopSweepHash = sweepHash;
+
+	// Simulation thread publishing snapshots
+	initGravityScene(scene);
+	sweepHash = HASH_SEED;
+	SnapshotBuffer<GravitySnapshot> snapshots;
+	SimulationThread simulation(60.0, 8);
+	simulation.start(tick, [&](double)
+	{
+		GravitySnapshot &snapshot = snapshots.writeSlot();
+		snapshot.tick = scene.nrTicks;
+		snapshot.falling = scene.falling;
+		snapshot.checksum = hashBytes(snapshot.falling.data(), snapshot.falling.size() * sizeof(vec3));
+		snapshots.publish();
+	});
+
+	LatencyStats frameTimes;
+	size_t nrSnapshots = 0;
+	size_t lastTick = 0;
+	bool consistent = true;
+	start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point nextVblank = start;
+	chrono::steady_clock::time_point lastFrame = start;
+	double sum = 0.0;
+	while (elapsedMs(start) < DURATION * 1000.0)
+	{
+		if (snapshots.acquire())
+		{
+			const GravitySnapshot &snapshot = snapshots.latest();
+			consistent = consistent && snapshot.tick >= lastTick &&
+				hashBytes(snapshot.falling.data(), snapshot.falling.size() * sizeof(vec3)) == snapshot.checksum;
+			lastTick = snapshot.tick;
+			nrSnapshots++;
+		}
+		sum += renderFrame(blocks, snapshots.latest().falling, nextVblank);
+		frameTimes.add(elapsedMs(lastFrame));
+		lastFrame = chrono::steady_clock::now();
+	}
+	simulation.stop();
+	finite = finite && std::isfinite(sum);
+
+	std::cout << "On a simulation thread (" << scene.nrTicks << " ticks, " << nrSnapshots << " snapshots drawn):" << endl;
+	frameTimes.print("  frame times", "ms");
+	std::cout << "  standard deviation " << frameTimes.stddev() << " ms" << endl;
+	simulation.printStats();
+
+	if (! consistent)
+	{
+		std::cerr << "ERROR::BENCHMARK::SIMULATION_THREAD::SNAPSHOT_CHANGED_WHILE_READ" << endl;
+		return 1;
+	}
+	if (! finite)
+	{
+		std::cerr << "ERROR::BENCHMARK::SIMULATION_THREAD::FRAMES_NOT_FINITE" << endl;
+		return 1;
+	}
+
+	// Both simulations only depend on the number of ticks, the sweeps included
+	GravityScene reference;
+	uint64_t referenceSweepHash = HASH_SEED;
+	bool loopMatches = loopTicks == 0;
+	bool threadMatches = scene.nrTicks == 0;
+	initGravityScene(reference);
+	while (reference.nrTicks < std::max(scene.nrTicks, loopTicks))
+	{
+		simulate(reference, referenceSweepHash, 1.0f / 60.0f);
+		if (reference.nrTicks == loopTicks)
+			loopMatches = referenceSweepHash == loopSweepHash;
+		if (reference.nrTicks == scene.nrTicks)
+			threadMatches = referenceSweepHash == sweepHash && hashGravityScene(reference) == hashGravityScene(scene);
+	}
+	if (! loopMatches || ! threadMatches)
+	{
+		std::cerr << "ERROR::BENCHMARK::SIMULATION_THREAD::STATE_DIFFERS" << endl;
+		return 1;
+	}
+	std::cout << "  all snapshots consistent, the sweeps of both runs and the final state match a plain simulation" << endl;
+	return 0;
+}
+
+
+
+static int benchBlockTicks()
+{
+	// A quarter of the updates is due within 10 seconds (like falling blocks), the rest within 28 minutes
+	const int NR_UPDATES = 1000000;
+	const int SHORT_DELAY = 600;
+	const int LONG_DELAY = 100000;
+	TickScheduler scheduler;
+	vector<uint64_t> dueTicks(NR_UPDATES);
+	mt19937 random(11);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < NR_UPDATES; i++)
+	{
+		dueTicks[i] = 1 + random() % (i % 4 == 0 ? SHORT_DELAY : LONG_DELAY);
+		scheduler.schedule(ivec3(i, 0, 0), (uint8_t)(i % 2), dueTicks[i]);
+	}
+	double scheduleMs = elapsedMs(start);
+	std::cout << "Scheduled " << scheduler.getNrPending() << " block updates in " << scheduleMs << " ms (" <<
+		NR_UPDATES / scheduleMs / 1000.0 << " M/s)" << endl;
+
+	// Every update has to come up exactly once, in the tick it was scheduled for
+	vector<bool> done(NR_UPDATES, false);
+	vector<ScheduledTick> due;
+	LatencyStats tickTimes;   // us
+	size_t nrFirstMinute = 0;
+	bool correct = true;
+	start = chrono::steady_clock::now();
+	while (scheduler.getNrPending() > 0)
+	{
+		due.clear();
+		chrono::steady_clock::time_point tickStart = chrono::steady_clock::now();
+		scheduler.advance(due);
+		if (scheduler.getCurrentTick() <= 3600)
+		{
+			tickTimes.add(elapsedMs(tickStart) * 1000.0);
+			nrFirstMinute += due.size();
+		}
+
+		for (const ScheduledTick &tick : due)
+		{
+			int i = tick.pos.x;
+			correct = correct && dueTicks[i] == scheduler.getCurrentTick() && ! done[i] && tick.type == i % 2;
+			done[i] = true;
+		}
+	}
+	double drainMs = elapsedMs(start);
+	if (! correct || find(done.begin(), done.end(), false) != done.end())
+	{
+		std::cerr << "ERROR::BENCHMARK::BLOCK_TICKS::WRONG_TICK" << endl;
+		return 1;
+	}
+
+	std::cout << "First minute (3600 ticks, " << nrFirstMinute / 3600 << " updates per tick):" << endl;
+	tickTimes.print("  tick cost", "us");
+	std::cout << "All " << scheduler.getCurrentTick() << " ticks until the last update in " << drainMs << " ms (" <<
+		drainMs * 1000.0 / scheduler.getCurrentTick() << " us per tick)" << endl;
+
+	// Polling all pending updates every tick instead
+	start = chrono::steady_clock::now();
+	size_t nrDue = 0;
+	for (uint64_t tick = 1; tick <= 20; tick++)
+	{
+		for (uint64_t dueTick : dueTicks)
+			nrDue += dueTick == tick;
+	}
+	std::cout << "Polling " << NR_UPDATES << " pending updates: " << elapsedMs(start) * 1000.0 / 20 << " us per tick (" << nrDue << " due)" << endl;
+	std::cout << "  every update came up once, in its tick" << endl;
+	return 0;
+}
+
+
+
+// Basin of 12 x 12 chunks with an uneven floor and walls around it, springs above it on a grid
+static const BlockId BASIN_SOURCE = 11;
+static const int BASIN_SIZE = 192;
+
+static void buildBasin(World &world)
+{
+	for (int z = 0; z < BASIN_SIZE; z++)
+	{
+		for (int x = 0; x < BASIN_SIZE; x++)
+		{
+			bool wall = x == 0 || z == 0 || x == BASIN_SIZE - 1 || z == BASIN_SIZE - 1;
+			int height = wall ? 24 : 8 + (int)(5.0f * sin(x * 0.09f) * cos(z * 0.07f));
+			for (int y = 0; y <= height; y++)
+				world.setBlock(ivec3(x, y, z), 4);
+			if (! wall && x % 8 == 4 && z % 8 == 4)
+				world.setBlock(ivec3(x, 22, z), BASIN_SOURCE);
+		}
+	}
+
+	// The air above the floor is part of the world too
+	for (int cz = 0; cz < BASIN_SIZE / CHUNK_SIZE; cz++)
+	{
+		for (int cx = 0; cx < BASIN_SIZE / CHUNK_SIZE; cx++)
+			world.getOrCreateChunk(ivec3(cx, 1, cz));
+	}
+}
+
+
+static int benchFluids()
+{
+	World world;
+	buildBasin(world);
+	function<bool(ivec3)> isReady = [](ivec3) { return true; };
+	std::cout << "Flooding a basin of " << BASIN_SIZE << " x " << BASIN_SIZE << " blocks from " << (BASIN_SIZE / 8) * (BASIN_SIZE / 8) <<
+		" springs until the fluid settles, then draining it by removing the springs" << endl;
+
+	uint64_t referenceHash = 0;
+	size_t referenceSteps = 0;
+	for (int nrThreads : { 1, 4 })
+	{
+		JobSystem jobs(nrThreads);
+		FluidSimulation fluids(BASIN_SOURCE, &jobs);
+		for (const ChunkMap::value_type &entry : world.getChunks())
+			fluids.chunkLoaded(world, entry.first);
+
+		vector<FluidChange> changes;
+		size_t nrSteps = 0;
+		size_t nrChanges = 0;
+		size_t maxActive = 0;
+		auto settle = [&]()
+		{
+			while (fluids.getNrActive() > 0 && nrSteps < 5000)
+			{
+				maxActive = std::max(maxActive, fluids.getNrActive());
+				changes.clear();
+				fluids.step(world, isReady, changes);
+				nrChanges += changes.size();
+				nrSteps++;
+			}
+		};
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		settle();
+		double ms = elapsedMs(start);
+
+		uint64_t hash = HASH_SEED;
+		size_t nrWet = 0;
+		size_t nrSources = 0;
+		for (int y = 0; y < 32; y++)
+		{
+			for (int z = 0; z < BASIN_SIZE; z++)
+			{
+				for (int x = 0; x < BASIN_SIZE; x++)
+				{
+					uint8_t level = fluids.getLevel(ivec3(x, y, z));
+					hash = hashBytes(&level, 1, hash);
+					nrWet += level > 0;
+					nrSources += level == FluidSimulation::SOURCE;
+				}
+			}
+		}
+
+		std::cout << nrThreads << " thread(s): settled after " << nrSteps << " steps in " << ms << " ms, " << fluids.getNrCellUpdates() <<
+			" cell updates (" << fluids.getNrCellUpdates() / ms / 1000.0 << " M/s, up to " << maxActive << " active), " <<
+			nrChanges << " changes, " << nrWet << " wet cells, " << nrSources << " sources" << endl;
+		std::cout << "  " << fluids.getNrCellUpdates() / nrSteps << " cells updated per step instead of " << BASIN_SIZE * BASIN_SIZE * 32 <<
+			" in the basin" << endl;
+
+		// Without the springs, all fluid drains away again
+		size_t nrFloodUpdates = fluids.getNrCellUpdates();
+		size_t nrFloodSteps = nrSteps;
+		for (int z = 4; z < BASIN_SIZE; z += 8)
+		{
+			for (int x = 4; x < BASIN_SIZE; x += 8)
+			{
+				world.setBlock(ivec3(x, 22, z), AIR);
+				fluids.blockChanged(ivec3(x, 22, z), AIR);
+			}
+		}
+		start = chrono::steady_clock::now();
+		settle();
+		double drainMs = elapsedMs(start);
+		std::cout << "  drained after " << nrSteps - nrFloodSteps << " steps in " << drainMs << " ms, " << fluids.getNrCellUpdates() - nrFloodUpdates <<
+			" cell updates (" << (fluids.getNrCellUpdates() - nrFloodUpdates) / drainMs / 1000.0 << " M/s), " << fluids.getNrChunks() <<
+			" chunks with fluid left" << endl;
+		hash = hashBytes(&nrSteps, sizeof(nrSteps), hash);
+		if (fluids.getNrChunks() != 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::FLUIDS::NOT_DRAINED" << endl;
+			return 1;
+		}
+		world.clear();
+		buildBasin(world);
+
+		if (referenceSteps == 0)
+		{
+			referenceHash = hash;
+			referenceSteps = nrSteps;
+		}
+		else if (hash != referenceHash || nrSteps != referenceSteps)
+		{
+			std::cerr << "ERROR::BENCHMARK::FLUIDS::RESULT_DEPENDS_ON_THREADS" << endl;
+			return 1;
+		}
+	}
+	std::cout << "  identical result for all thread counts (hash " << hex << referenceHash << dec << ")" << endl;
+	return 0;
+}
+
+
+
+// Sand falls into the air below it, soil next to grass turns into grass. Sand crosses chunk borders, so
+// chunk ticks write into their neighbours.
+static const BlockId TICK_SAND = 1;
+static const BlockId TICK_SOIL = 2;
+static const BlockId TICK_GRASS = 3;
+
+static void tickSandAndGrass(ChunkRegion &region, uint64_t tick)
+{
+	ivec3 chunkPos = region.getChunkPos();
+	mt19937 generator((uint32_t)hashBytes(&tick, sizeof(tick), hashBytes(&chunkPos, sizeof(chunkPos))));
+	for (int n = 0; n < 512; n++)
+	{
+		ivec3 pos = blockPosOf(chunkPos, generator() % CHUNK_VOLUME);
+		BlockId id = region.getBlock(pos);
+		ivec3 below = pos - ivec3(0, 1, 0);
+		if (id == TICK_SAND && pos.y > 0 && region.getBlock(below) == AIR)
+		{
+			region.setBlock(below, TICK_SAND);
+			region.setBlock(pos, AIR);
+		}
+		else if (id == TICK_SOIL && region.getBlock(pos + ivec3(0, 1, 0)) == AIR)
+		{
+			if (region.getBlock(pos + ivec3(1, 0, 0)) == TICK_GRASS || region.getBlock(pos - ivec3(1, 0, 0)) == TICK_GRASS ||
+				region.getBlock(pos + ivec3(0, 0, 1)) == TICK_GRASS || region.getBlock(pos - ivec3(0, 0, 1)) == TICK_GRASS)
+				region.setBlock(pos, TICK_GRASS);
+		}
+	}
+}
+
+
+static int benchChunkTicks()
+{
+	const int size = 16;
+	const int height = 4;
+	const int nrTicks = 30;
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < height; cy++)
+	{
+		for (int cz = 0; cz < size; cz++)
+		{
+			for (int cx = 0; cx < size; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	std::cout << "Ticking " << chunkPositions.size() << " chunks of sand, soil and grass " << nrTicks << " times, 512 random blocks per chunk and tick" << endl;
+
+	int maxThreads = std::max((int)thread::hardware_concurrency(), 4);
+	vector<int> threadCounts;
+	for (int nrThreads = 1; nrThreads < maxThreads; nrThreads *= 2)
+		threadCounts.push_back(nrThreads);
+	threadCounts.push_back(maxThreads);
+
+	uint64_t referenceHash = 0;
+	double singleThreadMs = 0.0;
+	for (int nrThreads : threadCounts)
+	{
+		World world;
+		mt19937 generator(7);
+		for (const ivec3 &chunkPos : chunkPositions)
+		{
+			Chunk &chunk = world.getOrCreateChunk(chunkPos);
+			for (int i = 0; i < CHUNK_VOLUME; i++)
+			{
+				const BlockId ids[10] = { AIR, AIR, AIR, AIR, TICK_SAND, TICK_SAND, TICK_SOIL, TICK_SOIL, TICK_SOIL, TICK_GRASS };
+				chunk.set(i, ids[generator() % 10]);
+			}
+		}
+
+		JobSystem jobs(nrThreads);
+		ChunkTicker ticker(jobs);
+		vector<BlockChange> changes;
+		uint64_t hash = HASH_SEED;
+		size_t nrChanges = 0;
+		for (int tick = 0; tick < nrTicks; tick++)
+		{
+			changes.clear();
+			uint64_t tickNr = tick;
+			ticker.tick(world, chunkPositions, [tickNr](ChunkRegion &region) { tickSandAndGrass(region, tickNr); }, changes);
+			nrChanges += changes.size();
+			for (const BlockChange &change : changes)
+			{
+				hash = hashBytes(&change.pos, sizeof(change.pos), hash);
+				hash = hashBytes(&change.oldId, 1, hash);
+				hash = hashBytes(&change.newId, 1, hash);
+			}
+		}
+		for (const ivec3 &chunkPos : chunkPositions)
+			hash = hashBytes(world.getChunk(chunkPos)->blocks(), CHUNK_VOLUME, hash);
+
+		const LatencyStats &times = ticker.getTickTimes();
+		if (nrThreads == 1)
+			singleThreadMs = times.mean();
+		std::cout << nrThreads << " thread(s): " << times.mean() << " ms per tick (p99 " << times.percentile(0.99) << " ms), speedup " <<
+			singleThreadMs / times.mean() << ", " << nrChanges << " blocks changed" << endl;
+
+		if (nrThreads == 1)
+			referenceHash = hash;
+		else if (hash != referenceHash)
+		{
+			std::cerr << "ERROR::BENCHMARK::CHUNK_TICKS::RESULT_DEPENDS_ON_THREADS" << endl;
+			return 1;
+		}
+	}
+	std::cout << "  identical world and changes for all thread counts (hash " << hex << referenceHash << dec << "), " <<
+		thread::hardware_concurrency() << " cores" << endl;
+	return 0;
+}
+
+
+
+// Job that splits into two children down to the given depth and counts the leaves
+static void spawnTree(JobSystem &jobs, int depth, atomic<size_t> &nrLeaves)
+{
+	if (depth == 0)
+	{
+		nrLeaves++;
+		return;
+	}
+
+	JobCounter children;
+	jobs.spawn([&jobs, depth, &nrLeaves]() { spawnTree(jobs, depth - 1, nrLeaves); }, &children);
+	jobs.spawn([&jobs, depth, &nrLeaves]() { spawnTree(jobs, depth - 1, nrLeaves); }, &children);
+	jobs.waitFor(children);
+}
+
+
+static int benchJobs()
+{
+	int maxThreads = std::max((int)thread::hardware_concurrency(), 4);
+	vector<int> threadCounts;
+	for (int nrThreads = 1; nrThreads < maxThreads; nrThreads *= 2)
+		threadCounts.push_back(nrThreads);
+	threadCounts.push_back(maxThreads);
+
+	// Spawn and steal overhead: empty jobs spawned by one thread and taken by all, and a tree of jobs
+	// waiting for their children, which are stolen by the idle threads
+	const size_t nrFlatJobs = 1000000;
+	const int treeDepth = 18;
+	std::cout << "Spawning " << nrFlatJobs << " empty jobs from one thread and a binary tree of " << (2 << treeDepth) - 2 <<
+		" jobs waiting for their children" << endl;
+	for (int nrThreads : threadCounts)
+	{
+		JobSystem jobs(nrThreads);
+		atomic<size_t> nrRun(0);
+		JobCounter counter;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (size_t i = 0; i < nrFlatJobs; i++)
+			jobs.spawn([&nrRun]() { nrRun++; }, &counter);
+		jobs.waitFor(counter);
+		double flatMs = elapsedMs(start);
+		size_t flatStolen = jobs.getNrStolen();
+
+		atomic<size_t> nrLeaves(0);
+		start = chrono::steady_clock::now();
+		spawnTree(jobs, treeDepth, nrLeaves);
+		double treeMs = elapsedMs(start);
+
+		if (nrRun != nrFlatJobs || nrLeaves != ((size_t)1 << treeDepth))
+		{
+			std::cerr << "ERROR::BENCHMARK::JOBS::JOBS_LOST" << endl;
+			return 1;
+		}
+		std::cout << "  " << nrThreads << " thread(s): flat " << flatMs * 1e6 / nrFlatJobs << " ns per job (" << flatStolen << " stolen), tree " <<
+			treeMs * 1e6 / ((2 << treeDepth) - 2) << " ns per job (" << jobs.getNrStolen() - flatStolen << " stolen)" << endl;
+	}
+
+	// Nested parallel-for over chunks: columns in parallel, the chunks of a column in parallel as well
+	const int size = 16;
+	const int height = 8;
+	TerrainGenerator generator(12345);
+	vector<ChunkBlocks> reference(size * size * height);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < size * size * height; i++)
+		generator.generate(ivec3(i % size, i / (size * size), (i / size) % size), reference[i].ids);
+	double sequentialMs = elapsedMs(start);
+	std::cout << "Generating " << size << " x " << size << " columns of " << height << " chunks with a parallel-for over the chunks of " <<
+		"each column nested in one over the columns (sequential " << sequentialMs << " ms)" << endl;
+
+	for (int nrThreads : threadCounts)
+	{
+		JobSystem jobs(nrThreads);
+		vector<ChunkBlocks> chunks(size * size * height);
+		start = chrono::steady_clock::now();
+		jobs.parallelFor(0, size * size, 1, [&](size_t columnsBegin, size_t columnsEnd)
+		{
+			for (size_t column = columnsBegin; column < columnsEnd; column++)
+			{
+				jobs.parallelFor(0, height, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t y = begin; y < end; y++)
+					{
+						size_t i = column + y * size * size;
+						generator.generate(ivec3((int)column % size, (int)y, (int)column / size), chunks[i].ids);
+					}
+				});
+			}
+		});
+		double ms = elapsedMs(start);
+
+		if (memcmp(chunks.data(), reference.data(), chunks.size() * sizeof(ChunkBlocks)) != 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::JOBS::NESTED_RESULT_DIFFERS" << endl;
+			return 1;
+		}
+		std::cout << "  " << nrThreads << " thread(s): " << ms << " ms, speedup " << sequentialMs / ms << ", " << jobs.getNrSpawned() <<
+			" jobs, " << jobs.getNrStolen() << " stolen" << endl;
+	}
+	std::cout << "  identical chunks for all thread counts, " << thread::hardware_concurrency() << " cores" << endl;
+	return 0;
+}
+
+
+
+// Fills the cells from min to max (inclusive) with a block
+static void fillBlocks(World &world, ivec3 min, ivec3 max)
+{
+	for (int y = min.y; y <= max.y; y++)
+	{
+		for (int z = min.z; z <= max.z; z++)
+		{
+			for (int x = min.x; x <= max.x; x++)
+				world.setBlock(ivec3(x, y, z), 4);
+		}
+	}
+}
+
+
+// Runs the body for the given ticks at 60 per second, false if its box ended up inside a block
+static void loadGeneratedChunks(World &world, TerrainGenerator &generator, const vector<ivec3> &chunkPositions)
+{
+	vector<ChunkBlocks> generated;
+	generator.generateChunks(chunkPositions, generated);
+	for (size_t i = 0; i < chunkPositions.size(); i++)
+	{
+		unique_ptr<Chunk> chunk(new Chunk());
+		memcpy(chunk->mutableBlocks(), generated[i].ids, CHUNK_VOLUME);
+		world.setChunk(chunkPositions[i], std::move(chunk));
+	}
+}
+
+
+static bool walkPlayer(PlayerPhysics &physics, PlayerBody &body, vec3 walkVelocity, bool jump, int nrTicks)
+{
+	for (int tick = 0; tick < nrTicks; tick++)
+	{
+		physics.step(body, walkVelocity, jump, 1.0f / 60.0f);
+		if (physics.overlaps(physics.boxOf(body.position)))
+			return false;
+	}
+	return true;
+}
+
+
+static int benchCollision()
+{
+	// Corner cases, each in a world of its own on a floor whose top is at y = 0.5
+	struct CollisionCase {
+		const char *name;
+		bool passed;
+	};
+	vector<CollisionCase> cases;
+	World world;
+	PlayerPhysics physics([&world](ivec3 cell) { return cell.y < 0 || world.getBlock(cell) != AIR; });
+	auto resetWorld = [&world](int floorMaxX)
+	{
+		world.clear();
+		fillBlocks(world, ivec3(-16, 0, -16), ivec3(floorMaxX, 0, 16));
+	};
+	auto bodyAt = [](vec3 position, vec3 velocity) { PlayerBody body = { position, velocity, false }; return body; };
+
+	// Falling at 1000 blocks/s (17 blocks per tick) onto a floor one block thick
+	resetWorld(16);
+	physics.maxFallSpeed = 1000.0f;
+	PlayerBody body = bodyAt(vec3(0.0f, 60.0f, 0.0f), vec3(0.0f, -1000.0f, 0.0f));
+	bool inside = ! walkPlayer(physics, body, vec3(0.0f), false, 10);
+	cases.push_back({ "no tunnelling through the floor at 1000 blocks/s", ! inside && body.onGround && abs(body.position.y - 0.5f) < 1e-4f });
+	physics.maxFallSpeed = 60.0f;
+
+	// Running at 600 blocks/s (10 blocks per tick) into a wall one block thick
+	fillBlocks(world, ivec3(5, 1, -16), ivec3(5, 4, 16));
+	body = bodyAt(vec3(0.0f, 0.5f, 0.0f), vec3(0.0f));
+	inside = ! walkPlayer(physics, body, vec3(600.0f, 0.0f, 0.0f), false, 10);
+	cases.push_back({ "no tunnelling through a wall at 600 blocks/s", ! inside && abs(body.position.x - (4.5f - physics.width / 2.0f)) < 1e-4f });
+
+	// Jumping under a ceiling 0.2 blocks above the head stops at the ceiling and falls back
+	resetWorld(16);
+	fillBlocks(world, ivec3(-16, 3, -16), ivec3(16, 3, 16));
+	body = bodyAt(vec3(0.0f, 0.5f, 0.0f), vec3(0.0f));
+	walkPlayer(physics, body, vec3(0.0f), false, 1);
+	float highestHead = 0.0f;
+	for (int tick = 0; tick < 30; tick++)
+	{
+		physics.step(body, vec3(0.0f), tick == 0, 1.0f / 60.0f);
+		highestHead = std::max(highestHead, body.position.y + physics.height);
+	}
+	inside = physics.overlaps(physics.boxOf(body.position));
+	cases.push_back({ "jumping against a ceiling", abs(highestHead - 2.5f) < 1e-4f && ! inside && body.onGround && abs(body.position.y - 0.5f) < 1e-4f });
+
+	// Standing 0.05 blocks over the edge of the floor holds, 0.05 blocks beyond it falls
+	resetWorld(0);
+	body = bodyAt(vec3(0.5f + physics.width / 2.0f - 0.05f, 0.5f, 0.0f), vec3(0.0f));
+	walkPlayer(physics, body, vec3(0.0f), false, 30);
+	bool heldAtEdge = body.onGround && abs(body.position.y - 0.5f) < 1e-4f;
+	body = bodyAt(vec3(0.5f + physics.width / 2.0f + 0.05f, 0.5f, 0.0f), vec3(0.0f));
+	walkPlayer(physics, body, vec3(0.0f), false, 30);
+	cases.push_back({ "edges", heldAtEdge && body.position.y < -0.4f });
+
+	// Walking diagonally into the corner of a pillar slides along it without entering it
+	resetWorld(16);
+	fillBlocks(world, ivec3(2, 1, 2), ivec3(2, 3, 2));
+	body = bodyAt(vec3(0.6f, 0.5f, 0.9f), vec3(0.0f));
+	inside = ! walkPlayer(physics, body, vec3(4.0f, 0.0f, 4.0f), false, 60);
+	cases.push_back({ "sliding around the corner of a pillar", ! inside && body.position.x > 2.5f });
+
+	// Walking into a ledge of one block steps up onto it, a wall of two blocks stops the body
+	fillBlocks(world, ivec3(3, 1, -16), ivec3(16, 1, -1));
+	fillBlocks(world, ivec3(3, 1, 4), ivec3(16, 2, 16));
+	body = bodyAt(vec3(0.0f, 0.5f, -4.0f), vec3(0.0f));
+	inside = ! walkPlayer(physics, body, vec3(4.0f, 0.0f, 0.0f), false, 60);
+	bool steppedUp = ! inside && body.onGround && abs(body.position.y - 1.5f) < 1e-4f && body.position.x > 3.0f;
+	body = bodyAt(vec3(0.0f, 0.5f, 8.0f), vec3(0.0f));
+	inside = ! walkPlayer(physics, body, vec3(4.0f, 0.0f, 0.0f), false, 60);
+	cases.push_back({ "stepping up a ledge, not a wall", steppedUp && ! inside && abs(body.position.x - (2.5f - physics.width / 2.0f)) < 1e-4f });
+
+	bool allPassed = true;
+	for (const CollisionCase &collisionCase : cases)
+	{
+		std::cout << (collisionCase.passed ? "  passed: " : "  FAILED: ") << collisionCase.name << endl;
+		allPassed = allPassed && collisionCase.passed;
+	}
+	if (! allPassed)
+	{
+		std::cerr << "ERROR::BENCHMARK::COLLISION::CORNER_CASE_FAILED" << endl;
+		return 1;
+	}
+
+	// Bodies running, jumping and falling through generated terrain
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < 4; cy++)
+	{
+		for (int cz = -4; cz < 4; cz++)
+		{
+			for (int cx = -4; cx < 4; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	TerrainGenerator generator(12345);
+	world.clear();
+	loadGeneratedChunks(world, generator, chunkPositions);
+
+	const int nrBodies = 1000;
+	const int nrTicks = 300;
+	mt19937 random(3);
+	vector<PlayerBody> bodies;
+	vector<vec3> walkVelocities;
+	while ((int)bodies.size() < nrBodies)
+	{
+		int x = (int)(random() % 80) - 40;
+		int z = (int)(random() % 80) - 40;
+		body = bodyAt(vec3((float)x, generator.surfaceHeight(x, z) + 0.5f, (float)z), vec3(0.0f));
+		if (body.position.y > 62.0f || physics.overlaps(physics.boxOf(body.position)))
+			continue;
+		float angle = (random() % 3600) * 0.1f;
+		float speed = 1.0f + random() % 15;
+		bodies.push_back(body);
+		walkVelocities.push_back(vec3(cos(radians(angle)), 0.0f, sin(radians(angle))) * speed);
+	}
+
+	size_t queriesBefore = physics.getNrCellQueries();
+	size_t nrInside = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int tick = 0; tick < nrTicks; tick++)
+	{
+		for (int i = 0; i < nrBodies; i++)
+			physics.step(bodies[i], walkVelocities[i], (tick + i) % 40 == 0, 1.0f / 60.0f);
+	}
+	double ms = elapsedMs(start);
+	size_t nrQueries = physics.getNrCellQueries() - queriesBefore;
+	for (const PlayerBody &body : bodies)
+		nrInside += physics.overlaps(physics.boxOf(body.position));
+
+	size_t nrSteps = (size_t)nrBodies * nrTicks;
+	std::cout << nrBodies << " bodies running up to 15 blocks/s through terrain for " << nrTicks << " ticks: " << nrSteps / ms / 1000.0 <<
+		" M steps/s, " << (double)nrQueries / nrSteps << " cells queried per step, " << nrQueries / ms / 1000.0 << " M cell queries/s" << endl;
+	if (nrInside > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::COLLISION::" << nrInside << "_BODIES_INSIDE_BLOCKS" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+// Reference for the ray caster: slab test of the ray against every non-air cell within range
+static RayHit castRayByCellScan(const World &world, const Ray &ray)
+{
+	RayHit hit;
+	hit.hit = false;
+	hit.distance = INFINITY;
+
+	vec3 direction = normalize(ray.direction);
+	ivec3 originCell = cellOf(ray.origin);
+	ivec3 minCell = cellOf(ray.origin - vec3(ray.range));
+	ivec3 maxCell = cellOf(ray.origin + vec3(ray.range));
+	for (int y = minCell.y; y <= maxCell.y; y++)
+	{
+		for (int z = minCell.z; z <= maxCell.z; z++)
+		{
+			for (int x = minCell.x; x <= maxCell.x; x++)
+			{
+				ivec3 cell(x, y, z);
+				if (cell == originCell || world.getBlock(cell) == AIR)
+					continue;
+
+				vec3 tMin = (vec3(cell) - 0.5f - ray.origin) / direction;
+				vec3 tMax = (vec3(cell) + 0.5f - ray.origin) / direction;
+				vec3 tEntry = glm::min(tMin, tMax);
+				vec3 tExit = glm::max(tMin, tMax);
+				float tNear = std::max(std::max(tEntry.x, tEntry.y), tEntry.z);
+				float tFar = std::min(std::min(tExit.x, tExit.y), tExit.z);
+				if (tNear >= 0.0f && tNear <= ray.range && tNear < tFar && tNear < hit.distance)
+				{
+					hit.hit = true;
+					hit.cell = cell;
+					hit.distance = tNear;
+				}
+			}
+		}
+	}
+	return hit;
+}
+
+
+static bool sameHit(const RayHit &a, const RayHit &b)
+{
+	if (a.hit != b.hit)
+		return false;
+	return ! a.hit || (a.cell == b.cell && a.normal == b.normal && a.distance == b.distance && a.id == b.id);
+}
+
+
+static int benchRays()
+{
+	// Terrain of 12 x 12 columns of chunks, nothing is loaded above them
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < 4; cy++)
+	{
+		for (int cz = -6; cz < 6; cz++)
+		{
+			for (int cx = -6; cx < 6; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	World world;
+	TerrainGenerator generator(777);
+	loadGeneratedChunks(world, generator, chunkPositions);
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		entry.second->summary();
+
+	// Short rays, the DDA finds the same hits as the slab test of every cell (up to rounding of the distance)
+	mt19937 random(5);
+	auto randomFloat = [&random](float min, float max) { return min + (max - min) * (random() % 1000000) / 1000000.0f; };
+	auto randomDirection = [&]() { return normalize(vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f)) + vec3(1e-4f)); };
+	RayCaster caster(world);
+	const int nrShortRays = 2000;
+	vector<Ray> shortRays;
+	for (int i = 0; i < nrShortRays; i++)
+	{
+		vec3 origin(randomFloat(-80.0f, 80.0f), randomFloat(20.0f, 70.0f), randomFloat(-80.0f, 80.0f));
+		shortRays.push_back({ origin, randomDirection(), 10.0f });
+	}
+	int nrMismatches = 0;
+	int nrShortHits = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<RayHit> scanHits(nrShortRays);
+	for (int i = 0; i < nrShortRays; i++)
+		scanHits[i] = castRayByCellScan(world, shortRays[i]);
+	double scanMs = elapsedMs(start);
+	start = chrono::steady_clock::now();
+	vector<RayHit> shortHits(nrShortRays);
+	caster.castBatch(shortRays.data(), shortHits.data(), nrShortRays);
+	double shortMs = elapsedMs(start);
+	int nrPacketMismatches = 0;
+	for (int i = 0; i < nrShortRays; i++)
+	{
+		const RayHit &expected = scanHits[i];
+		const RayHit &hit = shortHits[i];
+		nrPacketMismatches += ! sameHit(hit, caster.cast(shortRays[i]));
+		nrShortHits += hit.hit;
+		bool nearRangeEnd = std::abs((hit.hit ? hit.distance : expected.distance) - shortRays[i].range) < 1e-3f;
+		if (hit.hit != expected.hit)
+			nrMismatches += ! nearRangeEnd;
+		else if (hit.hit && std::abs(hit.distance - expected.distance) > 1e-3f)
+			nrMismatches++;
+	}
+	std::cout << nrShortRays << " rays of 10 blocks (" << nrShortHits << " hits): cell scan " << nrShortRays / scanMs * 1000.0 <<
+		" rays/s, ray caster " << nrShortRays / shortMs * 1000.0 << " rays/s" << endl;
+	if (nrMismatches > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::RAYS::" << nrMismatches << "_HITS_DIFFER_FROM_THE_CELL_SCAN" << endl;
+		return 1;
+	}
+	if (nrPacketMismatches > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::RAYS::" << nrPacketMismatches << "_PACKET_HITS_DIFFER" << endl;
+		return 1;
+	}
+
+	// Coherent batch: the rays of a 512 x 256 view from above the terrain, neighbouring rays share packets.
+	// Incoherent batch: random origins and directions.
+	struct RayBatch {
+		const char *name;
+		vector<Ray> rays;
+	};
+	vector<RayBatch> batches(2);
+	batches[0].name = "coherent";
+	mat4 view = inverse(lookAt(vec3(0.0f, 110.0f, -120.0f), vec3(0.0f, 30.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f)));
+	for (int y = 0; y < 256; y++)
+	{
+		for (int x = 0; x < 512; x++)
+		{
+			vec3 direction((x - 256) / 256.0f * 0.8f, (y - 128) / 256.0f * 0.8f, -1.0f);
+			batches[0].rays.push_back({ vec3(view[3]), vec3(view * vec4(direction, 0.0f)), 400.0f });
+		}
+	}
+	batches[1].name = "incoherent";
+	for (int i = 0; i < 512 * 256; i++)
+	{
+		vec3 origin(randomFloat(-96.0f, 96.0f), randomFloat(0.0f, 120.0f), randomFloat(-96.0f, 96.0f));
+		batches[1].rays.push_back({ origin, randomDirection(), 200.0f });
+	}
+
+	for (RayBatch &batch : batches)
+	{
+		size_t nrRays = batch.rays.size();
+		vector<RayHit> scalarHits(nrRays);
+		vector<RayHit> batchHits(nrRays);
+		size_t stepsBefore = caster.getNrCellSteps();
+		size_t skippedBefore = caster.getNrChunksSkipped();
+		start = chrono::steady_clock::now();
+		for (size_t i = 0; i < nrRays; i++)
+			scalarHits[i] = caster.cast(batch.rays[i]);
+		double scalarMs = elapsedMs(start);
+		size_t nrSteps = caster.getNrCellSteps() - stepsBefore;
+		size_t nrSkipped = caster.getNrChunksSkipped() - skippedBefore;
+
+		start = chrono::steady_clock::now();
+		caster.castBatch(batch.rays.data(), batchHits.data(), nrRays);
+		double batchMs = elapsedMs(start);
+
+		size_t nrHits = 0;
+		size_t nrDifferent = 0;
+		for (size_t i = 0; i < nrRays; i++)
+		{
+			nrHits += scalarHits[i].hit;
+			nrDifferent += ! sameHit(scalarHits[i], batchHits[i]);
+		}
+		std::cout << nrRays << " " << batch.name << " rays (" << nrHits << " hits, " << nrRays - nrDifferent << " the same in packets, " << (double)nrSteps / nrRays << " cell steps and " <<
+			(double)nrSkipped / nrRays << " chunks skipped per ray): " << nrRays / scalarMs / 1000.0 << " M rays/s one by one, " <<
+			nrRays / batchMs / 1000.0 << " M rays/s in packets" << endl;
+		if (nrDifferent > 0)
+		{
+			std::cerr << "ERROR::BENCHMARK::RAYS::" << nrDifferent << "_PACKET_HITS_DIFFER" << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+
+// Compare the superchunk bits of the occupancy pyramid with the chunks of the world
+static bool superchunksConsistent(const World &world)
+{
+	unordered_map<ivec3, uint64_t, ChunkPosHash> present, occupied;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		ivec3 superchunkPos = superchunkPosOf(entry.first);
+		uint64_t bit = (uint64_t)1 << superchunkBitOf(entry.first);
+		present[superchunkPos] |= bit;
+		if (! entry.second->isEmpty())
+			occupied[superchunkPos] |= bit;
+	}
+
+	for (const auto &entry : present)
+	{
+		const SuperchunkOccupancy *superchunk = world.getSuperchunk(entry.first);
+		if (! superchunk || superchunk->present != entry.second || superchunk->occupied.load() != occupied[entry.first])
+			return false;
+	}
+
+	// Superchunks without chunks are dropped
+	for (int y = -2; y < 4; y++)
+	{
+		for (int z = -6; z < 6; z++)
+		{
+			for (int x = -6; x < 6; x++)
+			{
+				if (world.getSuperchunk(ivec3(x, y, z)) && ! present.count(ivec3(x, y, z)))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+static int benchPyramid()
+{
+	// Terrain of 24 x 24 columns of chunks, loaded up to 128 blocks like the streamer would, with the
+	// sky and some tunnels of air
+	vector<ivec3> chunkPositions;
+	for (int cy = 0; cy < 8; cy++)
+	{
+		for (int cz = -12; cz < 12; cz++)
+		{
+			for (int cx = -12; cx < 12; cx++)
+				chunkPositions.push_back(ivec3(cx, cy, cz));
+		}
+	}
+	World world;
+	TerrainGenerator generator(2024);
+	loadGeneratedChunks(world, generator, chunkPositions);
+	mt19937 random(11);
+	for (int n = 0; n < 40; n++)
+	{
+		ivec3 start((int)(random() % 320) - 160, 8 + (int)(random() % 40), (int)(random() % 320) - 160);
+		ivec3 step = (n % 2 == 0) ? ivec3(1, 0, 0) : ivec3(0, 0, 1);
+		for (int i = 0; i < 120; i++)
+		{
+			for (int d = 0; d < 27; d++)
+				world.setBlock(start + step * i + ivec3(d % 3, d / 9, (d / 3) % 3) - 1, AIR);
+		}
+	}
+
+	// Edits through every path that changes blocks: single blocks in the world and in chunks, bulk writes,
+	// restored snapshots, and chunks added, replaced and removed
+	for (int n = 0; n < 200000; n++)
+	{
+		int op = random() % 1000;
+		ivec3 chunkPos((int)(random() % 28) - 14, (int)(random() % 10) - 1, (int)(random() % 28) - 14);
+		if (op == 0)
+			world.removeChunk(chunkPos);
+		else if (op == 1)
+		{
+			unique_ptr<Chunk> chunk(new Chunk());
+			if (random() % 2 == 0)
+				memset(chunk->mutableBlocks(), 1 + random() % 3, CHUNK_VOLUME);
+			world.setChunk(chunkPos, std::move(chunk));
+		}
+		else if (op == 2)
+		{
+			Chunk *chunk = world.getChunk(chunkPos);
+			if (chunk)
+				chunk->restore(world.getChunk(ivec3(0, 1, 0)) ? world.getChunk(ivec3(0, 1, 0))->snapshot() : make_shared<ChunkBlocks>());
+		}
+		else if (op < 500)
+		{
+			Chunk *chunk = world.getChunk(chunkPos);
+			if (chunk)
+				chunk->set(random() % CHUNK_VOLUME, (random() % 2 == 0) ? AIR : (BlockId)(1 + random() % 3));
+		}
+		else
+		{
+			ivec3 pos = chunkPos * CHUNK_SIZE + ivec3(random() % 16, random() % 16, random() % 16);
+			world.setBlock(pos, (random() % 3 == 0) ? (BlockId)(1 + random() % 3) : AIR);
+		}
+	}
+	// Restore the ground the rays start above, only the top layers stay damaged
+	vector<ivec3> groundPositions;
+	for (const ivec3 &chunkPos : chunkPositions)
+	{
+		if (chunkPos.y < 2)
+			groundPositions.push_back(chunkPos);
+	}
+	loadGeneratedChunks(world, generator, groundPositions);
+
+	size_t nrInconsistent = 0;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		nrInconsistent += ! summaryConsistent(*entry.second);
+	if (nrInconsistent > 0 || ! superchunksConsistent(world))
+	{
+		std::cerr << "ERROR::BENCHMARK::PYRAMID::INCONSISTENT_AFTER_EDITS" << endl;
+		return 1;
+	}
+	std::cout << "Occupancy of " << world.nrChunks() << " chunks consistent with a rebuild after 200000 edits" << endl;
+
+	// Long rays from above the terrain, flat ones over the ground and steep ones into it
+	auto randomFloat = [&random](float min, float max) { return min + (max - min) * (random() % 1000000) / 1000000.0f; };
+	const int nrRays = 50000;
+	vector<Ray> rays;
+	for (int i = 0; i < nrRays; i++)
+	{
+		vec3 origin(randomFloat(-180.0f, 180.0f), randomFloat(70.0f, 160.0f), randomFloat(-180.0f, 180.0f));
+		vec3 direction(randomFloat(-1.0f, 1.0f), randomFloat(-0.4f, 0.05f), randomFloat(-1.0f, 1.0f));
+		rays.push_back({ origin, direction, 600.0f });
+	}
+
+	RayCaster caster(world);
+	vector<RayHit> hits[2];
+	for (int usePyramid = 0; usePyramid < 2; usePyramid++)
+	{
+		caster.setUsePyramid(usePyramid != 0);
+		hits[usePyramid].resize(nrRays);
+		size_t stepsBefore = caster.getNrCellSteps();
+		size_t bricksBefore = caster.getNrBricksSkipped();
+		size_t chunksBefore = caster.getNrChunksSkipped();
+		size_t superchunksBefore = caster.getNrSuperchunksSkipped();
+		size_t lookupsBefore = caster.getNrChunkLookups();
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		caster.castBatch(rays.data(), hits[usePyramid].data(), nrRays);
+		double ms = elapsedMs(start);
+
+		std::cout << nrRays << " rays of up to 600 blocks " << (usePyramid ? "with" : "without") << " the pyramid: " <<
+			(double)(caster.getNrCellSteps() - stepsBefore) / nrRays << " cell steps, " <<
+			(double)(caster.getNrBricksSkipped() - bricksBefore) / nrRays << " bricks, " <<
+			(double)(caster.getNrChunksSkipped() - chunksBefore) / nrRays << " chunks and " <<
+			(double)(caster.getNrSuperchunksSkipped() - superchunksBefore) / nrRays << " superchunks skipped and " <<
+			(double)(caster.getNrChunkLookups() - lookupsBefore) / nrRays << " chunk lookups per ray, " <<
+			nrRays / ms / 1000.0 << " M rays/s" << endl;
+	}
+
+	// Skipping steps through the same cells as the DDA, so the hits have to be exactly the same
+	size_t nrHits = 0;
+	size_t nrDifferent = 0;
+	for (int i = 0; i < nrRays; i++)
+	{
+		nrHits += hits[0][i].hit;
+		nrDifferent += ! sameHit(hits[0][i], hits[1][i]);
+	}
+	std::cout << nrHits << " hits, " << nrRays - nrDifferent << " of " << nrRays << " rays the same with the pyramid" << endl;
+	if (nrDifferent > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::PYRAMID::" << nrDifferent << "_HITS_DIFFER" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+
+// Components only used by the entity benchmark
+struct ObjectIndex {
+	uint32_t index;   // Of the object with the same movement in the arrays of objects
+};
+
+struct Lifetime {
+	float remaining;
+};
+
+// Game object as it would be laid out without an ECS, with the data of the other subsystems in between
+struct GameObject {
+	Transform transform;
+	Velocity velocity;
+	char name[32];
+	float health;
+	void *mesh;
+	void *material;
+	mat4 model;
+};
+
+
+static int benchEntities()
+{
+	const int nrEntities = 100000;
+	const int nrTicks = 200;
+	const float dt = 1.0f / 60.0f;
+	mt19937 random(17);
+
+	// Handles stay valid through destruction, slot reuse and moves between archetypes
+	EntityRegistry registry;
+	vector<Entity> handles;
+	vector<float> tags;
+	for (int i = 0; i < nrEntities; i++)
+	{
+		Transform transform = { vec3((float)i, 0.0f, 0.0f), vec3((float)i, 0.0f, 0.0f) };
+		if (i % 3 == 0)
+			handles.push_back(registry.create(transform, Velocity{ vec3(0.0f) }, Lifetime{ 1.0f }));
+		else
+			handles.push_back(registry.create(transform, Velocity{ vec3(0.0f) }));
+		tags.push_back((float)i);
+	}
+	vector<Entity> destroyed;
+	for (int n = 0; n < nrEntities; n++)
+	{
+		int i = random() % nrEntities;
+		int op = random() % 4;
+		if (op == 0 && registry.isAlive(handles[i]))
+		{
+			registry.destroy(handles[i]);
+			destroyed.push_back(handles[i]);
+		}
+		else if (op == 1)
+			registry.add(handles[i], Lifetime{ 2.0f });
+		else if (op == 2)
+			registry.remove<Lifetime>(handles[i]);
+		else
+			registry.create(Transform{ vec3(-1.0f), vec3(-1.0f) });   // Reuses the slots of destroyed entities
+	}
+	size_t nrWrong = 0;
+	for (int i = 0; i < nrEntities; i++)
+	{
+		Transform *transform = registry.get<Transform>(handles[i]);
+		if (registry.isAlive(handles[i]) && (! transform || transform->position.x != tags[i] || ! registry.get<Velocity>(handles[i])))
+			nrWrong++;
+	}
+	for (const Entity &entity : destroyed)
+		nrWrong += registry.isAlive(entity) || registry.get<Transform>(entity) != NULL;
+	std::cout << "Handles: " << registry.size() << " entities in " << registry.nrArchetypes() << " archetypes after " <<
+		destroyed.size() << " destructions and " << nrEntities << " other operations, " << nrWrong << " wrong" << endl;
+	if (nrWrong > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::ENTITIES::" << nrWrong << "_HANDLES_RESOLVE_WRONG" << endl;
+		return 1;
+	}
+
+	// The same movement as entities, as an array of objects and as objects scattered on the heap
+	EntityRegistry entities;
+	vector<GameObject> objects(nrEntities);
+	vector<unique_ptr<GameObject>> heapObjects;
+	for (int i = 0; i < nrEntities; i++)
+	{
+		vec3 position(random() % 1000, random() % 100, random() % 1000);
+		vec3 velocity(random() % 21 - 10.0f, random() % 21 - 10.0f, random() % 21 - 10.0f);
+		objects[i].transform = { position, position };
+		objects[i].velocity = { velocity };
+		heapObjects.push_back(unique_ptr<GameObject>(new GameObject(objects[i])));
+		if (i % 4 == 0)
+			entities.create(Transform{ position, position }, Velocity{ velocity }, ObjectIndex{ (uint32_t)i }, Lifetime{ 5.0f });
+		else
+			entities.create(Transform{ position, position }, Velocity{ velocity }, ObjectIndex{ (uint32_t)i });
+	}
+	shuffle(heapObjects.begin(), heapObjects.end(), random);
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int tick = 0; tick < nrTicks; tick++)
+	{
+		entities.forEach<Transform, Velocity>([dt](Entity, Transform &transform, Velocity &velocity)
+		{
+			transform.previousPosition = transform.position;
+			transform.position += velocity.linear * dt;
+		});
+	}
+	double entityMs = elapsedMs(start);
+
+	start = chrono::steady_clock::now();
+	for (int tick = 0; tick < nrTicks; tick++)
+	{
+		for (GameObject &object : objects)
+		{
+			object.transform.previousPosition = object.transform.position;
+			object.transform.position += object.velocity.linear * dt;
+		}
+	}
+	double arrayMs = elapsedMs(start);
+
+	start = chrono::steady_clock::now();
+	for (int tick = 0; tick < nrTicks; tick++)
+	{
+		for (const unique_ptr<GameObject> &object : heapObjects)
+		{
+			object->transform.previousPosition = object->transform.position;
+			object->transform.position += object->velocity.linear * dt;
+		}
+	}
+	double heapMs = elapsedMs(start);
+
+	nrWrong = 0;
+	entities.forEach<Transform, ObjectIndex>([&](Entity, Transform &transform, ObjectIndex &object)
+	{
+		nrWrong += transform.position != objects[object.index].transform.position;
+	});
+	double nrUpdates = (double)nrEntities * nrTicks;
+	std::cout << nrEntities << " entities with transform and velocity, " << nrTicks << " ticks: " << entityMs * 1e6 / nrUpdates <<
+		" ns per entity, array of objects " << arrayMs * 1e6 / nrUpdates << " ns, objects on the heap " << heapMs * 1e6 / nrUpdates << " ns" << endl;
+	if (nrWrong > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::ENTITIES::" << nrWrong << "_POSITIONS_DIFFER" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+
+static double loadTextures(const vector<string> &paths, bool useCache, vector<unique_ptr<CookedTexture>> &textures)
+{
+	auto start = chrono::steady_clock::now();
+	textures.clear();
+	for (const string &path : paths)
+	{
+		textures.emplace_back(new CookedTexture());
+		if (! textures.back()->load(path, useCache))
+			return -1.0;
+	}
+	return elapsedMs(start);
+}
+
+
+static void printTextureMemory(const char *name, double time, const vector<unique_ptr<CookedTexture>> &textures)
+{
+	size_t heapSize = 0, mappedSize = 0;
+	for (const unique_ptr<CookedTexture> &texture : textures)
+	{
+		heapSize += texture->heapSize();
+		mappedSize += texture->mappedSize();
+	}
+	std::cout << name << time << " ms, " << heapSize / 1024 << " KB of levels on the heap, " << mappedSize / 1024 <<
+		" KB mapped" << endl;
+}
+
+
+static int benchTextures()
+{
+	vector<string> paths;
+	for (const char *path : texturePaths)
+	{
+		if (std::find(paths.begin(), paths.end(), path) == paths.end() && AssetFile().open(path))
+			paths.push_back(path);
+	}
+	if (paths.empty())
+	{
+		std::cerr << "ERROR::BENCHMARK::TEXTURES::NO_TEXTURES_FOUND" << endl;
+		return 1;
+	}
+	std::cout << "Loading " << paths.size() << " textures of the game" << endl;
+
+	// Cook into a cache of its own, the game's cache stays as it is
+	const string gameCacheDirectory = CookedTexture::getCacheDirectory();
+	CookedTexture::setCacheDirectory("./benchtexturecache");
+	auto removeCacheFiles = [&paths]()
+	{
+		for (const string &path : paths)
+			std::remove(CookedTexture::cachePath(path).c_str());
+	};
+	removeCacheFiles();
+
+	vector<unique_ptr<CookedTexture>> cooked, mapped, decoded;
+	double cookTime = loadTextures(paths, true, cooked);
+	double mappedTime = loadTextures(paths, true, mapped);
+	double decodeTime = loadTextures(paths, false, decoded);
+	bool loaded = cookTime >= 0.0 && mappedTime >= 0.0 && decodeTime >= 0.0;
+
+	// The mapped level 0 has to be the decoded image
+	size_t nrDifferent = 0;
+	for (size_t i = 0; loaded && i < paths.size(); i++)
+	{
+		const CookedTexture &a = *mapped[i], &b = *decoded[i];
+		nrDifferent += ! a.fromCache || a.nrLevels < 1 || a.width != b.width || a.height != b.height ||
+			memcmp(a.levels[0], b.levels[0], (size_t)a.width * a.height * 3) != 0;
+	}
+
+	// The levels each path holds once the textures are loaded, mapped pages are shared with the file cache
+	// and can be dropped by the system. Decoding the images also needs a buffer of level 0 for a moment.
+	if (loaded)
+	{
+		printTextureMemory("Cooking into the cache:  ", cookTime, cooked);
+		printTextureMemory("Mapping from the cache:  ", mappedTime, mapped);
+		printTextureMemory("Decoding without cache:  ", decodeTime, decoded);
+	}
+	mapped.clear();
+	removeCacheFiles();
+	CookedTexture::setCacheDirectory(gameCacheDirectory);
+
+	if (! loaded)
+	{
+		std::cerr << "ERROR::BENCHMARK::TEXTURES::TEXTURE_COULD_NOT_BE_LOADED" << endl;
+		return 1;
+	}
+	if (nrDifferent > 0)
+	{
+		std::cerr << "ERROR::BENCHMARK::TEXTURES::" << nrDifferent << "_CACHED_TEXTURES_DIFFER" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+
+
+int runBenchmark(const string &name)
+{
+	if (name == "world-io")
+		return benchWorldIO();
+	if (name == "autosave")
+		return benchAutosave();
+	if (name == "journal")
+		return benchJournal();
+	if (name == "streaming")
+		return benchStreaming();
+	if (name == "prefetch")
+		return benchPrefetch();
+	if (name == "terrain")
+		return benchTerrain();
+	if (name == "noise")
+		return benchNoise();
+	if (name == "sharing")
+		return benchSharing();
+	if (name == "summary")
+		return benchSummary();
+	if (name == "compression")
+		return benchCompression();
+	if (name == "timestep")
+		return benchTimestep();
+	if (name == "simthread")
+		return benchSimulationThread();
+	if (name == "ticks")
+		return benchBlockTicks();
+	if (name == "fluids")
+		return benchFluids();
+	if (name == "chunkticks")
+		return benchChunkTicks();
+	if (name == "jobs")
+		return benchJobs();
+	if (name == "collision")
+		return benchCollision();
+	if (name == "rays")
+		return benchRays();
+	if (name == "pyramid")
+		return benchPyramid();
+	if (name == "entities")
+		return benchEntities();
+	if (name == "textures")
+		return benchTextures();
+
+	std::cerr << "Unknown benchmark '" << name << "', available: world-io, autosave, journal, streaming, prefetch, terrain, noise, sharing, summary, compression, timestep, simthread, ticks, fluids, chunkticks, jobs, collision, rays, pyramid, entities, textures" << endl;
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+
+
+// Engine benchmarks, run from the command line with --bench <name> instead of the game.
+// Every benchmark also checks the results it measures and returns non-zero if they are wrong.
+int runBenchmark(const string &name);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "ChunkCodec.hpp"
+
+
+
+void encodeChunk(const BlockId *blocks, vector<uint8_t> &out)
+{
+	out.clear();
+
+	int i = 0;
+	while (i < CHUNK_VOLUME)
+	{
+		BlockId id = blocks[i];
+		int runLength = 1;
+		while (i + runLength < CHUNK_VOLUME && runLength < 256 && blocks[i + runLength] == id)
+			runLength++;
+
+		out.push_back((uint8_t)(runLength - 1));
+		out.push_back(id);
+		i += runLength;
+	}
+}
+
+
+bool decodeChunk(const uint8_t *data, size_t size, BlockId *blocks)
+{
+	if (size % 2 != 0)
+		return false;
+
+	int i = 0;
+	for (size_t pos = 0; pos < size; pos += 2)
+	{
+		int runLength = data[pos] + 1;
+		if (i + runLength > CHUNK_VOLUME)
+			return false;
+
+		for (int j = 0; j < runLength; j++)
+			blocks[i + j] = data[pos + 1];
+		i += runLength;
+	}
+
+	return i == CHUNK_VOLUME;
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+#include "World.hpp"
+
+
+
+// Run-length encoding of a chunk's blocks as (run length - 1, block id) byte pairs, so a chunk of
+// a single block type takes 32 bytes and typical terrain only a few hundred.
+void encodeChunk(const BlockId *blocks, vector<uint8_t> &out);
+
+// Returns false if the data doesn't decode to exactly one chunk
+bool decodeChunk(const uint8_t *data, size_t size, BlockId *blocks);
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "ChunkCompressor.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+
+
+// Seconds between two runs, the chunks are only sorted by their last access this often
+static const double RUN_INTERVAL = 0.25;
+
+// Compressions per run, so a burst of cold chunks is spread over several frames
+static const int MAX_COMPRESSIONS_PER_RUN = 256;
+
+
+
+ChunkCompressor::ChunkCompressor(size_t budget, double coldAge)
+{
+	this->budget = budget;
+	this->coldAge = coldAge;
+	lastRun = 0.0;
+	nrCompressions = 0;
+	rawBytes = 0;
+	packedBytes = 0;
+}
+
+
+void ChunkCompressor::update(World &world, double time)
+{
+	world.getAccessStats().time = time;
+	if (time - lastRun < RUN_INTERVAL)
+		return;
+	lastRun = time;
+
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	// Uncompressed chunks, least recently used first
+	vector<pair<double, Chunk*>> candidates;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		if (! entry.second->isCompressed())
+			candidates.push_back(make_pair(entry.second->lastAccess, entry.second.get()));
+	}
+	sort(candidates.begin(), candidates.end(), [](const pair<double, Chunk*> &a, const pair<double, Chunk*> &b) {
+		return a.first < b.first;
+	});
+
+	size_t resident = uncompressedBytes(world);
+	int nrLeft = MAX_COMPRESSIONS_PER_RUN;
+	for (const pair<double, Chunk*> &candidate : candidates)
+	{
+		if ((candidate.first > time - coldAge && resident <= budget) || nrLeft == 0)
+			break;
+
+		// Storage shared with other chunks or snapshots stays anyway
+		if (! candidate.second->compress(world.getAccessStats()))
+			continue;
+		resident -= sizeof(ChunkBlocks);
+		nrLeft--;
+		nrCompressions++;
+		rawBytes += sizeof(ChunkBlocks);
+		packedBytes += candidate.second->compressedSize();
+	}
+
+	runTimes.add(chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count());
+}
+
+
+size_t ChunkCompressor::uncompressedBytes(const World &world)
+{
+	return world.nrStorageBlocks() * sizeof(ChunkBlocks);
+}
+
+
+size_t ChunkCompressor::compressedBytes(const World &world)
+{
+	size_t bytes = 0;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		bytes += entry.second->compressedSize();
+	return bytes;
+}
+
+
+void ChunkCompressor::printStats(const World &world) const
+{
+	size_t nrCompressed = 0;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		nrCompressed += entry.second->isCompressed();
+
+	const ChunkAccessStats &access = world.getAccessStats();
+	std::cout << "Chunk compression: " << nrCompressed << " of " << world.nrChunks() << " chunks compressed (" <<
+		uncompressedBytes(world) / 1024 << " KB uncompressed of a " << budget / 1024 << " KB budget, " <<
+		compressedBytes(world) / 1024 << " KB compressed), " << nrCompressions << " compressions with a ratio of " <<
+		(packedBytes > 0 ? (double)rawBytes / packedBytes : 0.0) << endl;
+	std::cout << "  accesses: " << access.nrHits << " hits, " << access.nrMisses << " misses (decompressions)" << endl;
+	if (access.decompressTimes.count() > 0)
+		access.decompressTimes.print("  decompression", "us");
+	if (runTimes.count() > 0)
+		runTimes.print("  compression runs", "ms");
+}
\ No newline at end of file
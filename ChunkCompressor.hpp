@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "World.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// Keeps the uncompressed block storage of a world within a byte budget. Chunks that weren't accessed
+// for a while are compressed in memory (run-length encoded, see encodeChunk), and while the storage
+// still exceeds the budget the least recently used chunks follow. Compressed chunks are decompressed
+// transparently on their next access.
+class ChunkCompressor
+{
+	private:
+		size_t budget;      // Bytes of uncompressed block storage
+		double coldAge;     // Seconds without an access after which a chunk is compressed
+		double lastRun;
+
+		size_t nrCompressions;
+		size_t rawBytes;               // Uncompressed and compressed size of all compressions so far
+		size_t packedBytes;
+		LatencyStats runTimes;         // ms per run
+
+	public:
+		ChunkCompressor(size_t budget, double coldAge);
+
+		// Set the access time of the world and compress the cold chunks (a few times per second)
+		void update(World &world, double time);
+
+		// Bytes of block storage of the uncompressed chunks and of the compressed ones
+		static size_t uncompressedBytes(const World &world);
+		static size_t compressedBytes(const World &world);
+
+		void printStats(const World &world) const;
+};
\ No newline at end of file
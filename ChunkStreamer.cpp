@@ -0,0 +1,439 @@
+#include "ChunkStreamer.hpp"
+
+#include <iostream>
+#include <climits>
+#include <cmath>
+
+
+
+// Prefetching: the camera position is predicted for these times ahead (in seconds) and the chunks
+// within PREFETCH_RADIUS of the predicted positions are requested
+static const float PREFETCH_TIMES[] = { 0.5f, 1.0f, 1.5f, 2.0f };
+static const int PREFETCH_RADIUS = 3;
+static const float MIN_PREFETCH_SPEED = 2.0f;    // Blocks per second
+static const float VELOCITY_SMOOTHING = 0.2f;    // Weight of the newest velocity sample
+static const float VIEW_DIRECTION_WEIGHT = 0.3f; // How much the path bends towards the view direction
+
+// A chunk counts as visible if it's in the view distance and within this angle of the view direction
+static const float VISIBLE_HALF_ANGLE = 60.0f;
+
+
+
+static int distanceSquared(ivec3 a, ivec3 b)
+{
+	ivec3 offset = a - b;
+	return offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+}
+
+
+// Offsets of the chunks within a sphere of the given radius
+static vector<ivec3> sphereOffsets(int radius)
+{
+	vector<ivec3> offsets;
+	for (int y = -radius; y <= radius; y++)
+	{
+		for (int z = -radius; z <= radius; z++)
+		{
+			for (int x = -radius; x <= radius; x++)
+			{
+				if (x * x + y * y + z * z <= radius * radius)
+					offsets.push_back(ivec3(x, y, z));
+			}
+		}
+	}
+	return offsets;
+}
+
+
+
+ChunkStreamer::ChunkStreamer(WorldStorage &storage, Autosave &autosave, int loadRadius, int unloadRadius, int nrThreads)
+	: storage(storage), autosave(autosave)
+{
+	this->loadRadius = loadRadius;
+	this->unloadRadius = std::max(unloadRadius, loadRadius);
+	loadOffsets = sphereOffsets(loadRadius);
+	prefetchOffsets = sphereOffsets(PREFETCH_RADIUS);
+	prefetchEnabled = true;
+	hasCamera = false;
+	lastCameraPos = vec3(0.0f);
+	lastTime = 0.0;
+	velocity = vec3(0.0f);
+	requestFront = vec3(0.0f);
+	stopping = false;
+	nrLoaded = 0;
+	nrRestored = 0;
+	nrEvicted = 0;
+	nrWrittenBack = 0;
+	nrVisibleChecks = 0;
+	nrNotReady = 0;
+	nrNotReadyFrames = 0;
+	nrFrames = 0;
+
+	for (int i = 0; i < std::max(nrThreads, 1); i++)
+		ioThreads.push_back(thread(&ChunkStreamer::ioLoop, this));
+}
+
+
+ChunkStreamer::~ChunkStreamer()
+{
+	{
+		lock_guard<mutex> lock(streamMutex);
+		stopping = true;
+	}
+	requestCondition.notify_all();
+	for (thread &ioThread : ioThreads)
+		ioThread.join();
+}
+
+
+void ChunkStreamer::setGenerator(const function<void(ivec3 chunkPos, BlockId *blocks)> &generator)
+{
+	lock_guard<mutex> lock(streamMutex);
+	this->generator = generator;
+}
+
+
+bool ChunkStreamer::update(World &world, vec3 cameraPos, vec3 cameraFront, double time)
+{
+	bool changed = addResults(world);
+
+	// Recent movement
+	if (hasCamera && time > lastTime)
+	{
+		vec3 sample = (cameraPos - lastCameraPos) / (float)(time - lastTime);
+		velocity = mix(velocity, sample, VELOCITY_SMOOTHING);
+	}
+	lastCameraPos = cameraPos;
+	lastTime = time;
+	hasCamera = true;
+
+	vector<ivec3> foci = predictFocus(cameraPos, cameraFront);
+	if (foci != focusChunks)
+	{
+		focusChunks = foci;
+		requestChunks(world, cameraFront);
+		changed = evictChunks(world) || changed;
+	}
+
+	countNotReady(world, cameraPos, cameraFront);
+	return changed;
+}
+
+
+vector<ivec3> ChunkStreamer::predictFocus(vec3 cameraPos, vec3 cameraFront) const
+{
+	vector<ivec3> foci(1, chunkPosOf(cellOf(cameraPos)));
+
+	float speed = length(velocity);
+	if (! prefetchEnabled || speed < MIN_PREFETCH_SPEED)
+		return foci;
+
+	// Moving forwards, the path bends towards where the camera looks
+	vec3 direction = velocity / speed;
+	if (dot(direction, cameraFront) > 0.0f)
+		direction = normalize(mix(direction, cameraFront, VIEW_DIRECTION_WEIGHT));
+
+	// Predictions beyond twice the load radius would only cost memory
+	float maxDistance = 2.0f * loadRadius * CHUNK_SIZE;
+	for (float time : PREFETCH_TIMES)
+	{
+		ivec3 chunkPos = chunkPosOf(cellOf(cameraPos + direction * std::min(speed * time, maxDistance)));
+		if (chunkPos != foci.back())
+			foci.push_back(chunkPos);
+	}
+	return foci;
+}
+
+
+bool ChunkStreamer::isInRange(ivec3 chunkPos) const
+{
+	if (distanceSquared(chunkPos, focusChunks[0]) <= unloadRadius * unloadRadius)
+		return true;
+
+	// Prefetched chunks stay while they're near the predicted path
+	for (size_t i = 1; i < focusChunks.size(); i++)
+	{
+		if (distanceSquared(chunkPos, focusChunks[i]) <= (PREFETCH_RADIUS + 1) * (PREFETCH_RADIUS + 1))
+			return true;
+	}
+	return false;
+}
+
+
+bool ChunkStreamer::waitForLoads(World &world)
+{
+	bool changed = false;
+	while (! loading.empty())
+	{
+		{
+			unique_lock<mutex> lock(streamMutex);
+			resultCondition.wait(lock, [this] { return ! results.empty(); });
+		}
+		changed = addResults(world) || changed;
+	}
+	return changed;
+}
+
+
+bool ChunkStreamer::isReady(const World &world, ivec3 chunkPos) const
+{
+	return world.getChunk(chunkPos) || absent.count(chunkPos);
+}
+
+
+bool ChunkStreamer::addResults(World &world)
+{
+	vector<LoadResult> loaded;
+	{
+		lock_guard<mutex> lock(streamMutex);
+		loaded.swap(results);
+	}
+
+	bool changed = false;
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	for (LoadResult &result : loaded)
+	{
+		// Chunks that were cancelled in the meantime are dropped
+		auto request = loading.find(result.pos);
+		if (request == loading.end())
+			continue;
+		loadTimes.add(chrono::duration<double, milli>(now - request->second).count());
+		loading.erase(request);
+
+		Chunk *existing = world.getChunk(result.pos);
+		if (! result.chunk)
+		{
+			if (! existing)
+				absent.insert(result.pos);
+			continue;
+		}
+
+		// Blocks placed into the chunk while it was loading are kept
+		if (existing)
+		{
+			BlockId *blocks = result.chunk->mutableBlocks();
+			for (int i = 0; i < CHUNK_VOLUME; i++)
+			{
+				if (existing->get(i) != AIR)
+					blocks[i] = existing->get(i);
+			}
+			result.chunk->modified = true;
+		}
+
+		world.setChunk(result.pos, std::move(result.chunk));
+		nrLoaded++;
+		changed = true;
+	}
+
+	return changed;
+}
+
+
+void ChunkStreamer::requestChunks(World &world, vec3 cameraFront)
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	vector<ivec3> newRequests;
+
+	// The load radius around the camera and the prefetch radius around the predicted positions
+	for (size_t focus = 0; focus < focusChunks.size(); focus++)
+	{
+		const vector<ivec3> &offsets = focus == 0 ? loadOffsets : prefetchOffsets;
+		for (const ivec3 &offset : offsets)
+		{
+			// The world has no blocks below y = 0
+			ivec3 chunkPos = focusChunks[focus] + offset;
+			if (chunkPos.y < 0 || world.getChunk(chunkPos) || loading.count(chunkPos) || absent.count(chunkPos))
+				continue;
+
+			// Chunks evicted before they were saved are restored without touching the disk
+			bool modified;
+			shared_ptr<const ChunkBlocks> unsaved = autosave.takeUnsaved(chunkPos, modified);
+			if (unsaved)
+			{
+				unique_ptr<Chunk> chunk(new Chunk());
+				chunk->restore(unsaved);
+				chunk->modified = modified;
+				world.setChunk(chunkPos, std::move(chunk));
+				nrRestored++;
+				continue;
+			}
+
+			loading[chunkPos] = now;
+			newRequests.push_back(chunkPos);
+		}
+	}
+
+	// Requests that are out of range now are cancelled
+	vector<ivec3> cancelled;
+	{
+		lock_guard<mutex> lock(streamMutex);
+		for (size_t i = 0; i < requests.size(); )
+		{
+			if (! isInRange(requests[i]))
+			{
+				cancelled.push_back(requests[i]);
+				requests[i] = requests.back();
+				requests.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+		requests.insert(requests.end(), newRequests.begin(), newRequests.end());
+		requestFoci = focusChunks;
+		requestFront = prefetchEnabled ? cameraFront : vec3(0.0f);
+	}
+	requestCondition.notify_all();
+
+	for (const ivec3 &chunkPos : cancelled)
+		loading.erase(chunkPos);
+}
+
+
+bool ChunkStreamer::evictChunks(World &world)
+{
+	vector<ivec3> farChunks;
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		if (! isInRange(entry.first))
+			farChunks.push_back(entry.first);
+	}
+
+	for (const ivec3 &chunkPos : farChunks)
+	{
+		Chunk *chunk = world.getChunk(chunkPos);
+		if (chunk->modified)
+		{
+			autosave.addEvicted({ chunkPos, chunk->snapshot() });
+			nrWrittenBack++;
+		}
+		world.removeChunk(chunkPos);
+		nrEvicted++;
+	}
+
+	for (auto it = absent.begin(); it != absent.end(); )
+	{
+		if (! isInRange(*it))
+			it = absent.erase(it);
+		else
+			++it;
+	}
+
+	return ! farChunks.empty();
+}
+
+
+void ChunkStreamer::ioLoop()
+{
+	unique_lock<mutex> lock(streamMutex);
+	while (true)
+	{
+		requestCondition.wait(lock, [this] { return stopping || ! requests.empty(); });
+		if (stopping)
+			return;
+
+		// Nearest chunk to the camera or the predicted path first. Later predicted positions count as
+		// farther away, chunks behind the camera as twice as far.
+		size_t nearest = 0;
+		int nearestDistance = INT_MAX;
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			int distance = INT_MAX;
+			for (size_t focus = 0; focus < requestFoci.size(); focus++)
+				distance = std::min(distance, distanceSquared(requests[i], requestFoci[focus]) + (int)(4 * focus * focus));
+			if (dot(vec3(requests[i] - requestFoci[0]), requestFront) < 0.0f)
+				distance *= 4;
+
+			if (distance < nearestDistance)
+			{
+				nearest = i;
+				nearestDistance = distance;
+			}
+		}
+		ivec3 chunkPos = requests[nearest];
+		requests[nearest] = requests.back();
+		requests.pop_back();
+		function<void(ivec3, BlockId*)> generate = generator;
+
+		lock.unlock();
+		unique_ptr<Chunk> chunk(new Chunk());
+		if (! storage.loadChunk(chunkPos, *chunk))
+		{
+			if (generate)
+				generate(chunkPos, chunk->mutableBlocks());
+			if (chunk->isEmpty())
+				chunk.reset();
+		}
+		lock.lock();
+
+		results.push_back({ chunkPos, std::move(chunk) });
+		resultCondition.notify_all();
+	}
+}
+
+
+void ChunkStreamer::countNotReady(const World &world, vec3 cameraPos, vec3 cameraFront)
+{
+	// Chunks in the view cone that are within the view distance but not loaded yet
+	const float chunkRadius = CHUNK_SIZE * 0.87f;   // Half the diagonal of a chunk
+	const float viewDistance = (float)(loadRadius * CHUNK_SIZE);
+	const float halfAngle = radians(VISIBLE_HALF_ANGLE);
+
+	size_t nrVisible = 0, nrMissing = 0;
+	for (const ivec3 &offset : loadOffsets)
+	{
+		ivec3 chunkPos = focusChunks[0] + offset;
+		if (chunkPos.y < 0)
+			continue;
+
+		vec3 toChunk = vec3(chunkPos * CHUNK_SIZE) + vec3(CHUNK_SIZE / 2 - 0.5f) - cameraPos;
+		float distance = length(toChunk);
+		if (distance > viewDistance + chunkRadius)
+			continue;
+		if (distance > chunkRadius && acos(glm::clamp(dot(toChunk / distance, cameraFront), -1.0f, 1.0f)) >
+			halfAngle + asin(chunkRadius / distance))
+			continue;
+
+		nrVisible++;
+		if (! isReady(world, chunkPos))
+			nrMissing++;
+	}
+
+	nrVisibleChecks += nrVisible;
+	nrNotReady += nrMissing;
+	nrNotReadyFrames += nrMissing > 0;
+	nrFrames++;
+}
+
+
+size_t ChunkStreamer::memoryUsage(const World &world) const
+{
+	// Chunk objects, the chunk map entries and the block storage, which identical chunks share and
+	// cold chunks keep compressed
+	size_t memory = world.nrChunks() * (sizeof(Chunk) + sizeof(ChunkMap::value_type) + 2 * sizeof(void*)) +
+		world.nrStorageBlocks() * sizeof(ChunkBlocks);
+	for (const ChunkMap::value_type &entry : world.getChunks())
+		memory += entry.second->compressedSize();
+	return memory;
+}
+
+
+void ChunkStreamer::printStats(const World &world) const
+{
+	std::cout << "Chunk streaming: " << world.nrChunks() << " resident chunks (" << memoryUsage(world) / 1024 << " KB), " <<
+		nrLoaded << " loaded, " << nrRestored << " restored, " << nrEvicted << " evicted (" << nrWrittenBack << " written back)" << endl;
+	size_t nrStorageBlocks = world.nrStorageBlocks();
+	if (nrStorageBlocks > 0)
+	{
+		std::cout << "  shared storage: " << world.nrChunks() << " chunks in " << nrStorageBlocks << " storage blocks (deduplication ratio " <<
+			(double)world.nrChunks() / nrStorageBlocks << ", " << (world.nrChunks() - nrStorageBlocks) * sizeof(ChunkBlocks) / 1024 << " KB saved)" << endl;
+	}
+	if (loadTimes.count() > 0)
+		loadTimes.print("  load latency", "ms");
+	if (nrVisibleChecks > 0)
+	{
+		std::cout << "  not ready when visible: " << notReadyRate() << " % of the visible chunks, in " <<
+			nrNotReadyFrames << " of " << nrFrames << " frames" << endl;
+	}
+}
\ No newline at end of file
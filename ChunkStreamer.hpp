@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+#include "World.hpp"
+#include "WorldStorage.hpp"
+#include "Autosave.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// Keeps the chunks within a radius around the camera resident in the world. Missing chunks are loaded
+// (or generated) on background I/O threads, the nearest ones first. Chunks beyond the unload radius are
+// evicted, modified ones are written back through the autosave.
+// With prefetching, the camera position is extrapolated from its recent movement and view direction and
+// the chunks along the predicted path are requested as well, with the same priority as those next to
+// the camera, so they are ready when a fast moving camera reaches them.
+class ChunkStreamer
+{
+	private:
+		struct LoadResult {
+			ivec3 pos;
+			unique_ptr<Chunk> chunk;   // NULL if the chunk is neither stored nor generated
+		};
+
+		WorldStorage &storage;
+		Autosave &autosave;
+		int loadRadius;     // In chunks
+		int unloadRadius;   // In chunks, larger than loadRadius so chunks at the border don't flicker
+		vector<ivec3> loadOffsets;       // Chunks within loadRadius
+		vector<ivec3> prefetchOffsets;   // Chunks within the prefetch radius
+
+		// Main thread only
+		unordered_map<ivec3, chrono::steady_clock::time_point, ChunkPosHash> loading;   // Requested chunks and when
+		unordered_set<ivec3, ChunkPosHash> absent;                                      // Chunks known to be empty
+		vector<ivec3> focusChunks;   // The camera's chunk followed by the chunks on the predicted path
+
+		// Camera motion
+		bool prefetchEnabled;
+		bool hasCamera;
+		vec3 lastCameraPos;
+		double lastTime;
+		vec3 velocity;   // Smoothed, in blocks per second
+
+		// Shared with the I/O threads
+		vector<thread> ioThreads;
+		mutex streamMutex;
+		condition_variable requestCondition;
+		condition_variable resultCondition;
+		vector<ivec3> requests;          // Chunks to load, the one nearest to a focus chunk first
+		vector<ivec3> requestFoci;
+		vec3 requestFront;               // View direction, chunks behind the camera are loaded last
+		vector<LoadResult> results;      // Loaded chunks waiting to be added to the world
+		function<void(ivec3, BlockId*)> generator;
+		bool stopping;
+
+		// Statistics
+		LatencyStats loadTimes;   // ms from the request to the chunk becoming resident
+		size_t nrLoaded;
+		size_t nrRestored;
+		size_t nrEvicted;
+		size_t nrWrittenBack;
+		size_t nrVisibleChecks;   // Visible chunks summed over all frames
+		size_t nrNotReady;        // Of which weren't loaded yet
+		size_t nrNotReadyFrames;
+		size_t nrFrames;
+
+		void ioLoop();
+		bool addResults(World &world);
+		vector<ivec3> predictFocus(vec3 cameraPos, vec3 cameraFront) const;
+		bool isInRange(ivec3 chunkPos) const;
+		void requestChunks(World &world, vec3 cameraFront);
+		bool evictChunks(World &world);
+		void countNotReady(const World &world, vec3 cameraPos, vec3 cameraFront);
+
+	public:
+		ChunkStreamer(WorldStorage &storage, Autosave &autosave, int loadRadius, int unloadRadius, int nrThreads = 2);
+		~ChunkStreamer();
+
+		// Chunks that aren't stored are filled by the generator on the I/O threads (without a generator
+		// they stay absent). Has to be set before the first update.
+		void setGenerator(const function<void(ivec3 chunkPos, BlockId *blocks)> &generator);
+
+		void setPrefetch(bool enabled) { prefetchEnabled = enabled; }
+
+		// Called every frame on the main thread with the current time in seconds: adds the loaded chunks
+		// to the world, requests the missing ones and evicts the far ones when the camera entered another
+		// chunk (or the predicted path changed). Returns true if chunks were added or removed.
+		bool update(World &world, vec3 cameraPos, vec3 cameraFront, double time);
+
+		// Wait until all requested chunks are resident
+		bool waitForLoads(World &world);
+
+		// Whether the chunk's blocks are known: it's resident or neither stored nor generated
+		bool isReady(const World &world, ivec3 chunkPos) const;
+
+		// Number of chunks still being loaded
+		size_t nrLoading() const { return loading.size(); }
+
+		// Approximate memory used by the resident chunks in bytes
+		size_t memoryUsage(const World &world) const;
+		const LatencyStats &getLoadTimes() const { return loadTimes; }
+
+		// Percentage of the visible chunks that weren't loaded yet, summed over all frames
+		double notReadyRate() const { return nrVisibleChecks > 0 ? 100.0 * nrNotReady / nrVisibleChecks : 0.0; }
+
+		void printStats(const World &world) const;
+};
\ No newline at end of file
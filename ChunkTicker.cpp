@@ -0,0 +1,102 @@
+#include "ChunkTicker.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <unordered_set>
+
+
+
+Chunk *ChunkRegion::chunkOf(ivec3 pos) const
+{
+	ivec3 offset = chunkPosOf(pos) - chunkPos + 1;
+	if (offset.x < 0 || offset.x > 2 || offset.y < 0 || offset.y > 2 || offset.z < 0 || offset.z > 2)
+		return NULL;
+	return chunks[offset.x + offset.z * 3 + offset.y * 9];
+}
+
+
+BlockId ChunkRegion::getBlock(ivec3 pos) const
+{
+	const Chunk *chunk = chunkOf(pos);
+	return chunk ? chunk->get(blockIndexOf(pos)) : AIR;
+}
+
+
+bool ChunkRegion::setBlock(ivec3 pos, BlockId id)
+{
+	Chunk *chunk = chunkOf(pos);
+	if (! chunk)
+		return false;
+
+	BlockId oldId = chunk->get(blockIndexOf(pos));
+	if (oldId != id)
+	{
+		chunk->set(blockIndexOf(pos), id);
+		changes.push_back({ pos, oldId, id });
+	}
+	return true;
+}
+
+
+
+ChunkTicker::ChunkTicker(JobSystem &jobs) : jobs(jobs)
+{
+	nrTicks = 0;
+	nrChunkTicks = 0;
+}
+
+
+void ChunkTicker::tick(World &world, const vector<ivec3> &chunkPositions, const function<void(ChunkRegion&)> &tickChunk,
+	vector<BlockChange> &changes)
+{
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	// The regions are resolved up front: looking chunks up in the world and decompressing them isn't thread-safe
+	vector<ChunkRegion> phases[NR_COLORS];
+	unordered_set<ivec3, ChunkPosHash> seen;
+	for (const ivec3 &chunkPos : chunkPositions)
+	{
+		if (! world.getChunk(chunkPos) || ! seen.insert(chunkPos).second)
+			continue;
+
+		ChunkRegion region;
+		region.chunkPos = chunkPos;
+		for (int i = 0; i < 27; i++)
+		{
+			Chunk *chunk = world.getChunk(chunkPos + ivec3(i % 3, i / 9, (i / 3) % 3) - 1);
+			if (chunk)
+				chunk->blocks();
+			region.chunks[i] = chunk;
+		}
+
+		ivec3 color = ((chunkPos % 3) + 3) % 3;
+		phases[color.x + color.z * 3 + color.y * 9].push_back(region);
+	}
+
+	for (vector<ChunkRegion> &regions : phases)
+	{
+		if (regions.empty())
+			continue;
+
+		jobs.parallelFor(0, regions.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				tickChunk(regions[i]);
+		});
+
+		for (const ChunkRegion &region : regions)
+			changes.insert(changes.end(), region.changes.begin(), region.changes.end());
+		nrChunkTicks += regions.size();
+	}
+
+	nrTicks++;
+	tickTimes.add(chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count());
+}
+
+
+void ChunkTicker::printStats() const
+{
+	std::cout << "Chunk ticks: " << nrChunkTicks << " chunks in " << nrTicks << " ticks on " << jobs.getNrThreads() << " threads" << endl;
+	if (tickTimes.count() > 0)
+		tickTimes.print("Chunk tick", "ms");
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "World.hpp"
+#include "JobSystem.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// A block changed by a chunk tick, reported back to the caller in a deterministic order
+struct BlockChange {
+	ivec3 pos;
+	BlockId oldId;
+	BlockId newId;
+};
+
+
+// The chunk being ticked and its 26 neighbours. A tick may read and write any block of them, but no other
+// chunk and no state shared with other chunk ticks.
+class ChunkRegion
+{
+	friend class ChunkTicker;
+
+	private:
+		ivec3 chunkPos;
+		Chunk *chunks[27];           // NULL where no chunk is loaded
+		vector<BlockChange> changes;
+
+		Chunk *chunkOf(ivec3 pos) const;
+
+	public:
+		ivec3 getChunkPos() const { return chunkPos; }
+		const Chunk *getChunk() const { return chunks[13]; }
+
+		// Blocks outside of the region or of loaded chunks are air and can't be set
+		BlockId getBlock(ivec3 pos) const;
+		bool setBlock(ivec3 pos, BlockId id);
+};
+
+
+// Ticks chunks in parallel on the job system. The chunks are colored by their coordinates modulo 3,
+// so the regions (3x3x3 chunks) of two chunks with the same color never overlap. The 27 colors are ticked one
+// after the other, the chunks of a color in parallel. As long as every chunk tick only depends on its region,
+// the result is the same for any number of threads. The changes are reported by color, then in the order
+// the chunks were given.
+class ChunkTicker
+{
+	private:
+		static const int NR_COLORS = 27;
+
+		JobSystem &jobs;
+
+		size_t nrTicks;
+		size_t nrChunkTicks;
+		LatencyStats tickTimes;   // ms
+
+	public:
+		ChunkTicker(JobSystem &jobs = JobSystem::shared());
+
+		// Tick each of the given chunks once and append the blocks changed. Duplicates and chunks that aren't
+		// loaded are skipped. No chunk may be loaded or evicted while a tick runs.
+		void tick(World &world, const vector<ivec3> &chunkPositions, const function<void(ChunkRegion&)> &tickChunk,
+			vector<BlockChange> &changes);
+
+		int getNrThreads() const { return jobs.getNrThreads(); }
+		const LatencyStats &getTickTimes() const { return tickTimes; }
+		void printStats() const;
+};
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "EditJournal.hpp"
+#include "Hash.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+
+
+
+static const uint32_t JOURNAL_MAGIC = 0x4E524A4B;   // "KJRN"
+static const uint32_t JOURNAL_VERSION = 1;
+
+// Edits are synced to the disk at least this often, or earlier when a batch is full
+static const chrono::milliseconds FLUSH_INTERVAL(50);
+static const size_t BATCH_SIZE = 4096;
+
+
+
+static uint16_t recordChecksum(const JournalRecord &record)
+{
+	return (uint16_t)hashBytes(&record, offsetof(JournalRecord, checksum));
+}
+
+
+
+EditJournal::EditJournal()
+{
+	nextSequence = 1;
+	nrReplayed = 0;
+	compactSequence = 0;
+	compactedSequence = 0;
+	durableSequence = 0;
+	nrFailedWrites = 0;
+	rewriteNeeded = false;
+	flushRequested = false;
+	stopping = false;
+	nrBatches = 0;
+	nrRecordsWritten = 0;
+}
+
+
+EditJournal::~EditJournal()
+{
+	close();
+}
+
+
+bool EditJournal::open(const string &path, World &world, WorldStorage *storage,
+	const function<void(ivec3 chunkPos, BlockId *blocks)> &generator)
+{
+	this->path = path;
+
+	// Read the valid records, a crash may have left a torn record at the end
+	bool valid = false;
+	size_t fileSize = 0;
+	ifstream in(path, ios::binary);
+	if (in)
+	{
+		uint32_t header[2] = { 0, 0 };
+		in.read((char*)header, sizeof(header));
+		valid = in && header[0] == JOURNAL_MAGIC && header[1] == JOURNAL_VERSION;
+		if (! valid)
+			std::cerr << "ERROR::JOURNAL::INVALID_HEADER: " << path << endl;
+
+		JournalRecord record;
+		while (valid && in.read((char*)&record, sizeof(record)))
+		{
+			if (record.checksum != recordChecksum(record) ||
+				(! retained.empty() && record.sequence != retained.back().sequence + 1))
+				break;
+			retained.push_back(record);
+		}
+
+		in.clear();
+		in.seekg(0, ios::end);
+		fileSize = (size_t)in.tellg();
+	}
+	in.close();
+
+	// Replay the edits, each sets the block to its new type, so edits the region files already
+	// contain are simply repeated
+	for (const JournalRecord &record : retained)
+	{
+		ivec3 pos(record.x, record.y, record.z);
+		ivec3 chunkPos = chunkPosOf(pos);
+		if (storage && ! world.getChunk(chunkPos))
+		{
+			Chunk &chunk = world.getOrCreateChunk(chunkPos);
+			if (! storage->loadChunk(chunkPos, chunk) && generator)
+				generator(chunkPos, chunk.mutableBlocks());
+		}
+		world.setBlock(pos, record.newId);
+	}
+	nrReplayed = retained.size();
+	if (! retained.empty())
+	{
+		nextSequence = retained.back().sequence + 1;
+		durableSequence = retained.back().sequence;
+		compactedSequence = retained.front().sequence - 1;
+	}
+
+	// Start a new file or cut off the invalid rest of the old one
+	bool opened;
+	if (! valid || fileSize != 2 * sizeof(uint32_t) + retained.size() * sizeof(JournalRecord))
+		opened = rewrite();
+	else
+		opened = file.open(path, false);
+	if (! opened)
+	{
+		std::cerr << "ERROR::JOURNAL::FILE_COULD_NOT_BE_OPENED: " << path << endl;
+		return false;
+	}
+
+	stopping = false;
+	flusher = thread(&EditJournal::flusherLoop, this);
+	return true;
+}
+
+
+void EditJournal::close()
+{
+	if (! flusher.joinable())
+		return;
+
+	{
+		lock_guard<mutex> lock(journalMutex);
+		stopping = true;
+	}
+	flushCondition.notify_one();
+	flusher.join();
+	file.close();
+}
+
+
+uint32_t EditJournal::append(ivec3 pos, BlockId oldId, BlockId newId)
+{
+	JournalRecord record;
+	record.sequence = nextSequence++;
+	record.x = pos.x;
+	record.y = pos.y;
+	record.z = pos.z;
+	record.oldId = oldId;
+	record.newId = newId;
+	record.checksum = recordChecksum(record);
+
+	bool batchFull;
+	{
+		lock_guard<mutex> lock(journalMutex);
+		unwritten.push_back(record);
+		batchFull = unwritten.size() >= BATCH_SIZE;
+	}
+	if (batchFull)
+		flushCondition.notify_one();
+
+	return record.sequence;
+}
+
+
+void EditJournal::compact(uint32_t sequence)
+{
+	{
+		lock_guard<mutex> lock(journalMutex);
+		if (sequence <= compactedSequence)
+			return;
+		compactSequence = compactedSequence = sequence;
+	}
+	flushCondition.notify_one();
+}
+
+
+bool EditJournal::sync()
+{
+	unique_lock<mutex> lock(journalMutex);
+	uint32_t sequence = lastSequence();
+	size_t failedWrites = nrFailedWrites;
+	flushRequested = true;
+	flushCondition.notify_one();
+	durableCondition.wait(lock, [this, sequence, failedWrites] {
+		return durableSequence >= sequence || nrFailedWrites != failedWrites || ! flusher.joinable();
+	});
+	return durableSequence >= sequence;
+}
+
+
+void EditJournal::flusherLoop()
+{
+	unique_lock<mutex> lock(journalMutex);
+	while (true)
+	{
+		flushCondition.wait_for(lock, FLUSH_INTERVAL, [this] {
+			return stopping || flushRequested || compactSequence != 0 || unwritten.size() >= BATCH_SIZE;
+		});
+
+		vector<JournalRecord> batch;
+		batch.swap(unwritten);
+		uint32_t compactTo = compactSequence;
+		compactSequence = 0;
+		flushRequested = false;
+		bool stop = stopping;
+
+		// Write without holding the lock, so appending edits never waits for the disk
+		lock.unlock();
+		chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+		bool written = true;
+		uint32_t lastRetained = retained.empty() ? 0 : retained.back().sequence;
+		if (compactTo != 0 || rewriteNeeded)
+		{
+			size_t nrCompacted = 0;
+			while (nrCompacted < retained.size() && retained[nrCompacted].sequence <= compactTo)
+				nrCompacted++;
+			retained.erase(retained.begin(), retained.begin() + nrCompacted);
+			retained.insert(retained.end(), batch.begin(), batch.end());
+			written = rewrite();
+		}
+		else if (! batch.empty())
+		{
+			written = file.append(batch.data(), batch.size() * sizeof(JournalRecord)) && file.sync();
+			retained.insert(retained.end(), batch.begin(), batch.end());
+
+			// A failed append may have left a partial record, the rewrite drops it
+			if (! written)
+				written = rewrite();
+		}
+		double syncTime = chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count();
+		if (! written)
+			std::cerr << "ERROR::JOURNAL::FILE_COULD_NOT_BE_WRITTEN: " << path << endl;
+
+		// After a failure the whole file is rewritten until it succeeds, the timeout of the wait retries it
+		rewriteNeeded = ! written;
+		lock.lock();
+
+		if (! written)
+		{
+			nrFailedWrites++;
+		}
+		else
+		{
+			// A retry also makes the edits of the failed batches durable
+			durableSequence = std::max(durableSequence, lastRetained);
+			if (! batch.empty())
+			{
+				durableSequence = batch.back().sequence;
+				syncTimes.add(syncTime);
+				nrBatches++;
+				nrRecordsWritten += batch.size();
+			}
+		}
+		durableCondition.notify_all();
+
+		if (stop)
+			return;
+	}
+}
+
+
+bool EditJournal::rewrite()
+{
+	vector<uint8_t> image(2 * sizeof(uint32_t) + retained.size() * sizeof(JournalRecord));
+	uint32_t header[2] = { JOURNAL_MAGIC, JOURNAL_VERSION };
+	memcpy(&image[0], header, sizeof(header));
+	if (! retained.empty())
+		memcpy(&image[sizeof(header)], retained.data(), retained.size() * sizeof(JournalRecord));
+
+	// The open file has to be closed before it can be replaced on Windows
+	file.close();
+	bool written = writeFileAtomically(path, image.data(), image.size());
+	return file.open(path, false) && written;
+}
+
+
+void EditJournal::printStats() const
+{
+	lock_guard<mutex> lock(journalMutex);
+	std::cout << "Edit journal: " << nrRecordsWritten << " edits in " << nrBatches << " batches (" <<
+		nrRecordsWritten * sizeof(JournalRecord) << " bytes), " << nrReplayed << " edits replayed at startup" << endl;
+	if (nrBatches > 0)
+		syncTimes.print("  write and sync", "ms");
+}
\ No newline at end of file
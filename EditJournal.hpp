@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "World.hpp"
+#include "WorldStorage.hpp"
+#include "FileSystem.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// One block edit, 20 bytes in the journal file
+#pragma pack(push, 1)
+struct JournalRecord {
+	uint32_t sequence;    // Increases by one with every edit
+	int32_t x, y, z;      // Block position
+	BlockId oldId;
+	BlockId newId;
+	uint16_t checksum;    // Detects a record that was torn by a crash
+};
+#pragma pack(pop)
+
+
+
+// Write-ahead log of block edits: every edit is appended to the journal before the region files
+// contain it. A flusher thread writes the edits in batches and syncs them to the disk, so an edit is
+// durable within FLUSH_INTERVAL without the main thread waiting for the disk. Once the region files
+// contain the edits up to a sequence number (after an autosave), the journal is compacted to the
+// later edits. After a crash the edits left in the journal are replayed onto the loaded world.
+class EditJournal
+{
+	private:
+		string path;
+		AppendFile file;
+		uint32_t nextSequence;
+		size_t nrReplayed;
+
+		thread flusher;
+		mutable mutex journalMutex;
+		condition_variable flushCondition;
+		condition_variable durableCondition;
+		vector<JournalRecord> unwritten;   // Appended but not yet handed to the flusher
+		uint32_t compactSequence;          // Requested compaction (0 = none)
+		uint32_t compactedSequence;        // Edits up to this one are or will be dropped
+		uint32_t durableSequence;          // Last edit synced to the disk
+		size_t nrFailedWrites;             // Wakes up sync() with an error
+		bool flushRequested;
+		bool stopping;
+
+		// Flusher thread only: the records in the file, needed to rewrite it when compacting or after a
+		// failed write (the file may be missing records then)
+		vector<JournalRecord> retained;
+		bool rewriteNeeded;
+
+		// Statistics
+		LatencyStats syncTimes;   // ms
+		size_t nrBatches;
+		size_t nrRecordsWritten;
+
+		void flusherLoop();
+		bool rewrite();
+
+	public:
+		EditJournal();
+		~EditJournal();
+
+		// Open the journal file and replay the edits it contains onto the world. Chunks the edits touch
+		// are loaded from the storage first unless the world already contains them (if no storage is
+		// given, the world has to be loaded completely). Chunks that aren't stored are filled by the
+		// terrain generator, if there is one. Starts the flusher thread.
+		bool open(const string &path, World &world, WorldStorage *storage = NULL,
+			const function<void(ivec3 chunkPos, BlockId *blocks)> &generator = nullptr);
+
+		// Stop the flusher thread after writing all edits
+		void close();
+
+		// Append an edit, returns its sequence number
+		uint32_t append(ivec3 pos, BlockId oldId, BlockId newId);
+
+		// Sequence number of the last edit appended
+		uint32_t lastSequence() const { return nextSequence - 1; }
+
+		// Drop the edits up to the given sequence number from the journal, as the region files contain them
+		void compact(uint32_t sequence);
+
+		// Wait until all edits appended so far are on the disk, returns false if writing them failed (they
+		// are written again with the next batch)
+		bool sync();
+
+		size_t getNrReplayed() const { return nrReplayed; }
+		void printStats() const;
+};
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "Entities.hpp"
+
+#include <atomic>
+
+
+
+int nextComponentTypeId()
+{
+	static atomic<int> nextId(0);
+	return nextId++;
+}
+
+
+
+EntityRegistry::EntityRegistry()
+{
+	for (size_t &size : componentSizes)
+		size = 0;
+	nrAlive = 0;
+}
+
+
+void EntityRegistry::destroy(Entity entity)
+{
+	if (! isAlive(entity))
+		return;
+
+	Slot &slot = slots[entity.index];
+	removeRow(slot.archetype, slot.row);
+	slot.alive = false;
+	slot.generation++;
+	freeSlots.push_back(entity.index);
+	nrAlive--;
+}
+
+
+bool EntityRegistry::isAlive(Entity entity) const
+{
+	return entity.index < slots.size() && slots[entity.index].alive && slots[entity.index].generation == entity.generation;
+}
+
+
+Entity EntityRegistry::allocate()
+{
+	uint32_t index;
+	if (! freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		index = (uint32_t)slots.size();
+		slots.push_back({ 0, 0, 0, false });
+	}
+
+	slots[index].alive = true;
+	nrAlive++;
+	return { index, slots[index].generation };
+}
+
+
+uint32_t EntityRegistry::archetypeWith(uint64_t types)
+{
+	unordered_map<uint64_t, uint32_t>::iterator it = archetypeOfTypes.find(types);
+	if (it != archetypeOfTypes.end())
+		return it->second;
+
+	unique_ptr<Archetype> archetype(new Archetype());
+	archetype->types = types;
+	for (int id = 0; id < MAX_COMPONENT_TYPES; id++)
+	{
+		archetype->columnOf[id] = -1;
+		if (types & ((uint64_t)1 << id))
+		{
+			archetype->columnOf[id] = (int)archetype->columns.size();
+			archetype->columns.push_back(vector<uint8_t>());
+			archetype->columnTypes.push_back(id);
+		}
+	}
+
+	uint32_t index = (uint32_t)archetypes.size();
+	archetypes.push_back(std::move(archetype));
+	archetypeOfTypes[types] = index;
+	return index;
+}
+
+
+uint32_t EntityRegistry::appendRow(uint32_t archetype, Entity entity)
+{
+	Archetype &table = *archetypes[archetype];
+	uint32_t row = (uint32_t)table.entities.size();
+	table.entities.push_back(entity);
+	for (size_t i = 0; i < table.columns.size(); i++)
+		table.columns[i].resize((row + 1) * componentSizes[table.columnTypes[i]]);
+
+	slots[entity.index].archetype = archetype;
+	slots[entity.index].row = row;
+	return row;
+}
+
+
+void EntityRegistry::moveEntity(Entity entity, uint32_t archetype)
+{
+	uint32_t oldArchetype = slots[entity.index].archetype;
+	uint32_t oldRow = slots[entity.index].row;
+	uint32_t row = appendRow(archetype, entity);
+
+	Archetype &from = *archetypes[oldArchetype];
+	Archetype &to = *archetypes[archetype];
+	for (size_t i = 0; i < from.columns.size(); i++)
+	{
+		int id = from.columnTypes[i];
+		if (to.columnOf[id] >= 0)
+		{
+			size_t size = componentSizes[id];
+			memcpy(to.columns[to.columnOf[id]].data() + row * size, from.columns[i].data() + oldRow * size, size);
+		}
+	}
+	removeRow(oldArchetype, oldRow);
+}
+
+
+void EntityRegistry::removeRow(uint32_t archetype, uint32_t row)
+{
+	Archetype &table = *archetypes[archetype];
+	uint32_t last = (uint32_t)table.entities.size() - 1;
+	for (size_t i = 0; i < table.columns.size(); i++)
+	{
+		size_t size = componentSizes[table.columnTypes[i]];
+		vector<uint8_t> &column = table.columns[i];
+		if (row != last)
+			memcpy(column.data() + row * size, column.data() + last * size, size);
+		column.resize(last * size);
+	}
+
+	if (row != last)
+	{
+		Entity moved = table.entities[last];
+		table.entities[row] = moved;
+		slots[moved.index].row = row;
+	}
+	table.entities.pop_back();
+}
+
+
+void *EntityRegistry::component(Entity entity, int typeId)
+{
+	if (! isAlive(entity))
+		return NULL;
+
+	const Slot &slot = slots[entity.index];
+	Archetype &table = *archetypes[slot.archetype];
+	int column = table.columnOf[typeId];
+	if (column < 0)
+		return NULL;
+	return table.columns[column].data() + slot.row * componentSizes[typeId];
+}
\ No newline at end of file
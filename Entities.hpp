@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+
+// Handle of an entity. It stays valid while the entity exists, wherever its components are moved;
+// the generation tells a destroyed entity from a later one that got the same index.
+struct Entity {
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const Entity &other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity &other) const { return ! (*this == other); }
+};
+
+const Entity NO_ENTITY = { 0xffffffffu, 0 };
+
+const int MAX_COMPONENT_TYPES = 64;
+
+// Id of a component type, assigned on first use
+int nextComponentTypeId();
+
+template <class C>
+int componentTypeId()
+{
+	static const int id = nextComponentTypeId();
+	return id;
+}
+
+
+// Entities and their components, stored by archetype: all entities with the same set of component types
+// share a table with a column per type, so the components of a type lie densely next to each other
+// and a system walking a few component types only touches their columns (structure of arrays).
+// Adding or removing a component moves the entity's row to the table of its new set of types, destroying
+// an entity moves the table's last row into its place.
+// Components are plain structs (trivially copyable), an entity has at most one of each type. Entities
+// must not be created, destroyed or change their types inside forEach. Not thread-safe.
+class EntityRegistry
+{
+	private:
+		struct Archetype {
+			uint64_t types;                   // Bit per component type id
+			vector<Entity> entities;          // Entity of each row
+			vector<vector<uint8_t>> columns;  // Components of each type, ordered by type id
+			vector<int> columnTypes;          // Type id of each column
+			int columnOf[MAX_COMPONENT_TYPES];   // Column of each type id, -1 if not in the archetype
+		};
+
+		// Where the components of each entity are, by entity index
+		struct Slot {
+			uint32_t generation;
+			uint32_t archetype;
+			uint32_t row;
+			bool alive;
+		};
+
+		vector<unique_ptr<Archetype>> archetypes;
+		unordered_map<uint64_t, uint32_t> archetypeOfTypes;
+		vector<Slot> slots;
+		vector<uint32_t> freeSlots;
+		size_t componentSizes[MAX_COMPONENT_TYPES];
+		size_t nrAlive;
+
+		template <class C>
+		int typeId()
+		{
+			static_assert(is_trivially_copyable<C>::value, "Components have to be trivially copyable");
+			int id = componentTypeId<C>();
+			componentSizes[id] = sizeof(C);
+			return id;
+		}
+
+		template <class C>
+		C *column(Archetype &archetype)
+		{
+			return reinterpret_cast<C*>(archetype.columns[archetype.columnOf[componentTypeId<C>()]].data());
+		}
+
+		Entity allocate();
+
+		// Index of the archetype with the given component types, created if there is none yet
+		uint32_t archetypeWith(uint64_t types);
+
+		// Append a row for the entity to the archetype, the components are left uninitialized
+		uint32_t appendRow(uint32_t archetype, Entity entity);
+
+		// Move the entity's row to the given archetype, copying the components both have
+		void moveEntity(Entity entity, uint32_t archetype);
+
+		// Remove a row by moving the last row into its place
+		void removeRow(uint32_t archetype, uint32_t row);
+
+		void *component(Entity entity, int typeId);
+
+	public:
+		EntityRegistry();
+
+		// Create an entity with the given components
+		template <class... C>
+		Entity create(const C &... components)
+		{
+			uint64_t types = 0;
+			int ids[] = { 0, typeId<C>()... };
+			for (size_t i = 1; i < sizeof(ids) / sizeof(ids[0]); i++)
+				types |= (uint64_t)1 << ids[i];
+
+			Entity entity = allocate();
+			uint32_t archetype = archetypeWith(types);
+			appendRow(archetype, entity);
+			int unused[] = { 0, (*get<C>(entity) = components, 0)... };
+			(void)unused;
+			return entity;
+		}
+
+		void destroy(Entity entity);
+		bool isAlive(Entity entity) const;
+
+		// Add a component to the entity or overwrite the one it has
+		template <class C>
+		void add(Entity entity, const C &value)
+		{
+			int id = typeId<C>();
+			if (! isAlive(entity))
+				return;
+			uint64_t types = archetypes[slots[entity.index].archetype]->types;
+			if (! (types & ((uint64_t)1 << id)))
+				moveEntity(entity, archetypeWith(types | ((uint64_t)1 << id)));
+			*get<C>(entity) = value;
+		}
+
+		template <class C>
+		void remove(Entity entity)
+		{
+			int id = typeId<C>();
+			if (! isAlive(entity))
+				return;
+			uint64_t types = archetypes[slots[entity.index].archetype]->types;
+			if (types & ((uint64_t)1 << id))
+				moveEntity(entity, archetypeWith(types & ~((uint64_t)1 << id)));
+		}
+
+		// The entity's component of the type, NULL if the entity doesn't have one or doesn't exist anymore
+		template <class C>
+		C *get(Entity entity)
+		{
+			return static_cast<C*>(component(entity, typeId<C>()));
+		}
+
+		// Call body(Entity, C &...) for every entity with components of all the given types, table by table
+		template <class... C, class F>
+		void forEach(F body)
+		{
+			uint64_t types = 0;
+			int ids[] = { 0, typeId<C>()... };
+			for (size_t i = 1; i < sizeof(ids) / sizeof(ids[0]); i++)
+				types |= (uint64_t)1 << ids[i];
+
+			for (const unique_ptr<Archetype> &archetype : archetypes)
+			{
+				if ((archetype->types & types) != types || archetype->entities.empty())
+					continue;
+
+				tuple<C*...> columns(column<C>(*archetype)...);
+				const Entity *entities = archetype->entities.data();
+				size_t nrRows = archetype->entities.size();
+				for (size_t row = 0; row < nrRows; row++)
+					body(entities[row], std::get<C*>(columns)[row]...);
+			}
+		}
+
+		size_t size() const { return nrAlive; }
+		size_t nrArchetypes() const { return archetypes.size(); }
+};
+
+
+
+// Components shared by the subsystems
+struct Transform {
+	vec3 position;           // Position after the last tick
+	vec3 previousPosition;   // Position before the last tick, the entity is shown in between
+};
+
+struct Velocity {
+	vec3 linear;   // Blocks per second
+};
\ No newline at end of file
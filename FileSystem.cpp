@@ -0,0 +1,271 @@
+#include "FileSystem.hpp"
+#include "Hash.hpp"
+
+#include <cstdio>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                   MAPPED FILE                                    */
+/* -------------------------------------------------------------------------------- */
+
+MappedFile::MappedFile()
+{
+	bytes = NULL;
+	length = 0;
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = NULL;
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+bool MappedFile::open(const string &path)
+{
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (! GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (! mappingHandle)
+	{
+		close();
+		return false;
+	}
+
+	bytes = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (! bytes)
+	{
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	void *mapping = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	bytes = (const unsigned char*)mapping;
+	length = (size_t)fileStat.st_size;
+#endif
+
+	return true;
+}
+
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	mappingHandle = NULL;
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (bytes)
+		munmap((void*)bytes, length);
+#endif
+
+	bytes = NULL;
+	length = 0;
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                   APPEND FILE                                    */
+/* -------------------------------------------------------------------------------- */
+
+AppendFile::AppendFile()
+{
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	fd = -1;
+#endif
+}
+
+
+AppendFile::~AppendFile()
+{
+	close();
+}
+
+
+bool AppendFile::open(const string &path, bool truncate)
+{
+	close();
+
+#ifdef _WIN32
+	// FlushFileBuffers needs write access, so the end of the file is sought once instead of opening
+	// the file for appending only
+	fileHandle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER offset;
+	offset.QuadPart = 0;
+	if (! SetFilePointerEx(fileHandle, offset, NULL, FILE_END))
+	{
+		close();
+		return false;
+	}
+	return true;
+#else
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+	return fd >= 0;
+#endif
+}
+
+
+void AppendFile::close()
+{
+#ifdef _WIN32
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+	fileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+}
+
+
+bool AppendFile::isOpen() const
+{
+#ifdef _WIN32
+	return fileHandle != INVALID_HANDLE_VALUE;
+#else
+	return fd >= 0;
+#endif
+}
+
+
+bool AppendFile::append(const void *data, size_t size)
+{
+	const char *bytes = (const char*)data;
+	while (size > 0)
+	{
+#ifdef _WIN32
+		DWORD chunkSize = (DWORD)std::min(size, (size_t)(1 << 30)), nrWritten = 0;
+		if (! WriteFile(fileHandle, bytes, chunkSize, &nrWritten, NULL) || nrWritten == 0)
+			return false;
+#else
+		ssize_t nrWritten = ::write(fd, bytes, size);
+		if (nrWritten <= 0)
+			return false;
+#endif
+		bytes += nrWritten;
+		size -= nrWritten;
+	}
+	return true;
+}
+
+
+bool AppendFile::sync()
+{
+#ifdef _WIN32
+	return FlushFileBuffers(fileHandle) != 0;
+#else
+	return fsync(fd) == 0;
+#endif
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                  FILE FUNCTIONS                                  */
+/* -------------------------------------------------------------------------------- */
+
+void makeDirectory(const string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+
+bool replaceFile(const string &tempPath, const string &path)
+{
+#ifdef _WIN32
+	return MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+
+bool writeFileAtomically(const string &path, const void *data, size_t size)
+{
+	string tempPath = path + ".tmp";
+
+	AppendFile file;
+	bool written = file.open(tempPath, true) && file.append(data, size) && file.sync();
+	file.close();
+
+	if (! written || ! replaceFile(tempPath, path))
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+uint64_t hashFile(const string &path)
+{
+	MappedFile file;
+	if (! file.open(path))
+		return 0;
+	return hashBytes(file.data(), file.size());
+}
\ No newline at end of file
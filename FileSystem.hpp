@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+	private:
+		const unsigned char *bytes;
+		size_t length;
+#ifdef _WIN32
+		void *fileHandle;
+		void *mappingHandle;
+#endif
+
+	public:
+		MappedFile();
+		~MappedFile();
+
+		// A mapping can't be shared
+		MappedFile(const MappedFile&) = delete;
+		MappedFile &operator=(const MappedFile&) = delete;
+
+		// Map the given file, returns false if it doesn't exist or can't be mapped
+		bool open(const string &path);
+		void close();
+
+		bool isOpen() const { return bytes != NULL; }
+		const unsigned char *data() const { return bytes; }
+		size_t size() const { return length; }
+};
+
+
+
+// File that is only appended to, with writes that can be flushed to the disk
+class AppendFile
+{
+	private:
+#ifdef _WIN32
+		void *fileHandle;
+#else
+		int fd;
+#endif
+
+	public:
+		AppendFile();
+		~AppendFile();
+
+		AppendFile(const AppendFile&) = delete;
+		AppendFile &operator=(const AppendFile&) = delete;
+
+		// Open the file for appending, creating it if it doesn't exist or emptying it if truncate is set
+		bool open(const string &path, bool truncate);
+		void close();
+
+		bool isOpen() const;
+		bool append(const void *data, size_t size);
+
+		// Wait until all appended data is on the disk
+		bool sync();
+};
+
+
+
+// Create a directory (does nothing if it already exists)
+void makeDirectory(const string &path);
+
+// Atomically replace the file at path with the file at tempPath
+bool replaceFile(const string &tempPath, const string &path);
+
+// Write the data to a temporary file, flush it to the disk and then replace the file at path with it,
+// so the file is either completely old or completely new after a crash
+bool writeFileAtomically(const string &path, const void *data, size_t size);
+
+// Hash of the file's contents, 0 if it can't be read
+uint64_t hashFile(const string &path);
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "FixedTimestep.hpp"
+
+#include <iostream>
+#include <algorithm>
+
+
+
+FixedTimestep::FixedTimestep(double tickRate, int maxTicksPerFrame)
+{
+	tickLength = 1.0 / tickRate;
+	this->maxTicksPerFrame = maxTicksPerFrame;
+	accumulator = 0.0;
+	lastTime = 0.0;
+	started = false;
+	nrTicks = 0;
+	nrCatchUpFrames = 0;
+	droppedTime = 0.0;
+	maxTicksInFrame = 0;
+}
+
+
+int FixedTimestep::advance(double time)
+{
+	// The first frame only starts the clock
+	if (! started)
+	{
+		started = true;
+		lastTime = time;
+		return 0;
+	}
+
+	accumulator += std::max(time - lastTime, 0.0);
+	lastTime = time;
+
+	// Frame times matching the tick length add up with rounding errors, without some tolerance a frame
+	// would now and then end just short of a tick and the next one run two
+	int ticks = (int)(accumulator / tickLength + 1e-4);
+	if (ticks > maxTicksPerFrame)
+	{
+		droppedTime += (ticks - maxTicksPerFrame) * tickLength;
+		accumulator -= (ticks - maxTicksPerFrame) * tickLength;
+		ticks = maxTicksPerFrame;
+	}
+	accumulator = std::max(accumulator - ticks * tickLength, 0.0);
+
+	nrTicks += ticks;
+	if (ticks > 1)
+		nrCatchUpFrames++;
+	maxTicksInFrame = std::max(maxTicksInFrame, ticks);
+	return ticks;
+}
+
+
+void FixedTimestep::printStats() const
+{
+	std::cout << "Simulation: " << nrTicks << " ticks of " << tickLength * 1000.0 << " ms, " << nrCatchUpFrames <<
+		" frames caught up with several ticks (up to " << maxTicksInFrame << "), " << droppedTime * 1000.0 <<
+		" ms of stalls dropped" << endl;
+	if (tickTimes.count() > 0)
+		tickTimes.print("  tick cost", "ms");
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Profiling.hpp"
+
+using namespace std;
+
+
+
+// Clock of a fixed-timestep simulation: the real time passed between frames is accumulated and consumed
+// in ticks of a fixed length, so the simulation behaves the same at any frame rate. The state shown is
+// interpolated between the last two ticks (see alpha). After a stall, at most maxTicksPerFrame ticks
+// catch up per frame and the rest of the backlog is dropped, so a long stall slows the simulation down
+// for a moment instead of making every following frame slower (spiral of death).
+class FixedTimestep
+{
+	private:
+		double tickLength;      // Seconds
+		int maxTicksPerFrame;
+		double accumulator;     // Real time not yet simulated
+		double lastTime;
+		bool started;
+
+		size_t nrTicks;
+		size_t nrCatchUpFrames;      // Frames that ran more than one tick
+		double droppedTime;          // Seconds of backlog that were dropped
+		int maxTicksInFrame;
+		LatencyStats tickTimes;      // ms
+
+	public:
+		FixedTimestep(double tickRate = 60.0, int maxTicksPerFrame = 8);
+
+		// Add the time passed since the last frame, returns the number of ticks to run this frame
+		int advance(double time);
+
+		// Fraction of a tick the real time is ahead of the last tick (0..1), for interpolating between
+		// the states before and after the last tick
+		float alpha() const { return (float)(accumulator / tickLength); }
+
+		double getTickLength() const { return tickLength; }
+		size_t getNrTicks() const { return nrTicks; }
+		double getDroppedTime() const { return droppedTime; }
+
+		// Record the time a tick took (ms)
+		void addTickTime(double ms) { tickTimes.add(ms); }
+
+		void printStats() const;
+};
\ No newline at end of file
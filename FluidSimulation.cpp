@@ -0,0 +1,312 @@
+#include "FluidSimulation.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+
+
+FluidSimulation::FluidSimulation(BlockId sourceId, JobSystem *jobs)
+{
+	this->sourceId = sourceId;
+	this->jobs = jobs;
+	nrSteps = 0;
+	nrCellUpdates = 0;
+	nrCellChanges = 0;
+}
+
+
+FluidSimulation::FluidChunk &FluidSimulation::getOrCreateChunk(ivec3 chunkPos)
+{
+	unique_ptr<FluidChunk> &chunk = chunks[chunkPos];
+	if (! chunk)
+	{
+		chunk.reset(new FluidChunk());
+		memset(chunk->levels, 0, sizeof(chunk->levels));
+		memset(chunk->activeMask, 0, sizeof(chunk->activeMask));
+		chunk->nrWet = 0;
+	}
+	return *chunk;
+}
+
+
+uint8_t FluidSimulation::getLevel(ivec3 pos) const
+{
+	FluidChunkMap::const_iterator chunk = chunks.find(chunkPosOf(pos));
+	return chunk != chunks.end() ? chunk->second->get(blockIndexOf(pos)) : 0;
+}
+
+
+void FluidSimulation::setLevel(ivec3 pos, uint8_t level)
+{
+	FluidChunk &chunk = getOrCreateChunk(chunkPosOf(pos));
+	int i = blockIndexOf(pos);
+	uint8_t oldLevel = chunk.get(i);
+	if (oldLevel == level)
+		return;
+
+	int shift = (i & 1) * 4;
+	chunk.levels[i >> 1] = (uint8_t)((chunk.levels[i >> 1] & ~(15 << shift)) | (level << shift));
+	chunk.nrWet += (level > 0) - (oldLevel > 0);
+}
+
+
+void FluidSimulation::activate(ivec3 pos)
+{
+	if (pos.y < 0)
+		return;
+
+	FluidChunk &chunk = getOrCreateChunk(chunkPosOf(pos));
+	int i = blockIndexOf(pos);
+	uint64_t bit = 1ull << (i & 63);
+	if (chunk.activeMask[i >> 6] & bit)
+		return;
+	chunk.activeMask[i >> 6] |= bit;
+	chunk.active.push_back((uint16_t)i);
+}
+
+
+void FluidSimulation::activateAround(ivec3 pos)
+{
+	// A cell reads itself, the cells above and below it, its horizontal neighbours and the cells below those
+	activate(pos);
+	activate(pos + ivec3(0, 1, 0));
+	activate(pos - ivec3(0, 1, 0));
+	const ivec3 horizontal[4] = { ivec3(1, 0, 0), ivec3(-1, 0, 0), ivec3(0, 0, 1), ivec3(0, 0, -1) };
+	for (const ivec3 &direction : horizontal)
+	{
+		activate(pos + direction);
+		activate(pos + direction + ivec3(0, 1, 0));
+	}
+}
+
+
+uint8_t FluidSimulation::computeLevel(const Neighbourhood &around, ivec3 p) const
+{
+	// Cells beyond the chunk borders (-1 or 16) are read from the neighbour chunks
+	auto neighbourOf = [](ivec3 p) { return ((p.x >> 4) + 1) + ((p.z >> 4) + 1) * 3 + ((p.y >> 4) + 1) * 9; };
+	auto isSolid = [&](ivec3 p)
+	{
+		const BlockView *view = around.blocks[neighbourOf(p)];
+		if (! view->ready)
+			return true;
+		if (! view->blocks)
+			return false;
+		BlockId id = view->blocks->ids[blockIndexOf(p)];
+		return id != AIR && id != sourceId;
+	};
+	auto levelAt = [&](ivec3 p) -> uint8_t
+	{
+		const FluidChunk *fluid = around.fluids[neighbourOf(p)];
+		return fluid ? fluid->get(blockIndexOf(p)) : 0;
+	};
+
+	if (isSolid(p))
+		return 0;
+	if (levelAt(p) == SOURCE)
+		return SOURCE;
+
+	// Fluid spreads sideways from the cells resting on solid ground or on a source, sources and falling fluid
+	// spread like a full flow
+	const ivec3 down(0, -1, 0);
+	const ivec3 horizontal[4] = { ivec3(1, 0, 0), ivec3(-1, 0, 0), ivec3(0, 0, 1), ivec3(0, 0, -1) };
+	int nrSources = 0;
+	int flow = 0;
+	for (const ivec3 &direction : horizontal)
+	{
+		ivec3 neighbour = p + direction;
+		int level = levelAt(neighbour);
+		if (level == SOURCE)
+			nrSources++;
+		if (level > 1 && (isSolid(neighbour + down) || levelAt(neighbour + down) == SOURCE))
+			flow = std::max(flow, std::min(level, MAX_FLOW + 1) - 1);
+	}
+
+	if (nrSources >= 2 && (isSolid(p + down) || levelAt(p + down) == SOURCE))
+		return SOURCE;
+	if (levelAt(p - down) > 0)
+		return FALLING;
+	return (uint8_t)flow;
+}
+
+
+void FluidSimulation::blockChanged(ivec3 pos, BlockId id)
+{
+	// Without fluid in the chunks around, a block change can't affect any
+	bool fluidNearby = id == sourceId;
+	ivec3 chunkPos = chunkPosOf(pos);
+	for (int dy = -1; dy <= 1 && ! fluidNearby; dy++)
+	{
+		for (int dz = -1; dz <= 1 && ! fluidNearby; dz++)
+		{
+			for (int dx = -1; dx <= 1 && ! fluidNearby; dx++)
+				fluidNearby = chunks.count(chunkPos + ivec3(dx, dy, dz)) > 0;
+		}
+	}
+	if (! fluidNearby)
+		return;
+
+	if (id == sourceId)
+		setLevel(pos, SOURCE);
+	else if (id != AIR || getLevel(pos) == SOURCE)
+		setLevel(pos, 0);
+	activateAround(pos);
+}
+
+
+void FluidSimulation::chunkLoaded(const World &world, ivec3 chunkPos)
+{
+	const Chunk *chunk = world.getChunk(chunkPos);
+	if (chunk && chunk->summary().contains(sourceId))
+	{
+		for (int i = 0; i < CHUNK_VOLUME; i++)
+		{
+			if (chunk->get(i) != sourceId)
+				continue;
+			setLevel(blockPosOf(chunkPos, i), SOURCE);
+			activateAround(blockPosOf(chunkPos, i));
+		}
+	}
+
+	// The chunk was solid for the fluid around it until now
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				ivec3 neighbourPos = chunkPos + ivec3(dx, dy, dz);
+				FluidChunkMap::iterator neighbour = chunks.find(neighbourPos);
+				if (neighbour == chunks.end() || neighbour->second->nrWet == 0)
+					continue;
+				for (int i = 0; i < CHUNK_VOLUME; i++)
+				{
+					if (neighbour->second->get(i) > 0)
+						activateAround(blockPosOf(neighbourPos, i));
+				}
+			}
+		}
+	}
+}
+
+
+void FluidSimulation::chunkUnloaded(ivec3 chunkPos)
+{
+	chunks.erase(chunkPos);
+}
+
+
+void FluidSimulation::step(const World &world, const function<bool(ivec3)> &isReady, vector<FluidChange> &changes)
+{
+	// The chunks with active cells, in a fixed order so the changes are applied in the same order every time
+	vector<ivec3> activeChunks;
+	for (const FluidChunkMap::value_type &entry : chunks)
+	{
+		if (! entry.second->active.empty())
+			activeChunks.push_back(entry.first);
+	}
+	std::sort(activeChunks.begin(), activeChunks.end(), [](const ivec3 &a, const ivec3 &b)
+	{
+		return a.y != b.y ? a.y < b.y : (a.z != b.z ? a.z < b.z : a.x < b.x);
+	});
+
+	// The workers read snapshots of the world blocks, which stay the same while the world is used elsewhere
+	unordered_map<ivec3, BlockView, ChunkPosHash> views;
+	vector<Neighbourhood> neighbourhoods(activeChunks.size());
+	vector<FluidChunk*> updated(activeChunks.size());
+	size_t nrUpdating = 0;
+	for (size_t c = 0; c < activeChunks.size(); c++)
+	{
+		for (int k = 0; k < 27; k++)
+		{
+			ivec3 pos = activeChunks[c] + ivec3(k % 3 - 1, k / 9 - 1, (k / 3) % 3 - 1);
+			auto view = views.find(pos);
+			if (view == views.end())
+			{
+				BlockView blocks;
+				const Chunk *chunk = pos.y >= 0 ? world.getChunk(pos) : NULL;
+				blocks.ready = chunk || (pos.y >= 0 && isReady(pos));
+				if (chunk)
+					blocks.blocks = chunk->snapshot();
+				view = views.insert(make_pair(pos, blocks)).first;
+			}
+			neighbourhoods[c].blocks[k] = &view->second;
+
+			FluidChunkMap::const_iterator fluid = chunks.find(pos);
+			neighbourhoods[c].fluids[k] = fluid != chunks.end() ? fluid->second.get() : NULL;
+		}
+
+		FluidChunk &chunk = *chunks[activeChunks[c]];
+		chunk.updating.swap(chunk.active);
+		chunk.active.clear();
+		memset(chunk.activeMask, 0, sizeof(chunk.activeMask));
+		chunk.newLevels.resize(chunk.updating.size());
+		updated[c] = &chunk;
+		nrUpdating += chunk.updating.size();
+	}
+
+	// Each chunk only writes its own new levels, everything read is from before the step
+	auto work = [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			FluidChunk &chunk = *updated[c];
+			for (size_t j = 0; j < chunk.updating.size(); j++)
+				chunk.newLevels[j] = computeLevel(neighbourhoods[c], blockPosOf(ivec3(0), chunk.updating[j]));
+		}
+	};
+
+	// Small steps aren't worth spawning jobs for
+	if (nrUpdating >= 8192)
+		(jobs ? *jobs : JobSystem::shared()).parallelFor(0, activeChunks.size(), 1, work);
+	else
+		work(0, activeChunks.size());
+
+	// The changed cells and the cells reading them are updated in the next step
+	for (size_t c = 0; c < activeChunks.size(); c++)
+	{
+		FluidChunk &chunk = *updated[c];
+		for (size_t j = 0; j < chunk.updating.size(); j++)
+		{
+			int i = chunk.updating[j];
+			uint8_t oldLevel = chunk.get(i);
+			uint8_t newLevel = chunk.newLevels[j];
+			if (oldLevel == newLevel)
+				continue;
+
+			ivec3 pos = blockPosOf(activeChunks[c], i);
+			setLevel(pos, newLevel);
+			activateAround(pos);
+			changes.push_back({ pos, oldLevel, newLevel });
+			nrCellChanges++;
+		}
+		nrCellUpdates += chunk.updating.size();
+		chunk.updating.clear();
+	}
+
+	// Chunks that dried up are dropped
+	for (FluidChunkMap::iterator it = chunks.begin(); it != chunks.end(); )
+	{
+		if (it->second->nrWet == 0 && it->second->active.empty())
+			it = chunks.erase(it);
+		else
+			++it;
+	}
+	nrSteps++;
+}
+
+
+size_t FluidSimulation::getNrActive() const
+{
+	size_t nrActive = 0;
+	for (const FluidChunkMap::value_type &entry : chunks)
+		nrActive += entry.second->active.size();
+	return nrActive;
+}
+
+
+void FluidSimulation::printStats() const
+{
+	std::cout << "Fluids: " << nrSteps << " steps, " << nrCellUpdates << " cell updates, " << nrCellChanges << " changes, " <<
+		chunks.size() << " chunks with fluid (" << chunks.size() * sizeof(FluidChunk) / 1024 << " KB)" << endl;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+#include "World.hpp"
+#include "JobSystem.hpp"
+
+using namespace std;
+
+
+
+// A fluid level that changed in a step of the FluidSimulation
+struct FluidChange {
+	ivec3 pos;
+	uint8_t oldLevel;
+	uint8_t newLevel;
+};
+
+
+// Cellular automaton of a flowing fluid like water. Sources are the fluid blocks of the world; fluid falls
+// from them and spreads sideways over solid ground, one level less per cell. Air enclosed by two sources
+// on solid ground becomes a source too, so a basin fills up. Levels are kept per chunk with 4 bits per
+// cell, only for chunks with fluid in them, and only the active cells (changed in the last step or next
+// to a change) are updated. A step computes all new levels from the levels before the step, so the
+// chunks are updated in parallel and the result doesn't depend on the number of threads.
+class FluidSimulation
+{
+	public:
+		static const uint8_t MAX_FLOW = 7;   // Level of fluid next to a source, one less per cell further
+		static const uint8_t FALLING = 8;    // Fluid falling in from the cell above
+		static const uint8_t SOURCE = 9;     // Fluid that never drains
+
+	private:
+		struct FluidChunk {
+			uint8_t levels[CHUNK_VOLUME / 2];         // 4 bits per cell
+			uint64_t activeMask[CHUNK_VOLUME / 64];   // Cells in active
+			vector<uint16_t> active;                  // Cells to update in the next step
+			vector<uint16_t> updating;                // Cells updated in the current step
+			vector<uint8_t> newLevels;                // Their new levels
+			int nrWet;                                // Cells with fluid
+
+			uint8_t get(int i) const { return (levels[i >> 1] >> ((i & 1) * 4)) & 15; }
+		};
+
+		typedef unordered_map<ivec3, unique_ptr<FluidChunk>, ChunkPosHash> FluidChunkMap;
+
+		// Blocks read in a step. Chunks that aren't loaded yet are solid, loaded chunks without storage are air.
+		struct BlockView {
+			bool ready;
+			shared_ptr<const ChunkBlocks> blocks;
+		};
+
+		// The chunk and its 26 neighbours, for reading the cells around a cell of the chunk
+		struct Neighbourhood {
+			const BlockView *blocks[27];
+			const FluidChunk *fluids[27];
+		};
+
+		BlockId sourceId;   // World block of a source, all other blocks except air are solid
+		JobSystem *jobs;
+		FluidChunkMap chunks;
+
+		// Statistics
+		size_t nrSteps;
+		size_t nrCellUpdates;
+		size_t nrCellChanges;
+
+		FluidChunk &getOrCreateChunk(ivec3 chunkPos);
+		void setLevel(ivec3 pos, uint8_t level);
+		void activate(ivec3 pos);
+		void activateAround(ivec3 pos);   // The cells whose next level depends on the given one
+		uint8_t computeLevel(const Neighbourhood &around, ivec3 local) const;
+
+	public:
+		// Large steps run in parallel on the given job system (NULL: the shared one, looked up on first use)
+		FluidSimulation(BlockId sourceId, JobSystem *jobs = NULL);
+
+		// 0 (dry) to SOURCE
+		uint8_t getLevel(ivec3 pos) const;
+
+		// To be called for every block the world changed, sets sources and lets the fluid around react
+		void blockChanged(ivec3 pos, BlockId id);
+
+		// Chunks of the world that were loaded or evicted: the sources of a loaded chunk start flowing
+		void chunkLoaded(const World &world, ivec3 chunkPos);
+		void chunkUnloaded(ivec3 chunkPos);
+
+		// Update the active cells, isReady tells whether a chunk without storage in the world is air
+		// (otherwise it's still loading and solid). The changed levels are appended to changes.
+		void step(const World &world, const function<bool(ivec3)> &isReady, vector<FluidChange> &changes);
+
+		bool hasFluid(ivec3 chunkPos) const { return chunks.count(chunkPos) > 0; }
+		size_t getNrActive() const;
+		size_t getNrChunks() const { return chunks.size(); }
+		size_t getNrCellUpdates() const { return nrCellUpdates; }
+
+		void printStats() const;
+};
\ No newline at end of file
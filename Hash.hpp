@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+
+
+// 64-bit FNV-1a hash. Used to key the on-disk caches by the contents they were built from.
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+const uint64_t HASH_PRIME = 1099511628211ULL;
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t hash = HASH_SEED)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+	}
+	return hash;
+}
+
+inline uint64_t hashString(const std::string &str, uint64_t hash = HASH_SEED)
+{
+	return hashBytes(str.data(), str.size(), hash);
+}
\ No newline at end of file
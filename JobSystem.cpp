@@ -0,0 +1,190 @@
+#include "JobSystem.hpp"
+
+#include <iostream>
+#include <algorithm>
+
+
+
+// Job system and queue the current thread belongs to, unset outside of the worker threads
+static thread_local const JobSystem *currentSystem = NULL;
+static thread_local int currentQueue = -1;
+
+
+JobSystem::JobSystem(int nrThreads)
+{
+	this->nrThreads = nrThreads > 0 ? nrThreads : std::max((int)thread::hardware_concurrency(), 1);
+	nrQueued = 0;
+	nrSleeping = 0;
+	stopping = false;
+	nrSpawned = 0;
+	nrStolen = 0;
+
+	// The thread waiting for jobs runs them as well, so one worker less is started
+	for (int i = 0; i < this->nrThreads; i++)
+		queues.push_back(unique_ptr<JobQueue>(new JobQueue()));
+	for (int i = 0; i < this->nrThreads - 1; i++)
+		workers.push_back(thread(&JobSystem::workerLoop, this, i));
+}
+
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (thread &worker : workers)
+		worker.join();
+}
+
+
+JobSystem &JobSystem::shared()
+{
+	static JobSystem jobs;
+	return jobs;
+}
+
+
+int JobSystem::queueOfThisThread() const
+{
+	return currentSystem == this ? currentQueue : (int)queues.size() - 1;
+}
+
+
+bool JobSystem::takeJob(Job &job)
+{
+	if (nrQueued == 0)
+		return false;
+
+	int own = queueOfThisThread();
+	{
+		JobQueue &queue = *queues[own];
+		lock_guard<mutex> lock(queue.queueMutex);
+		if (! queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			nrQueued--;
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < queues.size(); i++)
+	{
+		JobQueue &queue = *queues[(own + i) % queues.size()];
+		lock_guard<mutex> lock(queue.queueMutex);
+		if (! queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			nrQueued--;
+			nrStolen++;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void JobSystem::execute(Job &job)
+{
+	// The job is destroyed before the counter drops, a waiting thread may free what it refers to right after
+	{
+		function<void()> work = std::move(job.work);
+		work();
+	}
+	if (job.counter)
+		job.counter->pending--;
+}
+
+
+void JobSystem::workerLoop(int index)
+{
+	currentSystem = this;
+	currentQueue = index;
+
+	Job job;
+	while (true)
+	{
+		if (takeJob(job))
+		{
+			execute(job);
+			continue;
+		}
+
+		// A spawn after the check below sees the sleeping worker and wakes it
+		unique_lock<mutex> lock(sleepMutex);
+		nrSleeping++;
+		wakeUp.wait(lock, [&]() { return stopping || nrQueued > 0; });
+		nrSleeping--;
+		if (stopping)
+			return;
+	}
+}
+
+
+void JobSystem::spawn(function<void()> job, JobCounter *counter)
+{
+	if (counter)
+		counter->pending++;
+
+	JobQueue &queue = *queues[queueOfThisThread()];
+	{
+		lock_guard<mutex> lock(queue.queueMutex);
+		queue.jobs.push_back({ std::move(job), counter });
+	}
+	nrQueued++;
+	nrSpawned++;
+
+	if (nrSleeping > 0)
+	{
+		lock_guard<mutex> lock(sleepMutex);
+		wakeUp.notify_one();
+	}
+}
+
+
+void JobSystem::waitFor(const JobCounter &counter)
+{
+	while (counter.pending > 0)
+	{
+		if (! tryRunJob())
+			this_thread::yield();
+	}
+}
+
+
+bool JobSystem::tryRunJob()
+{
+	Job job;
+	if (! takeJob(job))
+		return false;
+	execute(job);
+	return true;
+}
+
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)> &body)
+{
+	if (begin >= end)
+		return;
+	grain = std::max(grain, (size_t)1);
+
+	// The upper halves are left for other threads to steal, the calling thread works its way down to the first piece
+	JobCounter counter;
+	while (end - begin > grain)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		spawn([this, middle, end, grain, &body]() { parallelFor(middle, end, grain, body); }, &counter);
+		end = middle;
+	}
+	body(begin, end);
+	waitFor(counter);
+}
+
+
+void JobSystem::printStats() const
+{
+	std::cout << "Jobs: " << nrSpawned << " spawned, " << nrStolen << " stolen, " << nrThreads << " threads" << endl;
+}
\ No newline at end of file
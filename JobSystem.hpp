@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+
+// Number of unfinished jobs spawned with the counter (see JobSystem::spawn and JobSystem::waitFor)
+struct JobCounter {
+	atomic<int> pending;
+
+	JobCounter() { pending = 0; }
+};
+
+
+// Work-stealing job system shared by the subsystems. Every worker thread has its own queue of jobs: it
+// pushes the jobs it spawns to the back and takes the next one from the back as well, so it works on the
+// most recent, still cached data. Idle workers steal from the front of the other queues, which holds the
+// oldest and usually biggest pieces of work. Threads outside the pool share one more queue.
+// Waiting for jobs never blocks a thread that could run them: waitFor runs queued jobs until the counter
+// drops to 0, so jobs may spawn and wait for jobs of their own (see parallelFor).
+class JobSystem
+{
+	private:
+		struct Job {
+			function<void()> work;
+			JobCounter *counter;
+		};
+
+		struct JobQueue {
+			mutex queueMutex;
+			deque<Job> jobs;
+		};
+
+		int nrThreads;
+		vector<thread> workers;
+		vector<unique_ptr<JobQueue>> queues;   // One per worker, the last one for the threads outside the pool
+
+		atomic<int> nrQueued;
+		atomic<int> nrSleeping;
+		mutex sleepMutex;
+		condition_variable wakeUp;
+		bool stopping;
+
+		atomic<size_t> nrSpawned;
+		atomic<size_t> nrStolen;
+
+		int queueOfThisThread() const;
+		bool takeJob(Job &job);   // From the back of the own queue, else from the front of another
+		void execute(Job &job);
+		void workerLoop(int index);
+
+	public:
+		JobSystem(int nrThreads = 0);   // Threads running jobs, the one waiting included (0 = one per core)
+		~JobSystem();                   // All jobs must have been waited for
+
+		// Job system with one thread per core, started on first use
+		static JobSystem &shared();
+
+		// Queue the job. The counter, if any, is incremented right away and decremented once the job has run.
+		void spawn(function<void()> job, JobCounter *counter = NULL);
+
+		// Run queued jobs until the counter is 0
+		void waitFor(const JobCounter &counter);
+
+		// Run one queued job on the calling thread, false if there was none
+		bool tryRunJob();
+
+		// Call body on subranges of [begin, end) of at most grain elements, split in halves on the job system
+		void parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)> &body);
+
+		int getNrThreads() const { return nrThreads; }
+		size_t getNrSpawned() const { return nrSpawned; }
+		size_t getNrStolen() const { return nrStolen; }
+		void printStats() const;
+};
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "Noise.hpp"
+#include "NoiseSimd.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <algorithm>
+
+
+
+NoiseBackend bestNoiseBackend()
+{
+	static const NoiseBackend best = isNoiseBackendSupported(NoiseBackend::AVX2) ? NoiseBackend::AVX2 :
+		isNoiseBackendSupported(NoiseBackend::SSE2) ? NoiseBackend::SSE2 : NoiseBackend::SCALAR;
+	return best;
+}
+
+
+bool isNoiseBackendSupported(NoiseBackend backend)
+{
+#ifdef NOISE_SIMD
+	// SSE2 is part of every x86-64 CPU (and required by the 32 bit build as well)
+	if (backend == NoiseBackend::AVX2)
+	{
+		static const bool avx2 = cpuSupportsAvx2();
+		return avx2;
+	}
+	return true;
+#else
+	return backend == NoiseBackend::SCALAR;
+#endif
+}
+
+
+const char *noiseBackendName(NoiseBackend backend)
+{
+	switch (backend)
+	{
+		case NoiseBackend::SSE2: return "SSE2";
+		case NoiseBackend::AVX2: return "AVX2";
+		default: return "scalar";
+	}
+}
+
+
+
+GradientNoise::GradientNoise(uint32_t seed)
+{
+	// Fisher-Yates shuffle with the raw generator output, std::shuffle isn't the same everywhere
+	mt19937 random(seed);
+	for (int i = 0; i < 256; i++)
+		perm[i] = (uint8_t)i;
+	for (int i = 255; i > 0; i--)
+	{
+		int j = (int)(random() % (uint32_t)(i + 1));
+		uint8_t temp = perm[i];
+		perm[i] = perm[j];
+		perm[j] = temp;
+	}
+	for (int i = 0; i < 256; i++)
+		perm[256 + i] = perm[i];
+	for (int i = 0; i < 512; i++)
+		perm32[i] = perm[i];
+
+	backend = bestNoiseBackend();
+}
+
+
+void GradientNoise::setBackend(NoiseBackend backend)
+{
+	this->backend = isNoiseBackendSupported(backend) ? backend : bestNoiseBackend();
+}
+
+
+static inline float fade(float t)
+{
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+
+static inline float lerp(float a, float b, float t)
+{
+	return a + t * (b - a);
+}
+
+
+static inline float grad2(int hash, float x, float y)
+{
+	// 8 gradient directions
+	switch (hash & 7)
+	{
+		case 0: return x + y;
+		case 1: return -x + y;
+		case 2: return x - y;
+		case 3: return -x - y;
+		case 4: return x;
+		case 5: return -x;
+		case 6: return y;
+		default: return -y;
+	}
+}
+
+
+static inline float grad3(int hash, float x, float y, float z)
+{
+	// The 12 edge directions of a cube, 4 of them repeated
+	int h = hash & 15;
+	float u = h < 8 ? x : y;
+	float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+
+float GradientNoise::noise2(float x, float y) const
+{
+	float fx = floor(x), fy = floor(y);
+	int xi = (int)fx & 255, yi = (int)fy & 255;
+	x -= fx;
+	y -= fy;
+	float u = fade(x), v = fade(y);
+
+	int a = perm[xi] + yi, b = perm[xi + 1] + yi;
+	return 0.7071f * lerp(lerp(grad2(perm[a], x, y), grad2(perm[b], x - 1.0f, y), u),
+		lerp(grad2(perm[a + 1], x, y - 1.0f), grad2(perm[b + 1], x - 1.0f, y - 1.0f), u), v);
+}
+
+
+float GradientNoise::noise3(float x, float y, float z) const
+{
+	float fx = floor(x), fy = floor(y), fz = floor(z);
+	int xi = (int)fx & 255, yi = (int)fy & 255, zi = (int)fz & 255;
+	x -= fx;
+	y -= fy;
+	z -= fz;
+	float u = fade(x), v = fade(y), w = fade(z);
+
+	int a = perm[xi] + yi, aa = perm[a] + zi, ab = perm[a + 1] + zi;
+	int b = perm[xi + 1] + yi, ba = perm[b] + zi, bb = perm[b + 1] + zi;
+	return lerp(
+		lerp(lerp(grad3(perm[aa], x, y, z), grad3(perm[ba], x - 1.0f, y, z), u),
+			lerp(grad3(perm[ab], x, y - 1.0f, z), grad3(perm[bb], x - 1.0f, y - 1.0f, z), u), v),
+		lerp(lerp(grad3(perm[aa + 1], x, y, z - 1.0f), grad3(perm[ba + 1], x - 1.0f, y, z - 1.0f), u),
+			lerp(grad3(perm[ab + 1], x, y - 1.0f, z - 1.0f), grad3(perm[bb + 1], x - 1.0f, y - 1.0f, z - 1.0f), u), v),
+		w);
+}
+
+
+float GradientNoise::fractal2(float x, float y, int nrOctaves) const
+{
+	float sum = 0.0f, amplitude = 1.0f, totalAmplitude = 0.0f;
+	for (int octave = 0; octave < nrOctaves; octave++)
+	{
+		sum += amplitude * noise2(x, y);
+		totalAmplitude += amplitude;
+		x *= 2.0f;
+		y *= 2.0f;
+		amplitude *= 0.5f;
+	}
+	return sum / totalAmplitude;
+}
+
+
+float GradientNoise::fractal3(float x, float y, float z, int nrOctaves) const
+{
+	float sum = 0.0f, amplitude = 1.0f, totalAmplitude = 0.0f;
+	for (int octave = 0; octave < nrOctaves; octave++)
+	{
+		sum += amplitude * noise3(x, y, z);
+		totalAmplitude += amplitude;
+		x *= 2.0f;
+		y *= 2.0f;
+		z *= 2.0f;
+		amplitude *= 0.5f;
+	}
+	return sum / totalAmplitude;
+}
+
+
+void GradientNoise::noise2(const float *x, const float *y, float *out, int count) const
+{
+#ifdef NOISE_SIMD
+	if (backend == NoiseBackend::AVX2)
+		return noise2Avx2(perm32, x, y, out, count);
+	if (backend == NoiseBackend::SSE2)
+		return noise2Sse2(perm32, x, y, out, count);
+#endif
+
+	for (int i = 0; i < count; i++)
+		out[i] = noise2(x[i], y[i]);
+}
+
+
+void GradientNoise::noise3(const float *x, const float *y, const float *z, float *out, int count) const
+{
+#ifdef NOISE_SIMD
+	if (backend == NoiseBackend::AVX2)
+		return noise3Avx2(perm32, x, y, z, out, count);
+	if (backend == NoiseBackend::SSE2)
+		return noise3Sse2(perm32, x, y, z, out, count);
+#endif
+
+	for (int i = 0; i < count; i++)
+		out[i] = noise3(x[i], y[i], z[i]);
+}
+
+
+// Samples of the fractal batches are processed in blocks, so the scaled coordinates fit on the stack
+static const int FRACTAL_BLOCK = 256;
+
+void GradientNoise::fractal2(const float *x, const float *y, float *out, int count, int nrOctaves) const
+{
+	float scaledX[FRACTAL_BLOCK], scaledY[FRACTAL_BLOCK], octave[FRACTAL_BLOCK];
+	for (int start = 0; start < count; start += FRACTAL_BLOCK)
+	{
+		int n = std::min(count - start, FRACTAL_BLOCK);
+		float *sum = out + start;
+		memcpy(scaledX, x + start, n * sizeof(float));
+		memcpy(scaledY, y + start, n * sizeof(float));
+		memset(sum, 0, n * sizeof(float));
+
+		// The same operations as the scalar version, so the sums are the same
+		float amplitude = 1.0f, totalAmplitude = 0.0f;
+		for (int o = 0; o < nrOctaves; o++)
+		{
+			noise2(scaledX, scaledY, octave, n);
+			for (int i = 0; i < n; i++)
+			{
+				sum[i] += amplitude * octave[i];
+				scaledX[i] *= 2.0f;
+				scaledY[i] *= 2.0f;
+			}
+			totalAmplitude += amplitude;
+			amplitude *= 0.5f;
+		}
+		for (int i = 0; i < n; i++)
+			sum[i] /= totalAmplitude;
+	}
+}
+
+
+void GradientNoise::fractal3(const float *x, const float *y, const float *z, float *out, int count, int nrOctaves) const
+{
+	float scaledX[FRACTAL_BLOCK], scaledY[FRACTAL_BLOCK], scaledZ[FRACTAL_BLOCK], octave[FRACTAL_BLOCK];
+	for (int start = 0; start < count; start += FRACTAL_BLOCK)
+	{
+		int n = std::min(count - start, FRACTAL_BLOCK);
+		float *sum = out + start;
+		memcpy(scaledX, x + start, n * sizeof(float));
+		memcpy(scaledY, y + start, n * sizeof(float));
+		memcpy(scaledZ, z + start, n * sizeof(float));
+		memset(sum, 0, n * sizeof(float));
+
+		// The same operations as the scalar version, so the sums are the same
+		float amplitude = 1.0f, totalAmplitude = 0.0f;
+		for (int o = 0; o < nrOctaves; o++)
+		{
+			noise3(scaledX, scaledY, scaledZ, octave, n);
+			for (int i = 0; i < n; i++)
+			{
+				sum[i] += amplitude * octave[i];
+				scaledX[i] *= 2.0f;
+				scaledY[i] *= 2.0f;
+				scaledZ[i] *= 2.0f;
+			}
+			totalAmplitude += amplitude;
+			amplitude *= 0.5f;
+		}
+		for (int i = 0; i < n; i++)
+			sum[i] /= totalAmplitude;
+	}
+}
\ No newline at end of file
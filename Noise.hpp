@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+using namespace std;
+
+
+
+// Backends of the batch noise functions. The best one the CPU supports is picked at runtime, all of them
+// compute the same operations in the same order as the scalar functions and return the same values.
+enum class NoiseBackend { SCALAR, SSE2, AVX2 };
+
+NoiseBackend bestNoiseBackend();
+bool isNoiseBackendSupported(NoiseBackend backend);
+const char *noiseBackendName(NoiseBackend backend);
+
+
+
+// Seeded gradient noise (improved Perlin noise) in 2D and 3D with values in about [-1, 1].
+// The permutation is derived from the seed with a fixed algorithm, so the noise is the same on every
+// platform and thread for a seed.
+class GradientNoise
+{
+	private:
+		uint8_t perm[512];     // Permutation of 0..255, repeated
+		int32_t perm32[512];   // The same as 32 bit integers for the SIMD gathers
+		NoiseBackend backend;
+
+	public:
+		GradientNoise(uint32_t seed);
+
+		float noise2(float x, float y) const;
+		float noise3(float x, float y, float z) const;
+
+		// Sum of octaves with doubling frequency and halving amplitude (fractal Brownian motion),
+		// normalized to about [-1, 1]
+		float fractal2(float x, float y, int nrOctaves) const;
+		float fractal3(float x, float y, float z, int nrOctaves) const;
+
+		// Batches of count samples, evaluated 4 (SSE2) or 8 (AVX2) at a time
+		void noise2(const float *x, const float *y, float *out, int count) const;
+		void noise3(const float *x, const float *y, const float *z, float *out, int count) const;
+		void fractal2(const float *x, const float *y, float *out, int count, int nrOctaves) const;
+		void fractal3(const float *x, const float *y, const float *z, float *out, int count, int nrOctaves) const;
+
+		// Backend of the batch functions (unsupported backends fall back to the best supported one)
+		NoiseBackend getBackend() const { return backend; }
+		void setBackend(NoiseBackend backend);
+};
\ No newline at end of file
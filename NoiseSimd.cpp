@@ -0,0 +1,376 @@
+#include "NoiseSimd.hpp"
+
+#ifdef NOISE_SIMD
+
+#include <cstring>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+
+// MSVC compiles the AVX2 intrinsics without special flags, GCC and Clang need the target per function
+#ifdef _MSC_VER
+#define AVX2_FUNCTION static inline
+#define AVX2_KERNEL
+#else
+#define AVX2_FUNCTION static inline __attribute__((target("avx2")))
+#define AVX2_KERNEL __attribute__((target("avx2")))
+#endif
+
+
+
+bool cpuSupportsAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// The operating system also has to save the AVX registers on context switches
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (! osxsave || ! avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                       SSE2                                       */
+/* -------------------------------------------------------------------------------- */
+
+// The kernels mirror the scalar functions in Noise.cpp operation by operation (without fused
+// multiply-adds), so they return exactly the same values
+
+static inline __m128 select4(__m128i mask, __m128 a, __m128 b)
+{
+	__m128 m = _mm_castsi128_ps(mask);
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+
+static inline __m128 negateIf4(__m128i mask, __m128 v)
+{
+	return _mm_xor_ps(v, _mm_and_ps(_mm_castsi128_ps(mask), _mm_set1_ps(-0.0f)));
+}
+
+
+static inline __m128i bitSet4(__m128i h, int bit)
+{
+	__m128i b = _mm_set1_epi32(bit);
+	return _mm_cmpeq_epi32(_mm_and_si128(h, b), b);
+}
+
+
+static inline __m128i gather4(const int32_t *table, __m128i index)
+{
+	// SSE2 has no gather, the lookups are done one by one
+	alignas(16) int32_t i[4];
+	_mm_store_si128((__m128i*)i, index);
+	return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+
+static inline __m128 fade4(__m128 t)
+{
+	__m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+	__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+	return _mm_mul_ps(t3, inner);
+}
+
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+
+// Floor of each lane as float and as integer (SSE2 has no rounding instruction)
+static inline void floor4(__m128 x, __m128 &floored, __m128i &index)
+{
+	__m128i truncated = _mm_cvttps_epi32(x);
+	__m128 f = _mm_cvtepi32_ps(truncated);
+	__m128 greater = _mm_cmpgt_ps(f, x);
+	floored = _mm_sub_ps(f, _mm_and_ps(greater, _mm_set1_ps(1.0f)));
+	index = _mm_add_epi32(truncated, _mm_castps_si128(greater));
+}
+
+
+static inline __m128 grad2Sse2(__m128i hash, __m128 x, __m128 y)
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+	__m128i sign = bitSet4(h, 1), second = bitSet4(h, 2);
+	__m128 diagonal = _mm_add_ps(negateIf4(sign, x), negateIf4(second, y));
+	__m128 axis = negateIf4(sign, select4(second, y, x));
+	return select4(_mm_cmplt_epi32(h, _mm_set1_epi32(4)), diagonal, axis);
+}
+
+
+static inline __m128 grad3Sse2(__m128i hash, __m128 x, __m128 y, __m128 z)
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	__m128 u = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(8)), x, y);
+	__m128i useX = _mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14)));
+	__m128 v = select4(_mm_cmplt_epi32(h, _mm_set1_epi32(4)), y, select4(useX, x, z));
+	return _mm_add_ps(negateIf4(bitSet4(h, 1), u), negateIf4(bitSet4(h, 2), v));
+}
+
+
+static inline __m128 noise2Block4(const int32_t *perm, __m128 x, __m128 y)
+{
+	__m128 fx, fy;
+	__m128i xi, yi;
+	floor4(x, fx, xi);
+	floor4(y, fy, yi);
+	__m128i mask = _mm_set1_epi32(255), one = _mm_set1_epi32(1);
+	xi = _mm_and_si128(xi, mask);
+	yi = _mm_and_si128(yi, mask);
+	x = _mm_sub_ps(x, fx);
+	y = _mm_sub_ps(y, fy);
+	__m128 u = fade4(x), v = fade4(y);
+	__m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f)), y1 = _mm_sub_ps(y, _mm_set1_ps(1.0f));
+
+	__m128i a = _mm_add_epi32(gather4(perm, xi), yi);
+	__m128i b = _mm_add_epi32(gather4(perm, _mm_add_epi32(xi, one)), yi);
+	__m128 result = lerp4(lerp4(grad2Sse2(gather4(perm, a), x, y), grad2Sse2(gather4(perm, b), x1, y), u),
+		lerp4(grad2Sse2(gather4(perm, _mm_add_epi32(a, one)), x, y1), grad2Sse2(gather4(perm, _mm_add_epi32(b, one)), x1, y1), u), v);
+	return _mm_mul_ps(_mm_set1_ps(0.7071f), result);
+}
+
+
+static inline __m128 noise3Block4(const int32_t *perm, __m128 x, __m128 y, __m128 z)
+{
+	__m128 fx, fy, fz;
+	__m128i xi, yi, zi;
+	floor4(x, fx, xi);
+	floor4(y, fy, yi);
+	floor4(z, fz, zi);
+	__m128i mask = _mm_set1_epi32(255), one = _mm_set1_epi32(1);
+	xi = _mm_and_si128(xi, mask);
+	yi = _mm_and_si128(yi, mask);
+	zi = _mm_and_si128(zi, mask);
+	x = _mm_sub_ps(x, fx);
+	y = _mm_sub_ps(y, fy);
+	z = _mm_sub_ps(z, fz);
+	__m128 u = fade4(x), v = fade4(y), w = fade4(z);
+	__m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f)), y1 = _mm_sub_ps(y, _mm_set1_ps(1.0f)), z1 = _mm_sub_ps(z, _mm_set1_ps(1.0f));
+
+	__m128i a = _mm_add_epi32(gather4(perm, xi), yi);
+	__m128i aa = _mm_add_epi32(gather4(perm, a), zi), ab = _mm_add_epi32(gather4(perm, _mm_add_epi32(a, one)), zi);
+	__m128i b = _mm_add_epi32(gather4(perm, _mm_add_epi32(xi, one)), yi);
+	__m128i ba = _mm_add_epi32(gather4(perm, b), zi), bb = _mm_add_epi32(gather4(perm, _mm_add_epi32(b, one)), zi);
+	return lerp4(
+		lerp4(lerp4(grad3Sse2(gather4(perm, aa), x, y, z), grad3Sse2(gather4(perm, ba), x1, y, z), u),
+			lerp4(grad3Sse2(gather4(perm, ab), x, y1, z), grad3Sse2(gather4(perm, bb), x1, y1, z), u), v),
+		lerp4(lerp4(grad3Sse2(gather4(perm, _mm_add_epi32(aa, one)), x, y, z1), grad3Sse2(gather4(perm, _mm_add_epi32(ba, one)), x1, y, z1), u),
+			lerp4(grad3Sse2(gather4(perm, _mm_add_epi32(ab, one)), x, y1, z1), grad3Sse2(gather4(perm, _mm_add_epi32(bb, one)), x1, y1, z1), u), v),
+		w);
+}
+
+
+void noise2Sse2(const int32_t *perm, const float *x, const float *y, float *out, int count)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, noise2Block4(perm, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+
+	// The remaining samples are padded to a full vector
+	if (i < count)
+	{
+		float px[4] = {}, py[4] = {}, result[4];
+		memcpy(px, x + i, (count - i) * sizeof(float));
+		memcpy(py, y + i, (count - i) * sizeof(float));
+		_mm_storeu_ps(result, noise2Block4(perm, _mm_loadu_ps(px), _mm_loadu_ps(py)));
+		memcpy(out + i, result, (count - i) * sizeof(float));
+	}
+}
+
+
+void noise3Sse2(const int32_t *perm, const float *x, const float *y, const float *z, float *out, int count)
+{
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, noise3Block4(perm, _mm_loadu_ps(x + i), _mm_loadu_ps(y + i), _mm_loadu_ps(z + i)));
+
+	// The remaining samples are padded to a full vector
+	if (i < count)
+	{
+		float px[4] = {}, py[4] = {}, pz[4] = {}, result[4];
+		memcpy(px, x + i, (count - i) * sizeof(float));
+		memcpy(py, y + i, (count - i) * sizeof(float));
+		memcpy(pz, z + i, (count - i) * sizeof(float));
+		_mm_storeu_ps(result, noise3Block4(perm, _mm_loadu_ps(px), _mm_loadu_ps(py), _mm_loadu_ps(pz)));
+		memcpy(out + i, result, (count - i) * sizeof(float));
+	}
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                       AVX2                                       */
+/* -------------------------------------------------------------------------------- */
+
+AVX2_FUNCTION __m256 select8(__m256i mask, __m256 a, __m256 b)
+{
+	return _mm256_blendv_ps(b, a, _mm256_castsi256_ps(mask));
+}
+
+
+AVX2_FUNCTION __m256 negateIf8(__m256i mask, __m256 v)
+{
+	return _mm256_xor_ps(v, _mm256_and_ps(_mm256_castsi256_ps(mask), _mm256_set1_ps(-0.0f)));
+}
+
+
+AVX2_FUNCTION __m256i bitSet8(__m256i h, int bit)
+{
+	__m256i b = _mm256_set1_epi32(bit);
+	return _mm256_cmpeq_epi32(_mm256_and_si256(h, b), b);
+}
+
+
+AVX2_FUNCTION __m256i lessThan8(__m256i a, int b)
+{
+	return _mm256_cmpgt_epi32(_mm256_set1_epi32(b), a);
+}
+
+
+AVX2_FUNCTION __m256i gather8(const int32_t *table, __m256i index)
+{
+	return _mm256_i32gather_epi32((const int*)table, index, 4);
+}
+
+
+AVX2_FUNCTION __m256 fade8(__m256 t)
+{
+	__m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+	__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f));
+	return _mm256_mul_ps(t3, inner);
+}
+
+
+AVX2_FUNCTION __m256 lerp8(__m256 a, __m256 b, __m256 t)
+{
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+
+AVX2_FUNCTION __m256 grad2Avx2(__m256i hash, __m256 x, __m256 y)
+{
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+	__m256i sign = bitSet8(h, 1), second = bitSet8(h, 2);
+	__m256 diagonal = _mm256_add_ps(negateIf8(sign, x), negateIf8(second, y));
+	__m256 axis = negateIf8(sign, select8(second, y, x));
+	return select8(lessThan8(h, 4), diagonal, axis);
+}
+
+
+AVX2_FUNCTION __m256 grad3Avx2(__m256i hash, __m256 x, __m256 y, __m256 z)
+{
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+	__m256 u = select8(lessThan8(h, 8), x, y);
+	__m256i useX = _mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14)));
+	__m256 v = select8(lessThan8(h, 4), y, select8(useX, x, z));
+	return _mm256_add_ps(negateIf8(bitSet8(h, 1), u), negateIf8(bitSet8(h, 2), v));
+}
+
+
+AVX2_FUNCTION __m256 noise2Block8(const int32_t *perm, __m256 x, __m256 y)
+{
+	__m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y);
+	__m256i mask = _mm256_set1_epi32(255), one = _mm256_set1_epi32(1);
+	__m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+	__m256i yi = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+	x = _mm256_sub_ps(x, fx);
+	y = _mm256_sub_ps(y, fy);
+	__m256 u = fade8(x), v = fade8(y);
+	__m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1.0f)), y1 = _mm256_sub_ps(y, _mm256_set1_ps(1.0f));
+
+	__m256i a = _mm256_add_epi32(gather8(perm, xi), yi);
+	__m256i b = _mm256_add_epi32(gather8(perm, _mm256_add_epi32(xi, one)), yi);
+	__m256 result = lerp8(lerp8(grad2Avx2(gather8(perm, a), x, y), grad2Avx2(gather8(perm, b), x1, y), u),
+		lerp8(grad2Avx2(gather8(perm, _mm256_add_epi32(a, one)), x, y1), grad2Avx2(gather8(perm, _mm256_add_epi32(b, one)), x1, y1), u), v);
+	return _mm256_mul_ps(_mm256_set1_ps(0.7071f), result);
+}
+
+
+AVX2_FUNCTION __m256 noise3Block8(const int32_t *perm, __m256 x, __m256 y, __m256 z)
+{
+	__m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y), fz = _mm256_floor_ps(z);
+	__m256i mask = _mm256_set1_epi32(255), one = _mm256_set1_epi32(1);
+	__m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+	__m256i yi = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+	__m256i zi = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+	x = _mm256_sub_ps(x, fx);
+	y = _mm256_sub_ps(y, fy);
+	z = _mm256_sub_ps(z, fz);
+	__m256 u = fade8(x), v = fade8(y), w = fade8(z);
+	__m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1.0f)), y1 = _mm256_sub_ps(y, _mm256_set1_ps(1.0f)), z1 = _mm256_sub_ps(z, _mm256_set1_ps(1.0f));
+
+	__m256i a = _mm256_add_epi32(gather8(perm, xi), yi);
+	__m256i aa = _mm256_add_epi32(gather8(perm, a), zi), ab = _mm256_add_epi32(gather8(perm, _mm256_add_epi32(a, one)), zi);
+	__m256i b = _mm256_add_epi32(gather8(perm, _mm256_add_epi32(xi, one)), yi);
+	__m256i ba = _mm256_add_epi32(gather8(perm, b), zi), bb = _mm256_add_epi32(gather8(perm, _mm256_add_epi32(b, one)), zi);
+	return lerp8(
+		lerp8(lerp8(grad3Avx2(gather8(perm, aa), x, y, z), grad3Avx2(gather8(perm, ba), x1, y, z), u),
+			lerp8(grad3Avx2(gather8(perm, ab), x, y1, z), grad3Avx2(gather8(perm, bb), x1, y1, z), u), v),
+		lerp8(lerp8(grad3Avx2(gather8(perm, _mm256_add_epi32(aa, one)), x, y, z1), grad3Avx2(gather8(perm, _mm256_add_epi32(ba, one)), x1, y, z1), u),
+			lerp8(grad3Avx2(gather8(perm, _mm256_add_epi32(ab, one)), x, y1, z1), grad3Avx2(gather8(perm, _mm256_add_epi32(bb, one)), x1, y1, z1), u), v),
+		w);
+}
+
+
+AVX2_KERNEL void noise2Avx2(const int32_t *perm, const float *x, const float *y, float *out, int count)
+{
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, noise2Block8(perm, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+
+	// The remaining samples are padded to a full vector
+	if (i < count)
+	{
+		float px[8] = {}, py[8] = {}, result[8];
+		memcpy(px, x + i, (count - i) * sizeof(float));
+		memcpy(py, y + i, (count - i) * sizeof(float));
+		_mm256_storeu_ps(result, noise2Block8(perm, _mm256_loadu_ps(px), _mm256_loadu_ps(py)));
+		memcpy(out + i, result, (count - i) * sizeof(float));
+	}
+
+	// Avoid the penalty of switching back to legacy SSE code
+	_mm256_zeroupper();
+}
+
+
+AVX2_KERNEL void noise3Avx2(const int32_t *perm, const float *x, const float *y, const float *z, float *out, int count)
+{
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, noise3Block8(perm, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), _mm256_loadu_ps(z + i)));
+
+	// The remaining samples are padded to a full vector
+	if (i < count)
+	{
+		float px[8] = {}, py[8] = {}, pz[8] = {}, result[8];
+		memcpy(px, x + i, (count - i) * sizeof(float));
+		memcpy(py, y + i, (count - i) * sizeof(float));
+		memcpy(pz, z + i, (count - i) * sizeof(float));
+		_mm256_storeu_ps(result, noise3Block8(perm, _mm256_loadu_ps(px), _mm256_loadu_ps(py), _mm256_loadu_ps(pz)));
+		memcpy(out + i, result, (count - i) * sizeof(float));
+	}
+
+	// Avoid the penalty of switching back to legacy SSE code
+	_mm256_zeroupper();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+using namespace std;
+
+
+
+// SIMD kernels of the batch functions of GradientNoise, only available on x86. perm is the repeated
+// permutation (512 entries), count doesn't have to be a multiple of the vector width.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NOISE_SIMD
+
+void noise2Sse2(const int32_t *perm, const float *x, const float *y, float *out, int count);
+void noise3Sse2(const int32_t *perm, const float *x, const float *y, const float *z, float *out, int count);
+void noise2Avx2(const int32_t *perm, const float *x, const float *y, float *out, int count);
+void noise3Avx2(const int32_t *perm, const float *x, const float *y, const float *z, float *out, int count);
+
+// Whether the CPU and the operating system support AVX2
+bool cpuSupportsAvx2();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "PlayerPhysics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+// Tolerance of the cell lookups, a box touching a cell doesn't overlap it
+static const float EPSILON = 1e-4f;
+
+// Cell range overlapped by the interval (cells span [i - 0.5, i + 0.5))
+static inline int firstCell(float min) { return (int)std::floor(min + EPSILON + 0.5f); }
+static inline int lastCell(float max) { return (int)std::floor(max - EPSILON + 0.5f); }
+
+
+PlayerPhysics::PlayerPhysics(function<bool(ivec3)> isSolid)
+{
+	this->isSolid = isSolid;
+	nrCellQueries = 0;
+
+	width = 0.6f;
+	height = 1.8f;
+	eyeHeight = 1.6f;
+	gravity = 28.0f;
+	maxFallSpeed = 60.0f;
+	jumpSpeed = 9.0f;      // Jumps 1.45 blocks high
+	stepHeight = 1.0f;
+}
+
+
+Aabb PlayerPhysics::boxOf(vec3 position) const
+{
+	Aabb box;
+	box.min = position - vec3(width / 2.0f, 0.0f, width / 2.0f);
+	box.max = position + vec3(width / 2.0f, height, width / 2.0f);
+	return box;
+}
+
+
+bool PlayerPhysics::overlaps(const Aabb &box)
+{
+	for (int y = firstCell(box.min.y); y <= lastCell(box.max.y); y++)
+	{
+		for (int z = firstCell(box.min.z); z <= lastCell(box.max.z); z++)
+		{
+			for (int x = firstCell(box.min.x); x <= lastCell(box.max.x); x++)
+			{
+				nrCellQueries++;
+				if (isSolid(ivec3(x, y, z)))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+float PlayerPhysics::sweepAxis(const Aabb &box, int axis, float motion)
+{
+	if (motion == 0.0f)
+		return 0.0f;
+
+	// Cross section of the box on the other two axes
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+	int firstU = firstCell(box.min[u]), lastU = lastCell(box.max[u]);
+	int firstV = firstCell(box.min[v]), lastV = lastCell(box.max[v]);
+
+	// The layers of cells the leading face enters, from the nearest one on
+	int direction = motion > 0.0f ? 1 : -1;
+	int firstLayer, lastLayer;
+	if (motion > 0.0f)
+	{
+		firstLayer = (int)std::ceil(box.max[axis] - EPSILON + 0.5f);
+		lastLayer = (int)std::ceil(box.max[axis] + motion + 0.5f) - 1;
+	}
+	else
+	{
+		firstLayer = (int)std::floor(box.min[axis] + EPSILON - 0.5f);
+		lastLayer = (int)std::floor(box.min[axis] + motion - 0.5f) + 1;
+	}
+
+	for (int layer = firstLayer; layer * direction <= lastLayer * direction; layer += direction)
+	{
+		ivec3 cell;
+		cell[axis] = layer;
+		for (cell[v] = firstV; cell[v] <= lastV; cell[v]++)
+		{
+			for (cell[u] = firstU; cell[u] <= lastU; cell[u]++)
+			{
+				nrCellQueries++;
+				if (! isSolid(cell))
+					continue;
+
+				// Stop at the face of the layer, a box already reaching into it doesn't move back
+				if (motion > 0.0f)
+					return std::max(layer - 0.5f - box.max[axis], 0.0f);
+				return std::min(layer + 0.5f - box.min[axis], 0.0f);
+			}
+		}
+	}
+	return motion;
+}
+
+
+vec3 PlayerPhysics::sweep(Aabb &box, vec3 motion)
+{
+	vec3 moved(0.0f);
+	for (int axis : { 1, 0, 2 })
+	{
+		moved[axis] = sweepAxis(box, axis, motion[axis]);
+		box.min[axis] += moved[axis];
+		box.max[axis] += moved[axis];
+	}
+	return moved;
+}
+
+
+void PlayerPhysics::step(PlayerBody &body, vec3 walkVelocity, bool jump, float dt)
+{
+	if (jump && body.onGround)
+		body.velocity.y = jumpSpeed;
+	body.velocity.y = std::max(body.velocity.y - gravity * dt, -maxFallSpeed);
+	body.velocity.x = walkVelocity.x;
+	body.velocity.z = walkVelocity.z;
+	vec3 motion = body.velocity * dt;
+
+	Aabb start = boxOf(body.position);
+	Aabb box = start;
+	vec3 moved = sweep(box, motion);
+
+	// Walking into a ledge: the same move from up to stepHeight higher, then down onto the ledge. It's
+	// taken if it gets further.
+	bool stepped = false;
+	if (body.onGround && stepHeight > 0.0f && (moved.x != motion.x || moved.z != motion.z))
+	{
+		Aabb raised = start;
+		vec3 raisedMoved = sweep(raised, vec3(0.0f, stepHeight, 0.0f));
+		raisedMoved += sweep(raised, vec3(motion.x, 0.0f, motion.z));
+		raisedMoved += sweep(raised, vec3(0.0f, -raisedMoved.y, 0.0f));
+
+		float distance = moved.x * moved.x + moved.z * moved.z;
+		float raisedDistance = raisedMoved.x * raisedMoved.x + raisedMoved.z * raisedMoved.z;
+		if (raisedDistance > distance + EPSILON)
+		{
+			box = raised;
+			moved = raisedMoved;
+			stepped = true;
+		}
+	}
+
+	// Blocked on the way down means standing on the ground, on the way up hitting the ceiling
+	bool blockedY = stepped || moved.y != motion.y;
+	if (blockedY)
+		body.velocity.y = 0.0f;
+	body.onGround = stepped || (blockedY && motion.y < 0.0f);
+	body.position = vec3((box.min.x + box.max.x) / 2.0f, box.min.y, (box.min.z + box.max.z) / 2.0f);
+}
\ No newline at end of file
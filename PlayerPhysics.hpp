@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+
+
+// Axis-aligned box in world space (blocks are unit cubes centered on their integer position)
+struct Aabb {
+	vec3 min;
+	vec3 max;
+};
+
+// The player's body: a box standing on its bottom center
+struct PlayerBody {
+	vec3 position;   // Bottom center of the box (the feet)
+	vec3 velocity;
+	bool onGround;
+};
+
+
+// Moves the player's box through the block grid with gravity, jumping and stepping up single blocks.
+// Collisions are resolved per axis: the box is swept along one axis at a time, layer of cells by layer
+// of cells from its leading face, and stops at the first solid cell. A sweep only looks at the cells it
+// passes, so it costs as much as the cells overlapped and the box can't tunnel through a block at any speed.
+class PlayerPhysics
+{
+	private:
+		function<bool(ivec3)> isSolid;
+		size_t nrCellQueries;
+
+		// Movement along one axis possible from motion, stopping in front of the first solid cell
+		float sweepAxis(const Aabb &box, int axis, float motion);
+
+		// Move the box by motion one axis after the other, y first, and return the movement made
+		vec3 sweep(Aabb &box, vec3 motion);
+
+	public:
+		// Dimensions in blocks, speeds in blocks per second
+		float width;
+		float height;
+		float eyeHeight;    // Camera above the feet
+		float gravity;
+		float maxFallSpeed;
+		float jumpSpeed;
+		float stepHeight;   // Highest ledge walked up onto without jumping
+
+		PlayerPhysics(function<bool(ivec3)> isSolid);
+
+		Aabb boxOf(vec3 position) const;
+
+		// Whether the box overlaps a solid cell
+		bool overlaps(const Aabb &box);
+
+		// Advance the body by dt: walk with the horizontal walkVelocity, jump if requested and the body is
+		// on the ground, fall and collide with the block grid
+		void step(PlayerBody &body, vec3 walkVelocity, bool jump, float dt);
+
+		size_t getNrCellQueries() const { return nrCellQueries; }
+};
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "Profiling.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+
+
+size_t peakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (! GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;          // in bytes
+#else
+	return (size_t)usage.ru_maxrss * 1024;   // in kilobytes
+#endif
+#endif
+}
+
+
+
+double LatencyStats::mean() const
+{
+	if (samples.empty())
+		return 0.0;
+
+	double sum = 0.0;
+	for (double sample : samples)
+		sum += sample;
+	return sum / samples.size();
+}
+
+
+double LatencyStats::stddev() const
+{
+	if (samples.empty())
+		return 0.0;
+
+	double average = mean();
+	double sum = 0.0;
+	for (double sample : samples)
+		sum += (sample - average) * (sample - average);
+	return std::sqrt(sum / samples.size());
+}
+
+
+double LatencyStats::max() const
+{
+	return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+}
+
+
+double LatencyStats::percentile(double fraction) const
+{
+	if (samples.empty())
+		return 0.0;
+
+	vector<double> sorted(samples);
+	size_t index = std::min((size_t)(fraction * sorted.size()), sorted.size() - 1);
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+
+void LatencyStats::print(const string &name, const string &unit) const
+{
+	std::cout << name << ": " << count() << " samples, mean " << mean() << " " << unit << ", p50 " << percentile(0.5) << " " << unit <<
+		", p99 " << percentile(0.99) << " " << unit << ", max " << max() << " " << unit << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+
+// Highest amount of physical memory used by this process so far, in bytes
+size_t peakMemoryUsage();
+
+
+
+// Collects samples of a duration (e.g. frame times or latencies) and reports their distribution
+class LatencyStats
+{
+	private:
+		vector<double> samples;
+
+	public:
+		void add(double sample) { samples.push_back(sample); }
+		void clear() { samples.clear(); }
+
+		size_t count() const { return samples.size(); }
+		double mean() const;
+		double stddev() const;
+		double max() const;
+
+		// Sample below which the given fraction (0..1) of the samples lies
+		double percentile(double fraction) const;
+
+		// Print count, mean, p50, p99 and max on one line
+		void print(const string &name, const string &unit) const;
+};
\ No newline at end of file
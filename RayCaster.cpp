@@ -0,0 +1,392 @@
+#include "RayCaster.hpp"
+
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#ifdef RAY_SIMD
+#include <emmintrin.h>
+#endif
+
+
+
+static const float INF = numeric_limits<float>::infinity();
+
+
+struct RayCaster::Lanes {
+	// Traversal state, structure of arrays so the step works on whole registers
+	alignas(16) float tMax[3][4];      // Distance at which the ray crosses the next cell boundary of each axis
+	alignas(16) float tFirst[3][4];    // Distance of the first cell boundary of each axis (INF if never crossed)
+	alignas(16) float tDelta[3][4];    // Distance between the cell boundaries of each axis (0 if never crossed)
+	alignas(16) int32_t nrCrossed[3][4];   // Boundaries crossed on each axis, the next one is tMax
+	alignas(16) int32_t cell[3][4];
+	alignas(16) int32_t step[3][4];    // Direction of the ray on each axis: -1, 0 or 1
+	alignas(16) float t[4];            // Distance of the current cell's entry point
+	alignas(16) int32_t axis[4];       // Axis of the last step, -1 in the cell of the origin
+
+	vec3 origin[4];
+	vec3 direction[4];
+	float range[4];
+
+	// Chunk of the current cell
+	ivec3 chunkPos[4];
+	const Chunk *chunk[4];
+	bool visit[4];
+	bool superchunkEmpty[4];
+};
+
+
+
+RayCaster::RayCaster(const World &world) : world(world)
+{
+	nrCellSteps = 0;
+	nrBricksSkipped = 0;
+	nrChunksSkipped = 0;
+	nrSuperchunksSkipped = 0;
+	nrChunkLookups = 0;
+	usePyramid = true;
+	call = 0;
+	for (CachedChunk &entry : chunkCache)
+		entry.call = 0;
+
+	for (int id = 0; id < 256; id++)
+		setHits((BlockId)id, id != AIR);
+}
+
+
+void RayCaster::setHits(BlockId id, bool hit)
+{
+	hits[id] = hit;
+
+	hitIds.clear();
+	for (int i = 0; i < 256; i++)
+	{
+		if (hits[i])
+			hitIds.push_back((BlockId)i);
+	}
+	hitsAllButAir = ! hits[AIR] && hitIds.size() == 255;
+}
+
+
+RayHit RayCaster::cast(const Ray &ray)
+{
+	Lanes lanes;
+	RayHit hit;
+
+	call++;
+	begin(lanes, 0, ray);
+	while (! examine(lanes, 0, hit))
+	{
+		stepLane(lanes, 0);
+		nrCellSteps++;
+	}
+	return hit;
+}
+
+
+void RayCaster::castBatch(const Ray *rays, RayHit *results, size_t count)
+{
+#ifndef RAY_SIMD
+	for (size_t i = 0; i < count; i++)
+		results[i] = cast(rays[i]);
+#else
+	call++;
+	Lanes lanes = {};
+	int64_t rayOf[4];   // Ray traced in each lane, -1 for idle lanes
+	size_t next = 0;
+	int nrActive = 0;
+
+	// Start the next ray of the batch that doesn't finish right away in the lane
+	auto refill = [&](int lane)
+	{
+		rayOf[lane] = -1;
+		while (next < count)
+		{
+			size_t i = next++;
+			begin(lanes, lane, rays[i]);
+			if (! examine(lanes, lane, results[i]))
+			{
+				rayOf[lane] = (int64_t)i;
+				nrActive++;
+				return;
+			}
+		}
+	};
+
+	for (int lane = 0; lane < 4; lane++)
+		refill(lane);
+
+	const __m128 allSet = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	while (nrActive > 0)
+	{
+		// Step all lanes at once: the axis with the nearest boundary is crossed (ties go to x, then y as in
+		// stepLane), idle lanes step along and are ignored
+		__m128 tx = _mm_load_ps(lanes.tMax[0]);
+		__m128 ty = _mm_load_ps(lanes.tMax[1]);
+		__m128 tz = _mm_load_ps(lanes.tMax[2]);
+
+		__m128 mx = _mm_and_ps(_mm_cmple_ps(tx, ty), _mm_cmple_ps(tx, tz));
+		__m128 my = _mm_andnot_ps(mx, _mm_cmple_ps(ty, tz));
+		__m128 mz = _mm_andnot_ps(_mm_or_ps(mx, my), allSet);
+
+		__m128 t = _mm_or_ps(_mm_and_ps(mx, tx), _mm_or_ps(_mm_and_ps(my, ty), _mm_and_ps(mz, tz)));
+		_mm_store_ps(lanes.t, t);
+
+		// The next boundary is tFirst + nrCrossed * tDelta, as in boundary (the masks are -1 where set)
+		__m128 masks[3] = { mx, my, mz };
+		for (int a = 0; a < 3; a++)
+		{
+			__m128i mask = _mm_castps_si128(masks[a]);
+			__m128i nrCrossed = _mm_sub_epi32(_mm_load_si128((const __m128i *)lanes.nrCrossed[a]), mask);
+			_mm_store_si128((__m128i *)lanes.nrCrossed[a], nrCrossed);
+			_mm_store_ps(lanes.tMax[a], _mm_add_ps(_mm_load_ps(lanes.tFirst[a]), _mm_mul_ps(_mm_cvtepi32_ps(nrCrossed), _mm_load_ps(lanes.tDelta[a]))));
+
+			__m128i cell = _mm_load_si128((const __m128i *)lanes.cell[a]);
+			__m128i step = _mm_and_si128(mask, _mm_load_si128((const __m128i *)lanes.step[a]));
+			_mm_store_si128((__m128i *)lanes.cell[a], _mm_add_epi32(cell, step));
+		}
+		__m128i axis = _mm_or_si128(_mm_and_si128(_mm_castps_si128(my), _mm_set1_epi32(1)), _mm_and_si128(_mm_castps_si128(mz), _mm_set1_epi32(2)));
+		_mm_store_si128((__m128i *)lanes.axis, axis);
+
+		nrCellSteps += nrActive;
+
+		// The block lookups are done lane by lane
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (rayOf[lane] >= 0 && examine(lanes, lane, results[rayOf[lane]]))
+			{
+				nrActive--;
+				refill(lane);
+			}
+		}
+	}
+#endif
+}
+
+
+const RayCaster::CachedChunk &RayCaster::lookupChunk(ivec3 chunkPos)
+{
+	CachedChunk &entry = chunkCache[ChunkPosHash()(chunkPos) % CHUNK_CACHE_SIZE];
+	if (entry.call != call || entry.pos != chunkPos)
+	{
+		entry.pos = chunkPos;
+		entry.chunk = world.getChunk(chunkPos);
+		entry.visit = needsVisit(entry.chunk);
+
+		// Only needed to skip chunks that aren't visited, a visited chunk isn't empty
+		entry.superchunkEmpty = false;
+		if (usePyramid && ! entry.visit && (! entry.chunk || entry.chunk->summary().isEmpty()))
+		{
+			const SuperchunkOccupancy *superchunk = world.getSuperchunk(superchunkPosOf(chunkPos));
+			entry.superchunkEmpty = ! superchunk || superchunk->occupied.load(memory_order_relaxed) == 0;
+		}
+		entry.call = call;
+		nrChunkLookups++;
+	}
+	return entry;
+}
+
+
+bool RayCaster::needsVisit(const Chunk *chunk) const
+{
+	if (! chunk)
+		return false;
+
+	const ChunkSummary &summary = chunk->summary();
+	if (hitsAllButAir)
+		return ! summary.isEmpty();
+
+	for (BlockId id : hitIds)
+	{
+		if (summary.contains(id))
+			return true;
+	}
+	return false;
+}
+
+
+void RayCaster::begin(Lanes &lanes, int lane, const Ray &ray)
+{
+	float length = glm::length(ray.direction);
+	vec3 direction = length > 0.0f ? ray.direction / length : vec3(0.0f);
+	ivec3 cell = cellOf(ray.origin);
+
+	lanes.origin[lane] = ray.origin;
+	lanes.direction[lane] = direction;
+	lanes.range[lane] = ray.range;
+	lanes.t[lane] = 0.0f;
+	lanes.axis[lane] = -1;
+	for (int a = 0; a < 3; a++)
+	{
+		// Components too small to ever cross a boundary count as 0
+		float tDelta = direction[a] != 0.0f ? 1.0f / std::abs(direction[a]) : INF;
+		lanes.cell[a][lane] = cell[a];
+		lanes.step[a][lane] = tDelta == INF ? 0 : (direction[a] > 0.0f ? 1 : -1);
+		lanes.tDelta[a][lane] = tDelta == INF ? 0.0f : tDelta;
+	}
+	setBoundaries(lanes, lane);
+
+	const CachedChunk &entry = lookupChunk(chunkPosOf(cell));
+	lanes.chunkPos[lane] = entry.pos;
+	lanes.chunk[lane] = entry.chunk;
+	lanes.visit[lane] = entry.visit;
+	lanes.superchunkEmpty[lane] = entry.superchunkEmpty;
+}
+
+
+bool RayCaster::examine(Lanes &lanes, int lane, RayHit &hit)
+{
+	while (true)
+	{
+		if (lanes.t[lane] > lanes.range[lane])
+		{
+			hit.hit = false;
+			return true;
+		}
+
+		ivec3 cell(lanes.cell[0][lane], lanes.cell[1][lane], lanes.cell[2][lane]);
+		ivec3 chunkPos = chunkPosOf(cell);
+		if (chunkPos != lanes.chunkPos[lane])
+		{
+			const CachedChunk &entry = lookupChunk(chunkPos);
+			lanes.chunkPos[lane] = chunkPos;
+			lanes.chunk[lane] = entry.chunk;
+			lanes.visit[lane] = entry.visit;
+			lanes.superchunkEmpty[lane] = entry.superchunkEmpty;
+		}
+
+		if (! lanes.visit[lane])
+		{
+			if (usePyramid && lanes.superchunkEmpty[lane])
+			{
+				const int size = SUPERCHUNK_CHUNKS * CHUNK_SIZE;
+				skipCube(lanes, lane, superchunkPosOf(chunkPos) * size, size);
+				nrSuperchunksSkipped++;
+			}
+			else
+			{
+				skipCube(lanes, lane, chunkPos * CHUNK_SIZE, CHUNK_SIZE);
+				nrChunksSkipped++;
+			}
+			continue;
+		}
+
+		// The summary is valid, needsVisit computed it
+		int index = blockIndexOf(cell);
+		if (usePyramid && ! lanes.chunk[lane]->summary().isBrickOccupied(brickOf(index)))
+		{
+			skipCube(lanes, lane, ivec3(cell.x & ~(BRICK_SIZE - 1), cell.y & ~(BRICK_SIZE - 1), cell.z & ~(BRICK_SIZE - 1)), BRICK_SIZE);
+			nrBricksSkipped++;
+			continue;
+		}
+
+		int axis = lanes.axis[lane];
+		if (axis < 0)
+			return false;
+
+		BlockId id = lanes.chunk[lane]->get(index);
+		if (! hits[id])
+			return false;
+
+		hit.hit = true;
+		hit.cell = cell;
+		hit.normal = ivec3(0);
+		hit.normal[axis] = -lanes.step[axis][lane];
+		hit.distance = lanes.t[lane];
+		hit.id = id;
+		return true;
+	}
+}
+
+
+
+void RayCaster::setBoundaries(Lanes &lanes, int lane)
+{
+	for (int a = 0; a < 3; a++)
+	{
+		int step = lanes.step[a][lane];
+		if (step == 0)
+			lanes.tFirst[a][lane] = INF;
+		else
+			lanes.tFirst[a][lane] = ((float)lanes.cell[a][lane] + 0.5f * (float)step - lanes.origin[lane][a]) / lanes.direction[lane][a];
+		lanes.nrCrossed[a][lane] = 0;
+		lanes.tMax[a][lane] = lanes.tFirst[a][lane];
+	}
+}
+
+
+float RayCaster::boundary(const Lanes &lanes, int lane, int axis, int index)
+{
+	// The same operations as the packet step, so both give the same distances
+	return lanes.tFirst[axis][lane] + (float)index * lanes.tDelta[axis][lane];
+}
+
+
+void RayCaster::crossBoundaries(Lanes &lanes, int lane, int axis, int count)
+{
+	lanes.nrCrossed[axis][lane] += count;
+	lanes.cell[axis][lane] += count * lanes.step[axis][lane];
+	lanes.tMax[axis][lane] = boundary(lanes, lane, axis, lanes.nrCrossed[axis][lane]);
+}
+
+
+void RayCaster::stepLane(Lanes &lanes, int lane)
+{
+	float tx = lanes.tMax[0][lane];
+	float ty = lanes.tMax[1][lane];
+	float tz = lanes.tMax[2][lane];
+	int axis = (tx <= ty && tx <= tz) ? 0 : (ty <= tz ? 1 : 2);
+
+	lanes.t[lane] = lanes.tMax[axis][lane];
+	lanes.axis[lane] = axis;
+	crossBoundaries(lanes, lane, axis, 1);
+}
+
+
+void RayCaster::skipCube(Lanes &lanes, int lane, ivec3 firstCell, int size)
+{
+	ivec3 lastCell = firstCell + (size - 1);
+
+	// Boundaries each axis has to cross to leave the cube, and the distance of the last one
+	int nrToExit[3];
+	float tExit[3];
+	for (int a = 0; a < 3; a++)
+	{
+		int step = lanes.step[a][lane];
+		int cell = lanes.cell[a][lane];
+		nrToExit[a] = step > 0 ? lastCell[a] - cell + 1 : cell - firstCell[a] + 1;
+		tExit[a] = step == 0 ? INF : boundary(lanes, lane, a, lanes.nrCrossed[a][lane] + nrToExit[a] - 1);
+	}
+
+	// The steps cross the boundaries in the order of their distances, ties go to x, then y (see stepLane)
+	int exitAxis = (tExit[0] <= tExit[1] && tExit[0] <= tExit[2]) ? 0 : (tExit[1] <= tExit[2] ? 1 : 2);
+	float t = tExit[exitAxis];
+	lanes.t[lane] = t;
+	if (t == INF)
+		return;
+
+	// Boundaries of the other axes the steps would cross before the exit: estimated from the distance and
+	// corrected with the exact distances of the boundaries
+	for (int a = 0; a < 3; a++)
+	{
+		if (a == exitAxis || lanes.step[a][lane] == 0)
+			continue;
+
+		int first = lanes.nrCrossed[a][lane];
+		auto isBeforeExit = [&](int count)
+		{
+			float tBoundary = boundary(lanes, lane, a, first + count - 1);
+			return tBoundary < t || (tBoundary == t && a < exitAxis);
+		};
+		float estimate = std::floor((t - lanes.tFirst[a][lane]) / lanes.tDelta[a][lane]) + 1.0f - (float)first;
+		int count = (int)std::min(std::max(estimate, 0.0f), (float)(nrToExit[a] - 1));
+		while (count < nrToExit[a] - 1 && isBeforeExit(count + 1))
+			count++;
+		while (count > 0 && ! isBeforeExit(count))
+			count--;
+		crossBoundaries(lanes, lane, a, count);
+	}
+
+	lanes.axis[lane] = exitAxis;
+	crossBoundaries(lanes, lane, exitAxis, nrToExit[exitAxis]);
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "World.hpp"
+
+using namespace std;
+using namespace glm;
+
+
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RAY_SIMD
+#endif
+
+
+struct Ray {
+	vec3 origin;
+	vec3 direction;   // Doesn't have to be normalized
+	float range;      // Longest distance along the ray that is searched
+};
+
+struct RayHit {
+	bool hit;
+	ivec3 cell;       // Block hit
+	ivec3 normal;     // Face the ray entered the block through
+	float distance;   // From the origin to the entry point
+	BlockId id;
+};
+
+
+// Casts rays through the block grid of a world and finds the first block of the hit ids along each ray.
+// A ray walks the cells it passes one after the other (3D DDA), the cell containing the origin isn't
+// tested. Chunks that aren't loaded or contain none of the hit ids are crossed in one stride to the cell
+// behind them. With the occupancy pyramid of the world, empty bricks of 4^3 blocks and empty
+// superchunks of 4^3 chunks are crossed in one stride as well, so a long ray through the sky or a cave
+// costs a few steps per superchunk and brick instead of one per block. The distance of every cell
+// boundary is computed from the first boundary of its axis and its index, never summed up, so a stride
+// ends in exactly the cell the steps would reach.
+// Not thread-safe, the chunk lookups go through World::getChunk.
+class RayCaster
+{
+	private:
+		const World &world;
+		bool hits[256];
+		vector<BlockId> hitIds;
+		size_t nrCellSteps;
+		size_t nrBricksSkipped;
+		size_t nrChunksSkipped;
+		size_t nrSuperchunksSkipped;
+		bool hitsAllButAir;
+		bool usePyramid;
+
+		// Chunks looked up during the current call of cast or castBatch, rays of a batch mostly pass the
+		// same chunks. Entries of earlier calls are invalid, the world may have changed since.
+		struct CachedChunk {
+			ivec3 pos;
+			const Chunk *chunk;
+			bool visit;
+			bool superchunkEmpty;   // No chunk of the superchunk has non-air blocks
+			uint32_t call;
+		};
+		static const int CHUNK_CACHE_SIZE = 256;
+		CachedChunk chunkCache[CHUNK_CACHE_SIZE];
+		uint32_t call;
+		size_t nrChunkLookups;
+
+		// State of up to 4 rays, one per lane of the SSE registers
+		struct Lanes;
+
+		// Distances of the first cell boundaries from the cell of the origin
+		static void setBoundaries(Lanes &lanes, int lane);
+
+		// Distance of the given boundary of an axis, counted from the first one
+		static float boundary(const Lanes &lanes, int lane, int axis, int index);
+
+		// Move the ray of the lane over the given number of boundaries of an axis
+		static void crossBoundaries(Lanes &lanes, int lane, int axis, int count);
+
+		// Advance the ray of the lane to the next cell (the scalar version of the packet step in castBatch)
+		static void stepLane(Lanes &lanes, int lane);
+
+		// Move the ray of the lane to the first cell behind the cube of size^3 blocks starting at firstCell
+		// in one stride, to the same cell and distance as stepping through the cube
+		static void skipCube(Lanes &lanes, int lane, ivec3 firstCell, int size);
+
+		// Whether a ray has to look at the blocks of the chunk
+		bool needsVisit(const Chunk *chunk) const;
+
+		const CachedChunk &lookupChunk(ivec3 chunkPos);
+
+		void begin(Lanes &lanes, int lane, const Ray &ray);
+
+		// Process the cell the ray of the lane just stepped into, skipping chunks. Returns true with the
+		// hit filled in when the ray is finished, false if it has to step on.
+		bool examine(Lanes &lanes, int lane, RayHit &hit);
+
+	public:
+		// All ids but air stop the rays
+		RayCaster(const World &world);
+
+		void setHits(BlockId id, bool hit);
+
+		// Skip empty bricks and superchunks with the occupancy pyramid (the default), empty chunks are
+		// skipped either way
+		void setUsePyramid(bool use) { usePyramid = use; }
+
+		RayHit cast(const Ray &ray);
+
+		// Cast count rays. On x86 the rays are traced in packets of 4, a ray leaving the packet is replaced
+		// by the next one of the batch so incoherent rays keep all lanes busy. Only the DDA step to the next
+		// cell runs in SSE registers, the block lookups and the skipping of chunks and bricks are done lane
+		// by lane in scalar code. The hits are the same as with cast.
+		void castBatch(const Ray *rays, RayHit *results, size_t count);
+
+		size_t getNrCellSteps() const { return nrCellSteps; }
+		size_t getNrBricksSkipped() const { return nrBricksSkipped; }
+		size_t getNrChunksSkipped() const { return nrChunksSkipped; }
+		size_t getNrSuperchunksSkipped() const { return nrSuperchunksSkipped; }
+		size_t getNrChunkLookups() const { return nrChunkLookups; }   // Lookups in the world, not the cache
+};
\ No newline at end of file
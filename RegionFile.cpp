@@ -0,0 +1,342 @@
+#include "RegionFile.hpp"
+#include "ChunkCodec.hpp"
+#include "Hash.hpp"
+#include "FileSystem.hpp"
+
+#include <iostream>
+#include <cstring>
+
+
+
+static const uint32_t REGION_MAGIC = 0x4745524B;   // "KREG"
+static const uint32_t REGION_VERSION = 1;
+
+// The header and the slot table occupy the first sectors
+static const uint32_t HEADER_SECTORS = (sizeof(RegionHeader) + sizeof(RegionSlot) * REGION_SLOTS + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+
+
+ivec3 RegionFile::regionPosOf(ivec3 chunkPos)
+{
+	return ivec3(chunkPos.x >> 3, chunkPos.y >> 3, chunkPos.z >> 3);
+}
+
+
+int RegionFile::slotOf(ivec3 chunkPos)
+{
+	return (chunkPos.x & 7) + (chunkPos.z & 7) * REGION_SIZE + (chunkPos.y & 7) * REGION_SIZE * REGION_SIZE;
+}
+
+
+ivec3 RegionFile::chunkPosOf(int slot) const
+{
+	return ivec3(header.x, header.y, header.z) * REGION_SIZE + ivec3(slot & 7, slot >> 6, (slot >> 3) & 7);
+}
+
+
+bool RegionFile::open(const string &path, ivec3 regionPos)
+{
+	this->path = path;
+	keepEmptyChunks = false;
+	file.open(path, ios::in | ios::out | ios::binary);
+
+	// Create a new region file with an empty slot table
+	if (! file.is_open())
+	{
+		memset(&header, 0, sizeof(header));
+		header.magic = REGION_MAGIC;
+		header.version = REGION_VERSION;
+		header.x = regionPos.x;
+		header.y = regionPos.y;
+		header.z = regionPos.z;
+		memset(slots, 0, sizeof(slots));
+
+		ofstream newFile(path, ios::binary | ios::trunc);
+		vector<char> headerSectors(HEADER_SECTORS * SECTOR_SIZE, 0);
+		memcpy(&headerSectors[0], &header, sizeof(header));
+		newFile.write(&headerSectors[0], headerSectors.size());
+		newFile.close();
+		if (! newFile)
+		{
+			std::cerr << "ERROR::REGION::FILE_COULD_NOT_BE_CREATED: " << path << endl;
+			return false;
+		}
+
+		file.open(path, ios::in | ios::out | ios::binary);
+		if (! file.is_open())
+			return false;
+	}
+
+	// Read the header and the slot table
+	file.seekg(0);
+	file.read((char*)&header, sizeof(header));
+	file.read((char*)slots, sizeof(slots));
+	if (! file || header.magic != REGION_MAGIC || header.version != REGION_VERSION ||
+		ivec3(header.x, header.y, header.z) != regionPos)
+	{
+		std::cerr << "ERROR::REGION::INVALID_HEADER: " << path << endl;
+		file.close();
+		return false;
+	}
+
+	markUsedSectors();
+	return true;
+}
+
+
+void RegionFile::markUsedSectors()
+{
+	// Mark the sectors in use, so freed sectors can be reused by later writes
+	file.clear();
+	file.seekg(0, ios::end);
+	fileSize = (uint64_t)file.tellg();
+	uint32_t nrSectors = (uint32_t)((fileSize + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	usedSectors.assign(std::max(nrSectors, HEADER_SECTORS), false);
+	for (uint32_t sector = 0; sector < HEADER_SECTORS; sector++)
+		usedSectors[sector] = true;
+
+	// Slots pointing outside of the file are corrupted and can't be read anyway
+	for (int slot = 0; slot < REGION_SLOTS; slot++)
+	{
+		if (! slots[slot].sector || ! isInFile(slots[slot]))
+			continue;
+		for (uint32_t i = 0; i < slots[slot].nrSectors; i++)
+			usedSectors[slots[slot].sector + i] = true;
+	}
+}
+
+
+bool RegionFile::isInFile(const RegionSlot &entry) const
+{
+	return entry.sector >= HEADER_SECTORS && entry.size <= (uint64_t)entry.nrSectors * SECTOR_SIZE &&
+		((uint64_t)entry.sector + entry.nrSectors) * SECTOR_SIZE <= fileSize;
+}
+
+
+bool RegionFile::readStoredBytes(int slot, vector<uint8_t> &payload)
+{
+	// Check the slot before trusting its size, a corrupted one could ask for gigabytes
+	const RegionSlot &entry = slots[slot];
+	if (! isInFile(entry))
+	{
+		payload.clear();
+		return false;
+	}
+
+	payload.resize(entry.size);
+	file.clear();
+	file.seekg((uint64_t)entry.sector * SECTOR_SIZE);
+	file.read((char*)payload.data(), entry.size);
+	return (bool)file;
+}
+
+
+bool RegionFile::readPayload(int slot, vector<uint8_t> &payload)
+{
+	return readStoredBytes(slot, payload) && (uint32_t)hashBytes(payload.data(), payload.size()) == slots[slot].checksum;
+}
+
+
+bool RegionFile::readChunk(int slot, BlockId *blocks)
+{
+	if (! slots[slot].sector)
+		return false;
+
+	vector<uint8_t> payload;
+	if (! readPayload(slot, payload) || ! decodeChunk(payload.data(), payload.size(), blocks))
+	{
+		ivec3 chunkPos = chunkPosOf(slot);
+		std::cerr << "ERROR::REGION::CORRUPTED_CHUNK: " << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool RegionFile::writeChunk(int slot, const BlockId *blocks)
+{
+	RegionSlot &entry = slots[slot];
+
+	// Empty chunks aren't stored
+	bool empty = true;
+	for (int i = 0; i < CHUNK_VOLUME && empty; i++)
+		empty = (blocks[i] == AIR);
+	if (empty && ! keepEmptyChunks)
+	{
+		if (! entry.sector)
+			return true;
+
+		// The sectors are only freed once the slot on disk doesn't point to them anymore
+		RegionSlot oldEntry = entry;
+		memset(&entry, 0, sizeof(entry));
+		if (! writeSlot(slot))
+		{
+			entry = oldEntry;
+			return false;
+		}
+		freeSectors(oldEntry.sector, oldEntry.nrSectors);
+		return true;
+	}
+
+	vector<uint8_t> payload;
+	encodeChunk(blocks, payload);
+	uint32_t nrSectors = (uint32_t)((payload.size() + SECTOR_SIZE - 1) / SECTOR_SIZE);
+
+	// The payload always goes to free sectors, the old ones stay intact until the slot points away
+	// from them (like commitChunks, which writes a whole new file)
+	RegionSlot oldEntry = entry;
+	RegionSlot newEntry;
+	newEntry.sector = allocateSectors(nrSectors);
+	newEntry.nrSectors = nrSectors;
+	newEntry.size = (uint32_t)payload.size();
+	newEntry.checksum = (uint32_t)hashBytes(payload.data(), payload.size());
+
+	// Pad the payload to whole sectors, so the file always ends on a sector boundary
+	payload.resize((size_t)nrSectors * SECTOR_SIZE, 0);
+
+	file.clear();
+	file.seekp((uint64_t)newEntry.sector * SECTOR_SIZE);
+	file.write((const char*)payload.data(), payload.size());
+	if (! file.good())
+	{
+		freeSectors(newEntry.sector, newEntry.nrSectors);
+		return false;
+	}
+	fileSize = std::max(fileSize, ((uint64_t)newEntry.sector + nrSectors) * SECTOR_SIZE);
+
+	// Switch the slot to the new payload. If that fails, the slot on disk may point to either one, so
+	// both runs of sectors stay in use.
+	entry = newEntry;
+	if (! writeSlot(slot))
+	{
+		entry = oldEntry;
+		return false;
+	}
+	if (oldEntry.sector)
+		freeSectors(oldEntry.sector, oldEntry.nrSectors);
+	return true;
+}
+
+
+bool RegionFile::commitChunks(const vector<int> &slots, const vector<const BlockId*> &blocks)
+{
+	// Payloads of the new region: the given chunks and the unchanged payloads of all other chunks
+	vector<vector<uint8_t>> payloads(REGION_SLOTS);
+	vector<bool> replaced(REGION_SLOTS, false);
+	vector<bool> corrupted(REGION_SLOTS, false);
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		replaced[slots[i]] = true;
+
+		bool empty = true;
+		for (int j = 0; j < CHUNK_VOLUME && empty; j++)
+			empty = (blocks[i][j] == AIR);
+		if (! empty || keepEmptyChunks)
+			encodeChunk(blocks[i], payloads[slots[i]]);
+	}
+	for (int slot = 0; slot < REGION_SLOTS; slot++)
+	{
+		if (replaced[slot] || ! this->slots[slot].sector)
+			continue;
+		if (readPayload(slot, payloads[slot]))
+			continue;
+
+		// A corrupted chunk is copied as it is with its old checksum, so it isn't lost when only its
+		// checksum or a few bytes are damaged. Bytes that can't be read at all fail the commit.
+		ivec3 chunkPos = chunkPosOf(slot);
+		std::cerr << "ERROR::REGION::CORRUPTED_CHUNK: " << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z << endl;
+		if (! readStoredBytes(slot, payloads[slot]) || payloads[slot].empty())
+		{
+			std::cerr << "ERROR::REGION::CHUNK_COULD_NOT_BE_COPIED: " << path << endl;
+			return false;
+		}
+		corrupted[slot] = true;
+	}
+
+	// Lay out the payloads one after another, which also compacts the region
+	RegionSlot newSlots[REGION_SLOTS];
+	memset(newSlots, 0, sizeof(newSlots));
+	uint32_t nrSectors = HEADER_SECTORS;
+	for (int slot = 0; slot < REGION_SLOTS; slot++)
+	{
+		if (payloads[slot].empty())
+			continue;
+		newSlots[slot].sector = nrSectors;
+		newSlots[slot].nrSectors = (uint32_t)((payloads[slot].size() + SECTOR_SIZE - 1) / SECTOR_SIZE);
+		newSlots[slot].size = (uint32_t)payloads[slot].size();
+		newSlots[slot].checksum = corrupted[slot] ? this->slots[slot].checksum : (uint32_t)hashBytes(payloads[slot].data(), payloads[slot].size());
+		nrSectors += newSlots[slot].nrSectors;
+	}
+
+	vector<uint8_t> image((size_t)nrSectors * SECTOR_SIZE, 0);
+	memcpy(&image[0], &header, sizeof(header));
+	memcpy(&image[sizeof(header)], newSlots, sizeof(newSlots));
+	for (int slot = 0; slot < REGION_SLOTS; slot++)
+	{
+		if (! payloads[slot].empty())
+			memcpy(&image[(size_t)newSlots[slot].sector * SECTOR_SIZE], payloads[slot].data(), payloads[slot].size());
+	}
+
+	// The open file has to be closed before it can be replaced on Windows
+	file.close();
+	bool written = writeFileAtomically(path, image.data(), image.size());
+	file.open(path, ios::in | ios::out | ios::binary);
+	if (! written || ! file.is_open())
+	{
+		std::cerr << "ERROR::REGION::FILE_COULD_NOT_BE_WRITTEN: " << path << endl;
+		return false;
+	}
+
+	memcpy(this->slots, newSlots, sizeof(newSlots));
+	markUsedSectors();
+	return true;
+}
+
+
+bool RegionFile::writeSlot(int slot)
+{
+	file.clear();
+	file.seekp(sizeof(RegionHeader) + (uint64_t)slot * sizeof(RegionSlot));
+	file.write((const char*)&slots[slot], sizeof(RegionSlot));
+	return file.good();
+}
+
+
+uint32_t RegionFile::allocateSectors(uint32_t nrSectors)
+{
+	// First fit
+	uint32_t runStart = 0, runLength = 0;
+	for (uint32_t sector = HEADER_SECTORS; sector < usedSectors.size(); sector++)
+	{
+		if (usedSectors[sector])
+		{
+			runLength = 0;
+			continue;
+		}
+
+		if (runLength == 0)
+			runStart = sector;
+		if (++runLength == nrSectors)
+			break;
+	}
+
+	// Append to the end of the file
+	if (runLength < nrSectors)
+	{
+		if (runLength == 0 || runStart + runLength != usedSectors.size())
+			runStart = (uint32_t)usedSectors.size();
+		usedSectors.resize(runStart + nrSectors, false);
+	}
+
+	for (uint32_t i = 0; i < nrSectors; i++)
+		usedSectors[runStart + i] = true;
+	return runStart;
+}
+
+
+void RegionFile::freeSectors(uint32_t sector, uint32_t nrSectors)
+{
+	for (uint32_t i = 0; i < nrSectors; i++)
+		usedSectors[sector + i] = false;
+}
\ No newline at end of file
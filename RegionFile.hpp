@@ -0,0 +1,87 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "World.hpp"
+
+using namespace std;
+
+
+
+// A region file stores a fixed grid of REGION_SIZE^3 chunks:
+//   header | slot table | chunk payloads, each in a run of whole sectors
+// Every chunk can be read or rewritten on its own, only its payload sectors and its slot are touched.
+const int REGION_SIZE = 8;
+const int REGION_SLOTS = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+const int SECTOR_SIZE = 4096;
+
+struct RegionHeader {
+	uint32_t magic;
+	uint32_t version;
+	int32_t x, y, z;   // Region position
+	uint32_t reserved;
+};
+
+struct RegionSlot {
+	uint32_t sector;      // First sector of the payload (0 = no chunk stored)
+	uint32_t nrSectors;   // Number of sectors reserved for the payload
+	uint32_t size;        // Size of the (compressed) payload in bytes
+	uint32_t checksum;    // Hash of the payload
+};
+
+
+
+class RegionFile
+{
+	private:
+		fstream file;
+		string path;
+		RegionHeader header;
+		RegionSlot slots[REGION_SLOTS];
+		vector<bool> usedSectors;
+		uint64_t fileSize;      // in bytes
+		bool keepEmptyChunks;   // Store empty chunks instead of freeing their slots
+
+		uint32_t allocateSectors(uint32_t nrSectors);
+		void freeSectors(uint32_t sector, uint32_t nrSectors);
+		bool writeSlot(int slot);
+		void markUsedSectors();
+		bool isInFile(const RegionSlot &entry) const;
+
+		// Read the bytes stored for the chunk without checking them
+		bool readStoredBytes(int slot, vector<uint8_t> &payload);
+
+	public:
+		// Open the region file at the given path, creating it if it doesn't exist
+		bool open(const string &path, ivec3 regionPos);
+
+		bool hasChunk(int slot) const { return slots[slot].sector != 0; }
+
+		// Read the chunk's blocks, returns false if it isn't stored or is corrupted
+		bool readChunk(int slot, BlockId *blocks);
+
+		// Read the chunk's encoded payload (see decodeChunk), returns false if it's corrupted
+		bool readPayload(int slot, vector<uint8_t> &payload);
+
+		// Worlds with generated terrain have to store chunks that became empty, otherwise they would be
+		// generated again
+		void setKeepEmptyChunks(bool keep) { keepEmptyChunks = keep; }
+
+		// Store the chunk's blocks (an empty chunk frees its slot unless empty chunks are kept). The payload
+		// is written to free sectors before the slot is switched to it, so a crash keeps the old chunk.
+		bool writeChunk(int slot, const BlockId *blocks);
+
+		// Store the given chunks by writing the whole region to a new file, which then replaces this
+		// one. Unlike writeChunk, a crash can't leave the region with partially written chunks. The
+		// other chunks are copied, corrupted ones as they are, and the commit fails if one can't be read.
+		bool commitChunks(const vector<int> &slots, const vector<const BlockId*> &blocks);
+
+		void flush() { file.flush(); }
+
+		// Position of the region containing the given chunk and the chunk's slot within it
+		static ivec3 regionPosOf(ivec3 chunkPos);
+		static int slotOf(ivec3 chunkPos);
+		ivec3 chunkPosOf(int slot) const;
+};
\ No newline at end of file
@@ -1,37 +1,151 @@
 #include "Shader.hpp"
+#include "Hash.hpp"
+#include "FileSystem.hpp"
+#include "AssetPack.hpp"
 
 
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath)
+/* -------------------------------------------------------------------------------- */
+/*                               PROGRAM BINARY CACHE                               */
+/* -------------------------------------------------------------------------------- */
+
+// The GLAD loader only covers core OpenGL 3.3, so the entry points and enums of
+// ARB_get_program_binary (core since OpenGL 4.1) are declared and loaded here
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+static PFNGLGETPROGRAMBINARYPROC getProgramBinary = NULL;
+static PFNGLPROGRAMBINARYPROC programBinary = NULL;
+static PFNGLPROGRAMPARAMETERIPROC programParameteri = NULL;
+
+static const char *SHADER_CACHE_DIR = "./shadercache";
+static const uint32_t PROGRAM_BINARY_MAGIC = 0x4248534B;   // "KSHB"
+static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+struct ProgramBinaryHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;      // Hash of the sources and the driver, see binaryCacheKey()
+	uint32_t format;   // Driver specific binary format
+	uint32_t length;   // Size of the binary following the header in bytes
+};
+
+bool Shader::binaryCacheEnabled = true;
+
+// Load the program binary functions once and check whether the driver supports at least one binary format
+static bool programBinarySupported()
 {
-	string vertexCode, fragmentCode;
-	ifstream vertexFile, fragmentFile;
+	static int supported = -1;
+
+	if (supported < 0)
+	{
+		getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+		programBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+		programParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+
+		GLint nrFormats = 0;
+		if (getProgramBinary && programBinary && programParameteri)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nrFormats);
+		glGetError();   // Drivers without the extension report GL_INVALID_ENUM for the query above
+
+		supported = nrFormats > 0 ? 1 : 0;
+
+		if (supported)
+			makeDirectory(SHADER_CACHE_DIR);
+	}
+
+	return supported == 1;
+}
+
+// A program binary is only valid for the exact same sources on the exact same driver
+static uint64_t binaryCacheKey(const string &vertexCode, const string &fragmentCode)
+{
+	uint64_t key = hashString(vertexCode);
+	key = hashString(fragmentCode, key);
+	key = hashString((const char*)glGetString(GL_VENDOR), key);
+	key = hashString((const char*)glGetString(GL_RENDERER), key);
+	key = hashString((const char*)glGetString(GL_VERSION), key);
+	return key;
+}
+
+static string binaryCachePath(uint64_t key)
+{
+	stringstream path;
+	path << SHADER_CACHE_DIR << "/" << std::hex << key << ".bin";
+	return path.str();
+}
+
+
+
+/* -------------------------------------------------------------------------------- */
+/*                                      SHADER                                      */
+/* -------------------------------------------------------------------------------- */
+
+// Insert the defines after the #version directive, which has to stay the first statement
+static string injectDefines(const string &code, const string &defines)
+{
+	if (defines.empty())
+		return code;
+
+	size_t insertPos = 0;
+	if (code.compare(0, 8, "#version") == 0)
+	{
+		insertPos = code.find('\n');
+		insertPos = (insertPos == string::npos) ? code.size() : insertPos + 1;
+	}
+
+	return code.substr(0, insertPos) + defines + code.substr(insertPos);
+}
 
-	// Ensure ifstream objects can throw exceptions
-	vertexFile.exceptions(ifstream::failbit | ifstream::badbit);
-	fragmentFile.exceptions(ifstream::failbit | ifstream::badbit);
 
-	try
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const string &defines)
+{
+	string vertexCode, fragmentCode;
+	AssetFile vertexFile, fragmentFile;
+
+	// Read the sources from the asset pack or the loose files
+	if (vertexFile.open(vertexPath) && fragmentFile.open(fragmentPath))
 	{
-		// Open files
-		vertexFile.open(vertexPath);
-		fragmentFile.open(fragmentPath);
-		// Read file's buffer contents into streams
-		stringstream vertexStream, fragmentStream;
-		vertexStream << vertexFile.rdbuf();
-		fragmentStream << fragmentFile.rdbuf();
-		// Close files
-		vertexFile.close();
-		fragmentFile.close();
-		// Convert streams to strings
-		vertexCode = vertexStream.str();
-		fragmentCode = fragmentStream.str();
+		vertexCode.assign((const char*)vertexFile.data(), vertexFile.size());
+		fragmentCode.assign((const char*)fragmentFile.data(), fragmentFile.size());
 	}
-	catch (ifstream::failure f)
+	else
 	{
 		std::cerr << "ERROR::SHADER::FILE_COULD_NOT_BE_READ" << endl;
 	}
 
+	vertexCode = injectDefines(vertexCode, defines);
+	fragmentCode = injectDefines(fragmentCode, defines);
+
+	fromBinaryCache = false;
+
+	// Restore the program from the binary cache if possible, otherwise compile it and
+	// store the resulting binary for the next launch
+	if (binaryCacheEnabled && programBinarySupported())
+	{
+		uint64_t key = binaryCacheKey(vertexCode, fragmentCode);
+
+		fromBinaryCache = loadBinary(key);
+		if (! fromBinaryCache)
+		{
+			compile(vertexCode, fragmentCode);
+			saveBinary(key);
+		}
+	}
+	else
+	{
+		compile(vertexCode, fragmentCode);
+	}
+}
+
+
+void Shader::compile(const string &vertexCode, const string &fragmentCode)
+{
 	// Convert strings to C-strings
 	const GLchar *vertexShaderSource = vertexCode.c_str();
 	const GLchar *fragmentShaderSource = fragmentCode.c_str();
@@ -69,6 +183,9 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
 	id = glCreateProgram();
 	glAttachShader(id, vertexShader);
 	glAttachShader(id, fragmentShader);
+	// The driver only keeps a retrievable binary if asked for it before linking
+	if (binaryCacheEnabled && programBinarySupported())
+		programParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(id);
 	// Print linking errors
 	glGetProgramiv(id, GL_LINK_STATUS, &success);
@@ -84,6 +201,71 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath)
 }
 
 
+bool Shader::loadBinary(uint64_t key)
+{
+	ifstream file(binaryCachePath(key), ios::binary);
+	if (! file)
+		return false;
+
+	// Check that the cache entry belongs to these sources and this driver
+	ProgramBinaryHeader header;
+	if (! file.read((char*)&header, sizeof(header)) ||
+		header.magic != PROGRAM_BINARY_MAGIC || header.version != PROGRAM_BINARY_VERSION || header.key != key)
+	{
+		return false;
+	}
+
+	string binary(header.length, '\0');
+	if (! file.read(&binary[0], header.length))
+		return false;
+
+	// The driver may still reject the binary (e.g. after an update), which shows up as a failed link
+	id = glCreateProgram();
+	programBinary(id, header.format, binary.data(), header.length);
+
+	GLint success;
+	glGetProgramiv(id, GL_LINK_STATUS, &success);
+	if (! success)
+	{
+		glDeleteProgram(id);
+		id = 0;
+		return false;
+	}
+
+	return true;
+}
+
+
+void Shader::saveBinary(uint64_t key) const
+{
+	GLint success, length = 0;
+	glGetProgramiv(id, GL_LINK_STATUS, &success);
+	glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (! success || length <= 0)
+		return;
+
+	ProgramBinaryHeader header;
+	string binary(length, '\0');
+	GLenum format;
+	getProgramBinary(id, length, NULL, &format, &binary[0]);
+
+	header.magic = PROGRAM_BINARY_MAGIC;
+	header.version = PROGRAM_BINARY_VERSION;
+	header.key = key;
+	header.format = format;
+	header.length = (uint32_t)length;
+
+	ofstream file(binaryCachePath(key), ios::binary | ios::trunc);
+	if (! file)
+	{
+		std::cerr << "ERROR::SHADER::PROGRAM_BINARY_COULD_NOT_BE_WRITTEN" << endl;
+		return;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), length);
+}
+
+
 void Shader::use() const
 {
 	glUseProgram(id);
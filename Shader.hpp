@@ -19,14 +19,33 @@ class Shader
 {
 	private:
 		GLuint id;
+		bool fromBinaryCache;   // true if the program was restored from a cached program binary
+
+		// Build the shader program from GLSL source code
+		void compile(const string &vertexCode, const string &fragmentCode);
+
+		// Program binary cache (only used if the driver supports program binaries)
+		bool loadBinary(uint64_t key);
+		void saveBinary(uint64_t key) const;
+
+		// Whether program binaries are read from and written to the on-disk cache
+		static bool binaryCacheEnabled;
 
 	public:
-		// Read the GLSL code from the specified files and build the shader program
-		Shader(const char* vertexPath, const char* fragmentPath);
+		// Switch the program binary cache on or off for the shaders created afterwards (on by default)
+		static void setBinaryCacheEnabled(bool enabled) { binaryCacheEnabled = enabled; }
+		static bool isBinaryCacheEnabled() { return binaryCacheEnabled; }
+
+		// Read the GLSL code from the specified files and build the shader program.
+		// The given #define lines are inserted into both sources right after the #version directive.
+		Shader(const char* vertexPath, const char* fragmentPath, const string &defines = "");
 
 		// Activate this shader program
 		void use() const;
 
+		// Whether the program was loaded from the program binary cache instead of being compiled
+		bool isFromBinaryCache() const { return fromBinaryCache; }
+
 		// Set uniform
 		void setUniform(const string &name, GLboolean value) const;
 		void setUniform(const string &name, GLint value) const;
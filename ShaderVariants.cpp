@@ -0,0 +1,122 @@
+#include "ShaderVariants.hpp"
+
+
+
+ShaderVariants::ShaderVariants(const char *vertexPath, const char *fragmentPath, function<void(const Shader&)> init)
+{
+	this->vertexPath = vertexPath;
+	this->fragmentPath = fragmentPath;
+	this->init = init;
+
+	activeVariant = NULL;
+	timing = false;
+
+	nrCompiled = 0;
+	nrFromBinaryCache = 0;
+	totalCompileTime = 0.0;
+}
+
+
+ShaderVariants::Variant &ShaderVariants::getVariant(const string &defines)
+{
+	map<string, Variant>::iterator it = variants.find(defines);
+	if (it != variants.end())
+		return it->second;
+
+	// Build the new permutation
+	double startTime = glfwGetTime();
+	Shader shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+	totalCompileTime += (glfwGetTime() - startTime) * 1000.0;
+
+	nrCompiled++;
+	if (shader.isFromBinaryCache())
+		nrFromBinaryCache++;
+
+	// Set constant uniforms
+	if (init)
+	{
+		shader.use();
+		init(shader);
+	}
+
+	return variants.emplace(defines, Variant(shader)).first->second;
+}
+
+
+const Shader &ShaderVariants::get(const string &defines)
+{
+	return getVariant(defines).shader;
+}
+
+
+const Shader &ShaderVariants::begin(const string &defines)
+{
+	activeVariant = &getVariant(defines);
+
+	// Collect the result of the last timed batch without waiting for the GPU.
+	// If it isn't ready yet, this batch isn't timed.
+	if (activeVariant->queryPending)
+	{
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(activeVariant->query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed;   // in nanoseconds
+			glGetQueryObjectui64v(activeVariant->query, GL_QUERY_RESULT, &elapsed);
+			activeVariant->totalGpuTime += elapsed / 1000000.0;
+			activeVariant->nrTimedBatches++;
+			activeVariant->queryPending = false;
+		}
+	}
+
+	activeVariant->shader.use();
+
+	if (! activeVariant->queryPending)
+	{
+		if (! activeVariant->query)
+			glGenQueries(1, &activeVariant->query);
+		glBeginQuery(GL_TIME_ELAPSED, activeVariant->query);
+		timing = true;
+	}
+
+	return activeVariant->shader;
+}
+
+
+void ShaderVariants::end()
+{
+	if (timing)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		activeVariant->queryPending = true;
+		timing = false;
+	}
+
+	activeVariant = NULL;
+}
+
+
+void ShaderVariants::printStats() const
+{
+	std::cout << fragmentPath << ": " << nrCompiled << " variants built (" << nrFromBinaryCache
+		<< " from the program binary cache) in " << totalCompileTime << " ms" << endl;
+
+	for (map<string, Variant>::const_iterator it = variants.begin(); it != variants.end(); it++)
+	{
+		// Turn the block of #define lines into a readable label
+		string label = it->first;
+		size_t pos;
+		while ((pos = label.find("#define ")) != string::npos)
+			label.erase(pos, 8);
+		while ((pos = label.find('\n')) != string::npos)
+			label.replace(pos, 1, pos + 1 < label.size() ? ", " : "");
+
+		const Variant &variant = it->second;
+		std::cout << "  [" << (label.empty() ? "default" : label) << "] ";
+		if (variant.nrTimedBatches > 0)
+			std::cout << variant.totalGpuTime / variant.nrTimedBatches << " ms GPU time per frame over "
+				<< variant.nrTimedBatches << " frames" << endl;
+		else
+			std::cout << "not timed" << endl;
+	}
+}
\ No newline at end of file
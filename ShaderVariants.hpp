@@ -0,0 +1,57 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <functional>
+
+#include "Shader.hpp"
+
+
+
+// Lazily compiled permutations of one shader program. Each variant is identified by the block of
+// #define lines injected into its sources, so state that would otherwise be a runtime branch in
+// the shader is resolved at compile time.
+class ShaderVariants
+{
+	private:
+		struct Variant {
+			Shader shader;
+
+			// GPU timing of the draw calls issued with this variant
+			GLuint query;
+			bool queryPending;
+			unsigned int nrTimedBatches;
+			double totalGpuTime;   // in milliseconds
+
+			Variant(const Shader &shader) : shader(shader), query(0), queryPending(false),
+				nrTimedBatches(0), totalGpuTime(0.0) {}
+		};
+
+		string vertexPath;
+		string fragmentPath;
+		function<void(const Shader&)> init;   // Sets the constant uniforms of a freshly built variant
+
+		map<string, Variant> variants;
+		Variant *activeVariant;
+		bool timing;   // true while activeVariant's timer query is running
+
+		unsigned int nrCompiled;
+		unsigned int nrFromBinaryCache;
+		double totalCompileTime;   // in milliseconds
+
+		Variant &getVariant(const string &defines);
+
+	public:
+		ShaderVariants(const char *vertexPath, const char *fragmentPath,
+			function<void(const Shader&)> init = function<void(const Shader&)>());
+
+		// Return the variant for the given defines, building it on first use
+		const Shader &get(const string &defines);
+
+		// Activate the variant for the given defines and time the draw calls until end() is called
+		const Shader &begin(const string &defines);
+		void end();
+
+		// Print how many variants were built and the average GPU time of a batch per variant
+		void printStats() const;
+};
\ No newline at end of file
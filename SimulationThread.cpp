@@ -0,0 +1,71 @@
+#include "SimulationThread.hpp"
+
+#include <algorithm>
+
+
+
+SimulationThread::SimulationThread(double tickRate, int maxTicksPerFrame)
+{
+	clock = FixedTimestep(tickRate, maxTicksPerFrame);
+	epoch = chrono::steady_clock::now();
+	running = false;
+}
+
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+
+void SimulationThread::start(function<void(float)> tick, function<void(double)> update)
+{
+	this->tick = tick;
+	this->update = update;
+	running = true;
+	worker = thread(&SimulationThread::run, this);
+}
+
+
+void SimulationThread::stop()
+{
+	running = false;
+	if (worker.joinable())
+		worker.join();
+}
+
+
+double SimulationThread::now() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - epoch).count();
+}
+
+
+float SimulationThread::alpha(double simulatedTime, double time) const
+{
+	return (float)std::min(std::max((time - simulatedTime) / clock.getTickLength(), 0.0), 1.0);
+}
+
+
+void SimulationThread::run()
+{
+	while (running)
+	{
+		double time = now();
+		int nrTicks = clock.advance(time);
+		for (int i = 0; i < nrTicks; i++)
+		{
+			double tickStartTime = now();
+			tick((float)clock.getTickLength());
+			clock.addTickTime((now() - tickStartTime) * 1000.0);
+		}
+
+		// The time left in the accumulator hasn't been simulated yet
+		double simulatedTime = time - clock.alpha() * clock.getTickLength();
+		update(simulatedTime);
+
+		// Sleep until the next tick is due
+		double wakeTime = simulatedTime + clock.getTickLength();
+		this_thread::sleep_for(chrono::duration<double>(std::max(wakeTime - now(), 0.0)));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "FixedTimestep.hpp"
+
+using namespace std;
+
+
+
+// Runs a fixed-timestep simulation on its own thread, so a slow tick delays the next snapshot of
+// the simulation instead of a frame. Every iteration runs the ticks that are due (see FixedTimestep),
+// then the update, which publishes the results, and sleeps until the next tick is due.
+class SimulationThread
+{
+	private:
+		FixedTimestep clock;
+		chrono::steady_clock::time_point epoch;
+		function<void(float)> tick;       // Advances the simulation by one tick of the given length
+		function<void(double)> update;    // Called after the ticks with the time the simulation reached
+
+		thread worker;
+		atomic<bool> running;
+
+		void run();
+
+	public:
+		SimulationThread(double tickRate = 60.0, int maxTicksPerFrame = 8);
+		~SimulationThread();
+
+		void start(function<void(float)> tick, function<void(double)> update);
+		void stop();   // Waits for the current iteration to finish
+
+		// Seconds since the simulation thread was created, the clock of the simulated times
+		double now() const;
+
+		// Fraction of a tick between the published state and the given time (0..1), for interpolating
+		// between the states before and after the tick
+		float alpha(double simulatedTime, double time) const;
+
+		double getTickLength() const { return clock.getTickLength(); }
+
+		void printStats() const { clock.printStats(); }   // Only after stop
+};
\ No newline at end of file
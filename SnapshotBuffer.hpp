@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+
+using namespace std;
+
+
+
+// Triple buffer handing the latest snapshot from a producer thread to a consumer thread without
+// locks: the producer fills the write slot and publishes it, the consumer switches to the latest
+// published snapshot when it's ready for a new one and reads it while the producer keeps going.
+// Neither thread ever waits for the other, a snapshot the consumer didn't get to is replaced.
+template <class T>
+class SnapshotBuffer
+{
+	private:
+		static const int FRESH = 4;   // Set on the published slot until the consumer takes it
+
+		T slots[3];
+		int writeIdx;              // Producer only
+		int readIdx;               // Consumer only
+		atomic<int> publishedIdx;  // Slot published last, with the FRESH flag
+
+	public:
+		SnapshotBuffer()
+		{
+			writeIdx = 0;
+			publishedIdx = 1;
+			readIdx = 2;
+		}
+
+		// Producer: the slot to fill for the next snapshot
+		T &writeSlot() { return slots[writeIdx]; }
+
+		// Producer: publish the write slot. Returns false if the snapshot published before was never
+		// taken by the consumer; that snapshot becomes the new write slot, so the producer can carry
+		// over what the consumer missed.
+		bool publish()
+		{
+			int previous = publishedIdx.exchange(writeIdx | FRESH);
+			writeIdx = previous & ~FRESH;
+			return ! (previous & FRESH);
+		}
+
+		// Consumer: switch to the latest snapshot, returns false if none was published since the last call
+		bool acquire()
+		{
+			if (! (publishedIdx.load() & FRESH))
+				return false;
+			readIdx = publishedIdx.exchange(readIdx) & ~FRESH;
+			return true;
+		}
+
+		// Consumer: the snapshot taken by the last acquire, it isn't written until the next acquire
+		const T &latest() const { return slots[readIdx]; }
+};
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "TerrainGenerator.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+
+
+// Block ids of the block types used for the strata (blockTypes[id - 1] in main.cpp)
+static const BlockId GRASS = 1;
+static const BlockId STONE_TILES = 4;
+static const BlockId CONCRETE = 5;
+static const BlockId PAVEMENT = 6;
+static const BlockId MOSS = 7;
+static const BlockId METAL_PANEL = 8;
+
+// Terrain shape
+static const float BASE_HEIGHT = 40.0f;
+static const float HEIGHT_RANGE = 32.0f;
+static const float HEIGHT_SCALE = 1.0f / 256.0f;   // Noise frequency per block
+static const int MOSS_HEIGHT = 56;                   // Hill tops are covered with moss instead of grass
+static const int SOIL_DEPTH = 3;
+static const int DEEP_STONE_HEIGHT = 16;             // Concrete below, stone tiles above
+
+// Caves are carved where the cave noise is close to zero, but not right below the surface so the
+// gravity blocks on top stay supported
+static const float CAVE_SCALE = 1.0f / 48.0f;
+static const float CAVE_THRESHOLD = 0.08f;
+static const int CAVE_MIN_DEPTH = SOIL_DEPTH + 3;
+
+
+
+TerrainGenerator::TerrainGenerator(uint32_t seed) : heightNoise(seed), roughnessNoise(seed * 3 + 1), caveNoise(seed * 7 + 2)
+{
+	this->seed = seed;
+}
+
+
+int TerrainGenerator::surfaceHeight(int x, int z) const
+{
+	int height;
+	surfaceHeights(x, z, 1, &height);
+	return height;
+}
+
+
+void TerrainGenerator::surfaceHeights(int x, int z, int count, int *heights) const
+{
+	// Only the first count entries are read, the rest is zeroed so the compiler can see that
+	float hillX[CHUNK_SIZE] = {}, hillZ[CHUNK_SIZE] = {}, roughX[CHUNK_SIZE] = {}, roughZ[CHUNK_SIZE] = {};
+	float hills[CHUNK_SIZE], roughness[CHUNK_SIZE];
+	for (int i = 0; i < count; i++)
+	{
+		hillX[i] = (x + i) * HEIGHT_SCALE;
+		hillZ[i] = z * HEIGHT_SCALE;
+		roughX[i] = (x + i) * HEIGHT_SCALE * 0.5f;
+		roughZ[i] = z * HEIGHT_SCALE * 0.5f;
+	}
+
+	// Large hills, with finer detail where the roughness noise is high
+	heightNoise.fractal2(hillX, hillZ, hills, count, 5);
+	roughnessNoise.noise2(roughX, roughZ, roughness, count);
+	for (int i = 0; i < count; i++)
+	{
+		roughness[i] = 0.5f + 0.5f * roughness[i];
+		heights[i] = std::max((int)floor(BASE_HEIGHT + HEIGHT_RANGE * hills[i] * (0.5f + roughness[i])), 1);
+	}
+}
+
+
+void TerrainGenerator::generate(ivec3 chunkPos, BlockId *blocks) const
+{
+	ivec3 origin = chunkPos * CHUNK_SIZE;
+
+	int surface[CHUNK_SIZE][CHUNK_SIZE];   // [z][x]
+	for (int z = 0; z < CHUNK_SIZE; z++)
+		surfaceHeights(origin.x, origin.z + z, CHUNK_SIZE, surface[z]);
+
+	// Cave candidates of a z slice, the cave noise is evaluated for all of them at once
+	const int SLICE = CHUNK_SIZE * CHUNK_SIZE;
+	int candidates[SLICE];
+	float caveX[SLICE], caveY[SLICE], caveZ[SLICE], cave[SLICE];
+
+	for (int z = 0; z < CHUNK_SIZE; z++)
+	{
+		int nrCandidates = 0;
+		for (int y = 0; y < CHUNK_SIZE; y++)
+		{
+			int worldY = origin.y + y;
+			for (int x = 0; x < CHUNK_SIZE; x++)
+			{
+				int depth = surface[z][x] - worldY;
+				BlockId id;
+
+				if (worldY < 0 || depth < 0)
+					id = AIR;
+				else if (worldY == 0)
+					id = METAL_PANEL;   // Bedrock
+				else if (depth == 0)
+					id = surface[z][x] >= MOSS_HEIGHT ? MOSS : GRASS;
+				else if (depth <= SOIL_DEPTH)
+					id = PAVEMENT;
+				else
+					id = worldY < DEEP_STONE_HEIGHT ? CONCRETE : STONE_TILES;
+
+				int index = blockIndexOf(ivec3(x, y, z));
+				blocks[index] = id;
+
+				// Caves, the noise is only evaluated where they can be
+				if (id != AIR && worldY > 0 && depth >= CAVE_MIN_DEPTH)
+				{
+					candidates[nrCandidates] = index;
+					caveX[nrCandidates] = (origin.x + x) * CAVE_SCALE;
+					caveY[nrCandidates] = worldY * CAVE_SCALE * 1.5f;
+					caveZ[nrCandidates] = (origin.z + z) * CAVE_SCALE;
+					nrCandidates++;
+				}
+			}
+		}
+
+		caveNoise.fractal3(caveX, caveY, caveZ, cave, nrCandidates, 2);
+		for (int i = 0; i < nrCandidates; i++)
+		{
+			if (fabs(cave[i]) < CAVE_THRESHOLD)
+				blocks[candidates[i]] = AIR;
+		}
+	}
+}
+
+
+void TerrainGenerator::generateChunks(const vector<ivec3> &chunkPositions, vector<ChunkBlocks> &chunks, JobSystem &jobs) const
+{
+	chunks.resize(chunkPositions.size());
+
+	// Each chunk is written by exactly one job and only depends on its position, so the result is
+	// the same for any number of threads
+	jobs.parallelFor(0, chunkPositions.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			generate(chunkPositions[i], chunks[i].ids);
+	});
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "World.hpp"
+#include "Noise.hpp"
+#include "JobSystem.hpp"
+
+using namespace std;
+
+
+
+// Seeded procedural terrain: rolling hills from fractal height noise, caves carved by 3D noise and
+// strata of the existing block types. Every chunk only depends on the seed and its position, so chunks
+// can be generated independently on any thread and in any order with the same result.
+class TerrainGenerator
+{
+	private:
+		uint32_t seed;
+		GradientNoise heightNoise;
+		GradientNoise roughnessNoise;
+		GradientNoise caveNoise;
+
+		// Surface heights of count (at most CHUNK_SIZE) consecutive columns starting at x
+		void surfaceHeights(int x, int z, int count, int *heights) const;
+
+	public:
+		TerrainGenerator(uint32_t seed);
+
+		uint32_t getSeed() const { return seed; }
+
+		// Y of the highest solid block of the column (ignoring caves)
+		int surfaceHeight(int x, int z) const;
+
+		// Fill the blocks of the chunk (thread-safe)
+		void generate(ivec3 chunkPos, BlockId *blocks) const;
+
+		// Generate the given chunks in parallel on the job system
+		void generateChunks(const vector<ivec3> &chunkPositions, vector<ChunkBlocks> &chunks, JobSystem &jobs = JobSystem::shared()) const;
+};
\ No newline at end of file
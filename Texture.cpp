@@ -1,8 +1,33 @@
 #include "Texture.hpp"
+#include "AssetPack.hpp"
 
 
 
 Texture::Texture(const char *imgPath)
+{
+	// Load image
+	int width = 0, height = 0;
+	GLubyte *img = NULL;
+	AssetFile file;
+	stbi_set_flip_vertically_on_load(true);
+	if (file.open(imgPath))
+		img = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, 0, STBI_rgb);
+
+	// Generate texture
+	*this = Texture(img, width, height);
+
+	// Free image memory
+	stbi_image_free(img);
+}
+
+
+Texture::Texture(const GLubyte *img, int width, int height)
+	: Texture(&img, 1, width, height)
+{
+}
+
+
+Texture::Texture(const GLubyte *const *levels, int nrLevels, int width, int height)
 {
 	// Create and bind texture
 	glGenTextures(1, &id);
@@ -14,15 +39,23 @@ Texture::Texture(const char *imgPath)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	// Load image and generate texture
-	int width, height;
-	stbi_set_flip_vertically_on_load(true);
-	GLubyte *img = stbi_load(imgPath, &width, &height, 0, STBI_rgb);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// Upload the mip levels (rows of the smaller levels aren't 4-byte aligned)
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int level = 0; level < nrLevels; level++)
+	{
+		int levelWidth = width >> level > 0 ? width >> level : 1;
+		int levelHeight = height >> level > 0 ? height >> level : 1;
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, levelWidth, levelHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, levels[level]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-	// Free image memory and unbind texture
-	stbi_image_free(img);
+	// Generate the missing levels
+	if (nrLevels == 1)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	else
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nrLevels - 1);
+
+	// Unbind texture
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
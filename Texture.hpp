@@ -17,6 +17,13 @@ class Texture
 		// Read the given image and generate and configure the texture
 		Texture(const char *imgPath);
 
+		// Generate and configure the texture from already decoded RGB pixels
+		Texture(const GLubyte *img, int width, int height);
+
+		// Generate and configure the texture from a precomputed mip chain of RGB pixels
+		// (with only one level, the remaining levels are generated on the GPU)
+		Texture(const GLubyte *const *levels, int nrLevels, int width, int height);
+
 		// Bind this texture
 		void bind() const;
 		void bindToTexUnit(GLenum texUnit) const;
@@ -0,0 +1,219 @@
+#include "TextureCache.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#include "stb_image.h"
+#include "AssetPack.hpp"
+#include "Hash.hpp"
+
+
+
+static const uint32_t COOKED_TEXTURE_MAGIC = 0x5845544B;   // "KTEX"
+static const uint32_t COOKED_TEXTURE_VERSION = 1;
+static const uint64_t LEVEL_ALIGNMENT = 16;
+
+
+
+string CookedTexture::cacheDirectory = "./texturecache";
+
+
+CookedTexture::CookedTexture()
+{
+	width = height = 0;
+	nrLevels = 0;
+	sourceSize = 0;
+	fromCache = false;
+}
+
+
+string CookedTexture::cachePath(const string &imgPath)
+{
+	// Images with the same name in different directories get different cache files, the name is only
+	// kept to make the files recognizable
+	string normalized = AssetPack::normalizePath(imgPath);
+	size_t nameStart = normalized.find_last_of('/');
+	string name = (nameStart == string::npos) ? normalized : normalized.substr(nameStart + 1);
+	char pathHash[17];
+	snprintf(pathHash, sizeof(pathHash), "%016llx", (unsigned long long)hashString(normalized));
+	return cacheDirectory + "/" + name + "." + pathHash + ".tex";
+}
+
+
+bool CookedTexture::load(const string &imgPath, bool useCache)
+{
+	uint64_t sourceHash = 0;
+
+	AssetFile source;
+	if (! source.open(imgPath))
+		return false;
+	sourceSize = source.size();
+
+	if (useCache)
+	{
+		sourceHash = source.contentHash();
+		if (loadFromCache(cachePath(imgPath), sourceHash))
+		{
+			fromCache = true;
+			return true;
+		}
+	}
+
+	// Decode the image
+	int channels;
+	stbi_set_flip_vertically_on_load_thread(true);
+	GLubyte *img = stbi_load_from_memory(source.data(), (int)source.size(), &width, &height, &channels, STBI_rgb);
+	if (! img)
+		return false;
+
+	// Without the cache, the mip chain is generated on the GPU
+	nrLevels = 1;
+	if (useCache)
+	{
+		while (nrLevels < MAX_MIP_LEVELS && ((width >> nrLevels) > 0 || (height >> nrLevels) > 0))
+			nrLevels++;
+	}
+
+	// Lay out all levels in one buffer
+	size_t offsets[MAX_MIP_LEVELS];
+	size_t totalSize = 0;
+	for (int level = 0; level < nrLevels; level++)
+	{
+		int levelWidth = std::max(1, width >> level);
+		int levelHeight = std::max(1, height >> level);
+		offsets[level] = totalSize;
+		totalSize += (size_t)levelWidth * levelHeight * 3;
+	}
+	pixels.resize(totalSize);
+	memcpy(pixels.data(), img, (size_t)width * height * 3);
+	stbi_image_free(img);
+
+	// Build the mip chain with a 2x2 box filter (edge texels are repeated for odd sizes)
+	for (int level = 1; level < nrLevels; level++)
+	{
+		int srcWidth = std::max(1, width >> (level - 1));
+		int srcHeight = std::max(1, height >> (level - 1));
+		int dstWidth = std::max(1, width >> level);
+		int dstHeight = std::max(1, height >> level);
+		const GLubyte *src = &pixels[offsets[level - 1]];
+		GLubyte *dst = &pixels[offsets[level]];
+
+		for (int y = 0; y < dstHeight; y++)
+		{
+			int y0 = std::min(2 * y, srcHeight - 1);
+			int y1 = std::min(2 * y + 1, srcHeight - 1);
+
+			for (int x = 0; x < dstWidth; x++)
+			{
+				int x0 = std::min(2 * x, srcWidth - 1);
+				int x1 = std::min(2 * x + 1, srcWidth - 1);
+
+				for (int c = 0; c < 3; c++)
+				{
+					int sum = src[(y0 * srcWidth + x0) * 3 + c] + src[(y0 * srcWidth + x1) * 3 + c] +
+						src[(y1 * srcWidth + x0) * 3 + c] + src[(y1 * srcWidth + x1) * 3 + c];
+					dst[(y * dstWidth + x) * 3 + c] = (GLubyte)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	for (int level = 0; level < nrLevels; level++)
+		levels[level] = &pixels[offsets[level]];
+	fromCache = false;
+
+	if (useCache && ! writeToCache(cachePath(imgPath), sourceHash))
+		std::cerr << "ERROR::TEXTURE::CACHE_COULD_NOT_BE_WRITTEN: " << imgPath << endl;
+
+	return true;
+}
+
+
+bool CookedTexture::loadFromCache(const string &cachePath, uint64_t sourceHash)
+{
+	if (sourceHash == 0 || ! file.open(cachePath))
+		return false;
+
+	// Validate the header and the level table before handing out pointers into the file
+	const CookedTextureHeader *header = (const CookedTextureHeader*)file.data();
+	bool valid = file.size() >= sizeof(CookedTextureHeader) &&
+		header->magic == COOKED_TEXTURE_MAGIC &&
+		header->version == COOKED_TEXTURE_VERSION &&
+		header->sourceHash == sourceHash &&
+		header->format == GL_RGB8 &&
+		header->nrLevels >= 1 && header->nrLevels <= MAX_MIP_LEVELS;
+
+	for (uint32_t level = 0; valid && level < header->nrLevels; level++)
+	{
+		uint64_t expectedSize = (uint64_t)std::max(1u, header->width >> level) * std::max(1u, header->height >> level) * 3;
+		valid = header->levelSizes[level] == expectedSize &&
+			header->levelOffsets[level] + header->levelSizes[level] <= file.size();
+	}
+
+	if (! valid)
+	{
+		file.close();
+		return false;
+	}
+
+	width = header->width;
+	height = header->height;
+	nrLevels = header->nrLevels;
+	for (int level = 0; level < nrLevels; level++)
+		levels[level] = file.data() + header->levelOffsets[level];
+
+	return true;
+}
+
+
+bool CookedTexture::writeToCache(const string &cachePath, uint64_t sourceHash) const
+{
+	if (sourceHash == 0)
+		return false;
+
+	makeDirectory(cacheDirectory);
+
+	CookedTextureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = COOKED_TEXTURE_MAGIC;
+	header.version = COOKED_TEXTURE_VERSION;
+	header.sourceHash = sourceHash;
+	header.format = GL_RGB8;
+	header.width = width;
+	header.height = height;
+	header.nrLevels = nrLevels;
+
+	// Levels start on aligned offsets after the header
+	uint64_t offset = sizeof(header);
+	for (int level = 0; level < nrLevels; level++)
+	{
+		offset = (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+		header.levelOffsets[level] = offset;
+		header.levelSizes[level] = (uint64_t)std::max(1, width >> level) * std::max(1, height >> level) * 3;
+		offset += header.levelSizes[level];
+	}
+
+	// Write to a temporary file first, so a crash never leaves a truncated cache file behind
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (! out)
+			return false;
+
+		out.write((const char*)&header, sizeof(header));
+		for (int level = 0; level < nrLevels; level++)
+		{
+			static const char padding[LEVEL_ALIGNMENT] = {};
+			out.write(padding, header.levelOffsets[level] - out.tellp());
+			out.write((const char*)levels[level], header.levelSizes[level]);
+		}
+
+		if (! out)
+			return false;
+	}
+
+	return replaceFile(tempPath, cachePath);
+}
\ No newline at end of file
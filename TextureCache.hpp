@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "FileSystem.hpp"
+
+using namespace std;
+
+
+
+// Cooked textures are stored in a binary cache file per image: a header followed by the raw RGB
+// pixels of the complete mip chain. A cache file is only used while the hash of the source image
+// still matches, so edited images are cooked again automatically.
+const int MAX_MIP_LEVELS = 16;
+
+struct CookedTextureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;   // Hash of the source image file
+	uint32_t format;       // OpenGL internal format of the levels (only GL_RGB8 so far)
+	uint32_t width;        // Size of level 0
+	uint32_t height;
+	uint32_t nrLevels;
+	uint64_t levelOffsets[MAX_MIP_LEVELS];   // Offset of each level from the start of the file in bytes
+	uint64_t levelSizes[MAX_MIP_LEVELS];     // Size of each level in bytes
+};
+
+
+
+// The mip levels of one image, either mapped from its cache file or decoded and cooked in memory
+class CookedTexture
+{
+	private:
+		MappedFile file;          // Cache file, if the texture was loaded from the cache
+		vector<GLubyte> pixels;   // All levels, if the texture was decoded in this run
+
+		static string cacheDirectory;
+
+		bool loadFromCache(const string &cachePath, uint64_t sourceHash);
+		bool writeToCache(const string &cachePath, uint64_t sourceHash) const;
+
+	public:
+		int width, height;   // Size of level 0
+		int nrLevels;
+		const GLubyte *levels[MAX_MIP_LEVELS];
+
+		size_t sourceSize;   // Size of the source image file in bytes
+		bool fromCache;      // true if the levels are read from the cache file without decoding
+
+		CookedTexture();
+
+		// Get the mip chain of the given image. With the cache enabled, an up-to-date cache file is
+		// mapped, otherwise the image is decoded, its mip chain built and the cache file (re)written.
+		// With the cache disabled, only level 0 is decoded and the mip chain is left to the GPU.
+		bool load(const string &imgPath, bool useCache);
+
+		// Bytes of the levels held on the heap and mapped from the cache file
+		size_t heapSize() const { return pixels.capacity(); }
+		size_t mappedSize() const { return file.size(); }
+
+		// Path of the cache file for the given image, derived from its whole path
+		static string cachePath(const string &imgPath);
+
+		// Directory of the cache files, ./texturecache by default
+		static void setCacheDirectory(const string &directory) { cacheDirectory = directory; }
+		static const string &getCacheDirectory() { return cacheDirectory; }
+};
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "TextureLoader.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <algorithm>
+
+#include "Profiling.hpp"
+
+
+
+static double elapsedMs(chrono::steady_clock::time_point since)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - since).count();
+}
+
+
+bool TextureLoader::cacheEnabled = true;
+
+
+TextureLoader::TextureLoader()
+{
+	nrThreadsUsed = 0;
+	totalTime = 0.0;
+}
+
+
+void TextureLoader::add(const char *imgPath)
+{
+	// Deduplicate by path
+	if (assetIndices.count(imgPath))
+		return;
+
+	Asset asset;
+	asset.path = imgPath;
+	asset.width = asset.height = 0;
+	asset.fileSize = 0;
+	asset.fromCache = false;
+	asset.decodeTime = asset.uploadTime = 0.0;
+
+	assetIndices[imgPath] = assets.size();
+	assets.push_back(std::move(asset));
+}
+
+
+void TextureLoader::load(JobSystem &jobs)
+{
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+	nrThreadsUsed = std::min((unsigned int)jobs.getNrThreads(), (unsigned int)assets.size());
+
+	queue<size_t> decodedAssets;   // Decoded but not yet uploaded
+	mutex decodedMutex;
+	condition_variable decodedCondition;
+
+	// Decode every image in a job of its own
+	JobCounter decoding;
+	for (size_t idx = 0; idx < assets.size(); idx++)
+	{
+		jobs.spawn([&, idx]()
+		{
+			Asset &asset = assets[idx];
+			chrono::steady_clock::time_point decodeStart = chrono::steady_clock::now();
+
+			asset.image.reset(new CookedTexture());
+			if (asset.image->load(asset.path, cacheEnabled))
+			{
+				asset.fileSize = asset.image->sourceSize;
+				asset.width = asset.image->width;
+				asset.height = asset.image->height;
+				asset.fromCache = asset.image->fromCache;
+			}
+			else
+			{
+				asset.image.reset();
+			}
+			asset.decodeTime = elapsedMs(decodeStart);
+
+			lock_guard<mutex> lock(decodedMutex);
+			decodedAssets.push(idx);
+			decodedCondition.notify_one();
+		}, &decoding);
+	}
+
+	// Upload every image as soon as it is decoded, decode one while none is ready. Once there is no job
+	// left to take, the missing images are being decoded on other threads.
+	for (size_t nrUploaded = 0; nrUploaded < assets.size(); nrUploaded++)
+	{
+		size_t idx;
+		{
+			unique_lock<mutex> lock(decodedMutex);
+			while (decodedAssets.empty())
+			{
+				lock.unlock();
+				bool ranJob = jobs.tryRunJob();
+				lock.lock();
+				if (! ranJob)
+					decodedCondition.wait(lock, [&]() { return ! decodedAssets.empty(); });
+			}
+			idx = decodedAssets.front();
+			decodedAssets.pop();
+		}
+
+		Asset &asset = assets[idx];
+		if (! asset.image)
+		{
+			std::cerr << "ERROR::TEXTURE::FILE_COULD_NOT_BE_READ: " << asset.path << endl;
+			continue;
+		}
+
+		chrono::steady_clock::time_point uploadStart = chrono::steady_clock::now();
+		asset.texture = Texture(asset.image->levels, asset.image->nrLevels, asset.width, asset.height);
+		asset.uploadTime = elapsedMs(uploadStart);
+
+		// Free the pixels or unmap the cache file
+		asset.image.reset();
+	}
+
+	jobs.waitFor(decoding);
+
+	totalTime = elapsedMs(startTime);
+}
+
+
+Texture TextureLoader::get(const char *imgPath) const
+{
+	map<string, size_t>::const_iterator it = assetIndices.find(imgPath);
+	if (it == assetIndices.end())
+	{
+		std::cerr << "ERROR::TEXTURE::NOT_LOADED: " << imgPath << endl;
+		return Texture();
+	}
+	return assets[it->second].texture;
+}
+
+
+void TextureLoader::printTimings() const
+{
+	double totalDecodeTime = 0.0, totalUploadTime = 0.0;
+	size_t nrFromCache = 0;
+
+	for (const Asset &asset : assets)
+	{
+		std::cout << "  " << asset.path << " (" << asset.fileSize / 1024 << " KB, " << asset.width << "x"
+			<< asset.height << "): " << (asset.fromCache ? "cache " : cacheEnabled ? "decode+cook " : "decode ")
+			<< asset.decodeTime << " ms, upload " << asset.uploadTime << " ms" << endl;
+		if (asset.fromCache)
+			nrFromCache++;
+		totalDecodeTime += asset.decodeTime;
+		totalUploadTime += asset.uploadTime;
+	}
+
+	std::cout << "Texture loading took " << totalTime << " ms for " << assets.size() << " unique images on "
+		<< nrThreadsUsed << " threads (decode " << totalDecodeTime << " ms, upload " << totalUploadTime
+		<< " ms if done serially), " << nrFromCache << " from the texture cache, peak memory "
+		<< peakMemoryUsage() / (1024 * 1024) << " MB" << endl;
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Texture.hpp"
+#include "TextureCache.hpp"
+#include "JobSystem.hpp"
+
+using namespace std;
+
+
+
+// The textures of the game's blocks, lamps and fluids (defined in main.cpp, indexed by the block types)
+const int NR_TEXTURES = 14;
+extern const char *texturePaths[NR_TEXTURES];
+
+
+
+// Loads a set of textures at once. The images are decoded in parallel on the job system while the
+// main thread (which owns the OpenGL context) uploads every image as soon as it is decoded.
+// Images requested more than once are only decoded and uploaded once. Images with an up-to-date
+// entry in the texture cache aren't decoded at all, their mip levels are uploaded straight from
+// the memory mapped cache file.
+class TextureLoader
+{
+	private:
+		struct Asset {
+			string path;
+			Texture texture;
+
+			// Mip levels (owned by the loader until they are uploaded)
+			unique_ptr<CookedTexture> image;
+
+			// Statistics
+			long long fileSize;   // in bytes
+			int width, height;
+			bool fromCache;
+			double decodeTime;    // in milliseconds (on a worker thread), includes cooking
+			double uploadTime;    // in milliseconds (on the main thread)
+		};
+
+		vector<Asset> assets;
+		map<string, size_t> assetIndices;   // Path -> index in assets
+
+		unsigned int nrThreadsUsed;
+		double totalTime;   // Wall-clock time of load() in milliseconds
+
+		// Whether the texture cache is used (if not, images are always decoded with stb_image)
+		static bool cacheEnabled;
+
+	public:
+		// Switch the texture cache on or off for the loads started afterwards (on by default)
+		static void setCacheEnabled(bool enabled) { cacheEnabled = enabled; }
+		static bool isCacheEnabled() { return cacheEnabled; }
+
+		TextureLoader();
+
+		// Queue an image for loading
+		void add(const char *imgPath);
+
+		// Decode all queued images on the job system and upload them. Must be called on the thread
+		// owning the OpenGL context, which decodes images as well while there is nothing to upload.
+		void load(JobSystem &jobs = JobSystem::shared());
+
+		// Texture of a loaded image
+		Texture get(const char *imgPath) const;
+
+		// Print the time spent on every asset and in total
+		void printTimings() const;
+};
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "TickScheduler.hpp"
+
+#include <algorithm>
+
+
+
+TickScheduler::TickScheduler()
+{
+	currentTick = 0;
+	nrPending = 0;
+}
+
+
+void TickScheduler::insert(const Entry &entry)
+{
+	// The level is chosen by the distance to the due tick, the slot by the due tick itself. A slot of level
+	// n is moved down when the tick reaches its start, which is never before the due tick of its entries.
+	const uint64_t horizon = (1ull << (SLOT_BITS * NR_LEVELS)) - 1;
+	uint64_t due = std::min(entry.due, currentTick + horizon);
+	uint64_t distance = due - currentTick;
+	int level = 0;
+	while (level < NR_LEVELS - 1 && distance >= (1ull << (SLOT_BITS * (level + 1))))
+		level++;
+	slots[level][(due >> (SLOT_BITS * level)) & (NR_SLOTS - 1)].push_back(entry);
+}
+
+
+void TickScheduler::schedule(ivec3 pos, uint8_t type, uint64_t delay)
+{
+	Entry entry;
+	entry.tick.pos = pos;
+	entry.tick.type = type;
+	entry.due = currentTick + std::max(delay, (uint64_t)1);
+	insert(entry);
+	nrPending++;
+}
+
+
+void TickScheduler::advance(vector<ScheduledTick> &due)
+{
+	currentTick++;
+
+	// Each time a level has turned once, the next slot of the level above is spread over the levels below
+	for (int level = 1; level < NR_LEVELS; level++)
+	{
+		if ((currentTick & ((1ull << (SLOT_BITS * level)) - 1)) != 0)
+			break;
+
+		vector<Entry> entries;
+		entries.swap(slots[level][(currentTick >> (SLOT_BITS * level)) & (NR_SLOTS - 1)]);
+		for (const Entry &entry : entries)
+			insert(entry);
+	}
+
+	vector<Entry> &slot = slots[0][currentTick & (NR_SLOTS - 1)];
+	for (const Entry &entry : slot)
+		due.push_back(entry.tick);
+	nrPending -= slot.size();
+	slot.clear();
+}
\ No newline at end of file
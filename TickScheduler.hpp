@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "World.hpp"
+
+using namespace std;
+
+
+
+// A block update due in a later simulation tick (see TickScheduler)
+struct ScheduledTick {
+	ivec3 pos;
+	uint8_t type;   // Meaning is up to the caller
+};
+
+
+// Schedules block updates for later simulation ticks in a hierarchical timing wheel: 4 levels of 64
+// slots, where a slot of level n covers 64^n ticks. Ticks are inserted into the slot of the coarsest
+// level they fit in and moved down a level whenever the wheel below has turned once, so scheduling is
+// constant time and advancing costs in proportion to the ticks that are due, however many are pending.
+// Delays beyond 64^4 ticks (77 hours at 60 ticks per second) are parked in the top level until they fit.
+class TickScheduler
+{
+	private:
+		static const int SLOT_BITS = 6;
+		static const int NR_SLOTS = 1 << SLOT_BITS;
+		static const int NR_LEVELS = 4;
+
+		struct Entry {
+			ScheduledTick tick;
+			uint64_t due;
+		};
+
+		vector<Entry> slots[NR_LEVELS][NR_SLOTS];
+		uint64_t currentTick;
+		size_t nrPending;
+
+		void insert(const Entry &entry);
+
+	public:
+		TickScheduler();
+
+		// Run the update delay ticks after the current one (at least 1)
+		void schedule(ivec3 pos, uint8_t type, uint64_t delay);
+
+		// Move on to the next tick and append the updates due in it
+		void advance(vector<ScheduledTick> &due);
+
+		uint64_t getCurrentTick() const { return currentTick; }
+		size_t getNrPending() const { return nrPending; }
+};
\ No newline at end of file
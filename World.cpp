@@ -0,0 +1,432 @@
+#include "World.hpp"
+#include "ChunkCodec.hpp"
+#include "Hash.hpp"
+
+#include <cstring>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+
+
+
+// FNV-1a over 64 bit words, a chunk is hashed in an eighth of the steps of hashBytes
+static uint64_t hashChunkBlocks(const ChunkBlocks &blocks)
+{
+	uint64_t words[CHUNK_VOLUME / 8];
+	memcpy(words, blocks.ids, sizeof(words));
+
+	uint64_t hash = HASH_SEED;
+	for (uint64_t word : words)
+	{
+		hash ^= word;
+		hash *= HASH_PRIME;
+	}
+	return hash;
+}
+
+
+ChunkPool::ChunkPool()
+{
+	purgeSize = 1024;
+	nrShared = 0;
+}
+
+
+shared_ptr<ChunkBlocks> ChunkPool::intern(const shared_ptr<ChunkBlocks> &blocks)
+{
+	uint64_t hash = hashChunkBlocks(*blocks);
+
+	lock_guard<mutex> lock(poolMutex);
+
+	// The blocks are compared as well, so a hash collision can't make chunks share storage
+	weak_ptr<ChunkBlocks> &entry = entries[hash];
+	shared_ptr<ChunkBlocks> pooled = entry.lock();
+	if (pooled && memcmp(pooled->ids, blocks->ids, CHUNK_VOLUME) == 0)
+	{
+		if (pooled != blocks)
+			nrShared++;
+		return pooled;
+	}
+	entry = blocks;
+
+	// Drop the entries of storage that was freed once the pool has doubled
+	if (entries.size() >= purgeSize)
+	{
+		for (auto it = entries.begin(); it != entries.end(); )
+		{
+			if (it->second.expired())
+				it = entries.erase(it);
+			else
+				++it;
+		}
+		purgeSize = std::max(entries.size() * 2, (size_t)1024);
+	}
+
+	return blocks;
+}
+
+
+
+void ChunkSummary::compute(const BlockId *blocks)
+{
+	// Four partial histograms, so runs of the same block don't serialize on one counter
+	uint16_t partial[4][256];
+	memset(partial, 0, sizeof(partial));
+	for (int y = 0; y < CHUNK_SIZE; y++)
+	{
+		// The layers are contiguous in the storage (see blockIndexOf)
+		const BlockId *layer = blocks + y * CHUNK_SIZE * CHUNK_SIZE;
+		int airBefore = partial[0][AIR] + partial[1][AIR] + partial[2][AIR] + partial[3][AIR];
+		for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i += 4)
+		{
+			partial[0][layer[i]]++;
+			partial[1][layer[i + 1]]++;
+			partial[2][layer[i + 2]]++;
+			partial[3][layer[i + 3]]++;
+		}
+		int air = partial[0][AIR] + partial[1][AIR] + partial[2][AIR] + partial[3][AIR];
+		layerCounts[y] = (uint16_t)(CHUNK_SIZE * CHUNK_SIZE - (air - airBefore));
+	}
+
+	for (int id = 0; id < 256; id++)
+		counts[id] = (uint16_t)(partial[0][id] + partial[1][id] + partial[2][id] + partial[3][id]);
+
+	memset(occupancy, 0, sizeof(occupancy));
+	for (int i = 0; i < CHUNK_VOLUME; i++)
+		occupancy[brickOf(i)] |= (uint64_t)(blocks[i] != AIR) << brickBitOf(i);
+	occupiedBricks = 0;
+	for (int brick = 0; brick < 64; brick++)
+		occupiedBricks |= (uint64_t)(occupancy[brick] != 0) << brick;
+}
+
+
+void ChunkSummary::update(int index, BlockId oldId, BlockId newId)
+{
+	int layer = index >> 8;
+	counts[oldId]--;
+	counts[newId]++;
+	if (oldId == AIR)
+		layerCounts[layer]++;
+	else if (newId == AIR)
+		layerCounts[layer]--;
+
+	if ((oldId == AIR) != (newId == AIR))
+	{
+		int brick = brickOf(index);
+		occupancy[brick] ^= (uint64_t)1 << brickBitOf(index);
+		uint64_t brickBit = (uint64_t)1 << brick;
+		occupiedBricks = occupancy[brick] != 0 ? occupiedBricks | brickBit : occupiedBricks & ~brickBit;
+	}
+}
+
+
+int ChunkSummary::minY() const
+{
+	for (int y = 0; y < CHUNK_SIZE; y++)
+	{
+		if (layerCounts[y] != 0)
+			return y;
+	}
+	return -1;
+}
+
+
+int ChunkSummary::maxY() const
+{
+	for (int y = CHUNK_SIZE - 1; y >= 0; y--)
+	{
+		if (layerCounts[y] != 0)
+			return y;
+	}
+	return -1;
+}
+
+
+
+Chunk::Chunk()
+{
+	data = make_shared<ChunkBlocks>();
+	for (int i = 0; i < CHUNK_VOLUME; i++)
+		data->ids[i] = AIR;
+	accessStats = NULL;
+	pooled = false;
+	summaryValid = false;
+	superchunk = NULL;
+	superchunkBit = 0;
+	modified = false;
+	lastAccess = 0.0;
+}
+
+
+void Chunk::detach()
+{
+	// Only the thread owning the chunk creates new references to its storage, so a use count
+	// of 1 can't be outdated (a higher one may be, which merely costs an unneeded copy). Pooled
+	// storage may be handed out again at any time, so it's always copied.
+	resident();
+	if (pooled || data.use_count() > 1)
+	{
+		data = make_shared<ChunkBlocks>(*data);
+		pooled = false;
+	}
+}
+
+
+void Chunk::set(int index, BlockId id)
+{
+	if (resident().ids[index] == id)
+		return;
+
+	detach();
+	if (summaryValid)
+	{
+		summaryData.update(index, data->ids[index], id);
+		publishOccupancy();
+	}
+	data->ids[index] = id;
+	modified = true;
+}
+
+
+void Chunk::restore(const shared_ptr<const ChunkBlocks> &snapshot)
+{
+	// The storage is only written after detach, which copies it while the snapshot still exists
+	data = const_pointer_cast<ChunkBlocks>(snapshot);
+	packed.clear();
+	pooled = false;
+	summaryValid = false;
+	publishOccupancy();
+}
+
+
+void Chunk::share(ChunkPool &pool)
+{
+	if (pooled)
+		return;
+
+	resident();
+	data = pool.intern(data);
+	pooled = true;
+}
+
+
+BlockId *Chunk::mutableBlocks()
+{
+	detach();
+	summaryValid = false;
+	publishOccupancy();
+	return data->ids;
+}
+
+
+bool Chunk::compress(ChunkAccessStats &stats)
+{
+	if (! data || data.use_count() > 1)
+		return false;
+
+	// The summary stays valid, so summary queries don't decompress the chunk
+	summary();
+	encodeChunk(data->ids, packed);
+	packed.shrink_to_fit();
+	data.reset();
+	pooled = false;
+	accessStats = &stats;
+	return true;
+}
+
+
+void Chunk::decompress() const
+{
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+	data = make_shared<ChunkBlocks>();
+	decodeChunk(packed.data(), packed.size(), data->ids);
+	packed.clear();
+	packed.shrink_to_fit();
+
+	if (accessStats)
+	{
+		accessStats->nrMisses++;
+		accessStats->decompressTimes.add(chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count());
+		lastAccess = accessStats->time;
+	}
+}
+
+
+const ChunkSummary &Chunk::summary() const
+{
+	if (! summaryValid)
+	{
+		summaryData.compute(resident().ids);
+		summaryValid = true;
+		publishOccupancy();
+	}
+	return summaryData;
+}
+
+
+void Chunk::setSuperchunk(SuperchunkOccupancy *superchunk, int bit)
+{
+	if (this->superchunk)
+		this->superchunk->occupied.fetch_and(~superchunkBit);
+
+	this->superchunk = superchunk;
+	superchunkBit = (uint64_t)1 << bit;
+	publishOccupancy();
+}
+
+
+void Chunk::publishOccupancy() const
+{
+	if (! superchunk)
+		return;
+
+	// The word is shared with the other chunks of the superchunk, so it's only written on changes
+	bool occupied = ! summaryValid || ! summaryData.isEmpty();
+	if (((superchunk->occupied.load(memory_order_relaxed) & superchunkBit) != 0) != occupied)
+	{
+		if (occupied)
+			superchunk->occupied.fetch_or(superchunkBit);
+		else
+			superchunk->occupied.fetch_and(~superchunkBit);
+	}
+}
+
+
+
+World::World()
+{
+	access.time = 0.0;
+	access.nrHits = 0;
+	access.nrMisses = 0;
+}
+
+
+BlockId World::getBlock(ivec3 pos) const
+{
+	const Chunk *chunk = getChunk(chunkPosOf(pos));
+	return chunk ? chunk->get(blockIndexOf(pos)) : AIR;
+}
+
+
+void World::setBlock(ivec3 pos, BlockId id)
+{
+	// Don't create chunks just to store air
+	Chunk *chunk = (id == AIR) ? getChunk(chunkPosOf(pos)) : &getOrCreateChunk(chunkPosOf(pos));
+	if (! chunk)
+		return;
+
+	chunk->set(blockIndexOf(pos), id);
+}
+
+
+Chunk *World::getChunk(ivec3 chunkPos)
+{
+	return const_cast<Chunk*>(static_cast<const World*>(this)->getChunk(chunkPos));
+}
+
+
+const Chunk *World::getChunk(ivec3 chunkPos) const
+{
+	ChunkMap::const_iterator it = chunks.find(chunkPos);
+	if (it == chunks.end())
+		return NULL;
+
+	const Chunk *chunk = it->second.get();
+	if (! chunk->isCompressed())
+		access.nrHits++;
+	chunk->lastAccess = access.time;
+	return chunk;
+}
+
+
+Chunk &World::getOrCreateChunk(ivec3 chunkPos)
+{
+	unique_ptr<Chunk> &chunk = chunks[chunkPos];
+	if (! chunk)
+	{
+		chunk.reset(new Chunk());
+		addToSuperchunk(chunkPos, *chunk);
+	}
+	return *chunk;
+}
+
+
+void World::setChunk(ivec3 chunkPos, unique_ptr<Chunk> chunk)
+{
+	chunk->share(pool);
+	unique_ptr<Chunk> &entry = chunks[chunkPos];
+	if (entry)
+		removeFromSuperchunk(chunkPos, *entry);
+	entry = std::move(chunk);
+	addToSuperchunk(chunkPos, *entry);
+}
+
+
+void World::removeChunk(ivec3 chunkPos)
+{
+	ChunkMap::iterator it = chunks.find(chunkPos);
+	if (it == chunks.end())
+		return;
+
+	removeFromSuperchunk(chunkPos, *it->second);
+	chunks.erase(it);
+}
+
+
+void World::clear()
+{
+	chunks.clear();
+	superchunks.clear();
+}
+
+
+const SuperchunkOccupancy *World::getSuperchunk(ivec3 superchunkPos) const
+{
+	SuperchunkMap::const_iterator it = superchunks.find(superchunkPos);
+	return it != superchunks.end() ? &it->second : NULL;
+}
+
+
+void World::addToSuperchunk(ivec3 chunkPos, Chunk &chunk)
+{
+	SuperchunkOccupancy &superchunk = superchunks[superchunkPosOf(chunkPos)];
+	int bit = superchunkBitOf(chunkPos);
+	superchunk.present |= (uint64_t)1 << bit;
+	chunk.setSuperchunk(&superchunk, bit);
+}
+
+
+void World::removeFromSuperchunk(ivec3 chunkPos, Chunk &chunk)
+{
+	SuperchunkMap::iterator it = superchunks.find(superchunkPosOf(chunkPos));
+	chunk.setSuperchunk(NULL, 0);
+	it->second.present &= ~((uint64_t)1 << superchunkBitOf(chunkPos));
+	if (it->second.present == 0)
+		superchunks.erase(it);
+}
+
+
+void World::snapshotModifiedChunks(vector<ChunkSnapshot> &snapshots)
+{
+	for (const ChunkMap::value_type &entry : chunks)
+	{
+		if (entry.second->modified)
+		{
+			snapshots.push_back({ entry.first, entry.second->snapshot() });
+			entry.second->modified = false;
+		}
+	}
+}
+
+
+size_t World::nrStorageBlocks() const
+{
+	unordered_set<const ChunkBlocks*> storage;
+	for (const ChunkMap::value_type &entry : chunks)
+	{
+		if (! entry.second->isCompressed())
+			storage.insert(entry.second->storage());
+	}
+	return storage.size();
+}
\ No newline at end of file
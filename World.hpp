@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Profiling.hpp"
+
+using namespace std;
+using namespace glm;
+
+
+
+// Content of a block cell: 0 is air, the following ids are the block types and after them the lamp types
+typedef uint8_t BlockId;
+const BlockId AIR = 0;
+
+// The world is divided into cubic chunks of CHUNK_SIZE^3 blocks
+const int CHUNK_SIZE = 16;
+const int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// Chunk containing the block at the given position
+inline ivec3 chunkPosOf(ivec3 blockPos)
+{
+	return ivec3(blockPos.x >> 4, blockPos.y >> 4, blockPos.z >> 4);
+}
+
+// Index of the block within its chunk (x varies fastest, then z, then y)
+inline int blockIndexOf(ivec3 blockPos)
+{
+	return (blockPos.x & 15) + (blockPos.z & 15) * CHUNK_SIZE + (blockPos.y & 15) * CHUNK_SIZE * CHUNK_SIZE;
+}
+
+// World position of the block with the given index in the given chunk
+inline ivec3 blockPosOf(ivec3 chunkPos, int index)
+{
+	return chunkPos * CHUNK_SIZE + ivec3(index & 15, index >> 8, (index >> 4) & 15);
+}
+
+// Block containing the given point (blocks are unit cubes centered on their position)
+inline ivec3 cellOf(vec3 pos)
+{
+	return ivec3(glm::floor(pos + 0.5f));
+}
+
+// The occupancy pyramid has levels of 1, 4, 16 and 64 blocks. A chunk consists of 4^3 bricks of 4^3 blocks,
+// a superchunk of 4^3 chunks (unrelated to the regions of 8^3 chunks in the region files). Bricks, the
+// blocks in a brick and the chunks in a superchunk are numbered like the blocks in a chunk: x varies
+// fastest, then z, then y.
+const int BRICK_SIZE = 4;
+const int SUPERCHUNK_CHUNKS = 4;
+
+// Brick of the block with the given index within its chunk, and the block's bit within the brick
+inline int brickOf(int index)
+{
+	return ((index >> 2) & 3) | ((index >> 4) & 12) | ((index >> 6) & 48);
+}
+
+inline int brickBitOf(int index)
+{
+	return (index & 3) | ((index >> 2) & 12) | ((index >> 4) & 48);
+}
+
+// Superchunk containing the given chunk, and the chunk's bit within the superchunk
+inline ivec3 superchunkPosOf(ivec3 chunkPos)
+{
+	return ivec3(chunkPos.x >> 2, chunkPos.y >> 2, chunkPos.z >> 2);
+}
+
+inline int superchunkBitOf(ivec3 chunkPos)
+{
+	return (chunkPos.x & 3) | ((chunkPos.z & 3) << 2) | ((chunkPos.y & 3) << 4);
+}
+
+
+
+// Block storage of a chunk. The storage is shared between a chunk and its snapshots and
+// copied when the chunk is modified while a snapshot of it still exists (copy-on-write).
+struct ChunkBlocks {
+	BlockId ids[CHUNK_VOLUME];
+};
+
+// Content-addressed pool of chunk storage: chunks with identical blocks (solid underground chunks,
+// flat layers) share one immutable storage block. The pool only holds weak references, so storage
+// no chunk uses anymore is freed. Thread-safe.
+class ChunkPool
+{
+	private:
+		mutex poolMutex;
+		unordered_map<uint64_t, weak_ptr<ChunkBlocks>> entries;
+		size_t purgeSize;   // Number of entries at which the expired ones are dropped
+		size_t nrShared;    // Chunks that took over the storage of an identical chunk
+
+	public:
+		ChunkPool();
+
+		// The pooled storage with the same blocks, or the given storage after adding it to the pool
+		shared_ptr<ChunkBlocks> intern(const shared_ptr<ChunkBlocks> &blocks);
+
+		size_t getNrShared() const { return nrShared; }
+};
+
+// Summary of the blocks of a chunk, so whole chunks can be skipped (all air) or shortcut (solid, only
+// some block types or layers occupied) without visiting their blocks
+struct ChunkSummary {
+	uint16_t counts[256];               // Number of blocks of each id, counts[AIR] is the number of air blocks
+	uint16_t layerCounts[CHUNK_SIZE];   // Number of non-air blocks in each layer (y within the chunk)
+
+	// Levels 1 and 4 of the occupancy pyramid: a bit per non-air block, one word per brick (see brickOf and
+	// brickBitOf), and a bit per brick with any non-air block
+	uint64_t occupancy[64];
+	uint64_t occupiedBricks;
+
+	// Count the blocks from scratch
+	void compute(const BlockId *blocks);
+
+	// Account for the block with the given index changing from oldId to newId
+	void update(int index, BlockId oldId, BlockId newId);
+
+	int nrNonAir() const { return CHUNK_VOLUME - counts[AIR]; }
+	bool isEmpty() const { return counts[AIR] == CHUNK_VOLUME; }
+	bool isFull() const { return counts[AIR] == 0; }        // No air at all
+	bool contains(BlockId id) const { return counts[id] != 0; }
+	bool isOccupied(int index) const { return (occupancy[brickOf(index)] >> brickBitOf(index) & 1) != 0; }
+	bool isBrickOccupied(int brick) const { return (occupiedBricks >> brick & 1) != 0; }
+	bool isUniform(BlockId id) const { return counts[id] == CHUNK_VOLUME; }
+
+	// Lowest and highest layer with non-air blocks (y within the chunk), -1 for empty chunks
+	int minY() const;
+	int maxY() const;
+};
+
+// Level 64 of the occupancy pyramid: a bit per chunk of a superchunk (see superchunkBitOf). The chunks publish
+// their bits themselves when their blocks change, atomically since neighbouring chunks may be edited in
+// parallel (see ChunkTicker).
+struct SuperchunkOccupancy {
+	atomic<uint64_t> occupied;   // Chunks that may have non-air blocks
+	uint64_t present;            // Chunks of the superchunk in the world
+
+	SuperchunkOccupancy() : occupied(0), present(0) {}
+};
+
+// Access statistics of the chunks of a world, for the compression of cold chunks (see ChunkCompressor)
+struct ChunkAccessStats {
+	double time;                    // Current time, accessed chunks take it as their last access time
+	size_t nrHits;                  // Accesses through the world to uncompressed chunks
+	size_t nrMisses;                // Accesses that had to decompress the chunk first
+	LatencyStats decompressTimes;   // us
+};
+
+class Chunk
+{
+	private:
+		// The blocks are either in the storage or, while the chunk is compressed, run-length encoded
+		// (see encodeChunk). Every access decompresses them transparently.
+		mutable shared_ptr<ChunkBlocks> data;
+		mutable vector<uint8_t> packed;
+		mutable ChunkAccessStats *accessStats;   // Where decompressions are counted, set by compress
+		bool pooled;   // The storage is in a ChunkPool and must never be written in place
+
+		// The summary is updated on every set, after writes through mutableBlocks or a restore it's
+		// computed again when it's needed next
+		mutable ChunkSummary summaryData;
+		mutable bool summaryValid;
+
+		// Superchunk of the world the chunk is in, and its bit there. The bits are set while the summary
+		// is invalid, so the superchunk never claims a chunk to be empty that isn't.
+		SuperchunkOccupancy *superchunk;
+		uint64_t superchunkBit;
+
+		// Update the chunk's bits in the superchunk from the summary
+		void publishOccupancy() const;
+
+		// Make the storage exclusive to this chunk before it is modified
+		void detach();
+
+		void decompress() const;
+		ChunkBlocks &resident() const
+		{
+			if (! data)
+				decompress();
+			return *data;
+		}
+
+	public:
+		bool modified;                // Modified since the chunk was last saved
+		mutable double lastAccess;    // Time of the last access (see ChunkAccessStats)
+
+		Chunk();
+
+		// Block access by index within the chunk (see blockIndexOf)
+		const BlockId *blocks() const { return resident().ids; }
+		BlockId get(int index) const { return resident().ids[index]; }
+		void set(int index, BlockId id);   // Marks the chunk as modified if the block changes
+
+		// Write access to all blocks at once (doesn't mark the chunk as modified)
+		BlockId *mutableBlocks();
+
+		// Immutable copy of the current blocks, which shares the storage until the chunk is modified
+		shared_ptr<const ChunkBlocks> snapshot() const { resident(); return data; }
+
+		// Take over the blocks of a snapshot, sharing the storage until the chunk is modified
+		void restore(const shared_ptr<const ChunkBlocks> &snapshot);
+
+		// Share the storage with the identical chunks of the pool, until the chunk is modified
+		void share(ChunkPool &pool);
+		const ChunkBlocks *storage() const { return data.get(); }   // NULL while compressed
+
+		// Replace the storage by the encoded blocks until the next access. Returns false if the storage is
+		// shared with other chunks or snapshots, compressing it wouldn't free it.
+		bool compress(ChunkAccessStats &stats);
+		bool isCompressed() const { return ! data; }
+		size_t compressedSize() const { return packed.size(); }
+
+		const ChunkSummary &summary() const;
+
+		// True if all blocks are air
+		bool isEmpty() const { return summary().isEmpty(); }
+
+		// Called by the world when the chunk is added to or removed from it (superchunk is NULL then)
+		void setSuperchunk(SuperchunkOccupancy *superchunk, int bit);
+};
+
+struct ChunkSnapshot {
+	ivec3 pos;
+	shared_ptr<const ChunkBlocks> blocks;
+};
+
+struct ChunkPosHash {
+	size_t operator()(const ivec3 &pos) const
+	{
+		return ((size_t)(uint32_t)pos.x * 73856093u) ^ ((size_t)(uint32_t)pos.y * 19349663u) ^ ((size_t)(uint32_t)pos.z * 83492791u);
+	}
+};
+
+typedef unordered_map<ivec3, unique_ptr<Chunk>, ChunkPosHash> ChunkMap;
+typedef unordered_map<ivec3, SuperchunkOccupancy, ChunkPosHash> SuperchunkMap;
+
+
+
+class World
+{
+	private:
+		ChunkMap chunks;
+		SuperchunkMap superchunks;        // Top level of the occupancy pyramid, superchunks without chunks are dropped
+		ChunkPool pool;                   // Storage shared between identical chunks
+		mutable ChunkAccessStats access;  // Updated by getChunk
+
+		void addToSuperchunk(ivec3 chunkPos, Chunk &chunk);
+		void removeFromSuperchunk(ivec3 chunkPos, Chunk &chunk);
+
+	public:
+		World();
+
+		// Block access (positions outside of any chunk are air)
+		BlockId getBlock(ivec3 pos) const;
+		void setBlock(ivec3 pos, BlockId id);
+
+		// Chunk access, notes the access time of the chunk
+		Chunk *getChunk(ivec3 chunkPos);
+		const Chunk *getChunk(ivec3 chunkPos) const;
+		Chunk &getOrCreateChunk(ivec3 chunkPos);
+		void setChunk(ivec3 chunkPos, unique_ptr<Chunk> chunk);   // Shares the storage with identical chunks
+		void removeChunk(ivec3 chunkPos);
+		const ChunkMap &getChunks() const { return chunks; }
+
+		// Occupancy of the superchunk of 4^3 chunks, NULL if none of its chunks is in the world
+		const SuperchunkOccupancy *getSuperchunk(ivec3 superchunkPos) const;
+
+		// Take snapshots of all modified chunks and clear their modified flags
+		void snapshotModifiedChunks(vector<ChunkSnapshot> &snapshots);
+
+		size_t nrChunks() const { return chunks.size(); }
+
+		// Number of distinct storage blocks of the chunks (less than nrChunks if storage is shared)
+		size_t nrStorageBlocks() const;
+		const ChunkPool &getPool() const { return pool; }
+
+		// Chunk accesses and decompressions, the time is set by the caller every frame
+		ChunkAccessStats &getAccessStats() { return access; }
+		const ChunkAccessStats &getAccessStats() const { return access; }
+		void clear();
+};
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "WorldStorage.hpp"
+#include "FileSystem.hpp"
+#include "ChunkCodec.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+
+static const uint32_t LEVEL_MAGIC = 0x4C564C4B;   // "KLVL"
+static const uint32_t LEVEL_VERSION = 2;   // Version 1 has no terrain seed
+
+
+
+WorldStorage::WorldStorage(const string &directory)
+{
+	this->directory = directory;
+	seed = 0;
+	nrRegionUses = 0;
+
+	makeDirectory(directory);
+	readLevel();
+}
+
+
+string WorldStorage::regionPath(ivec3 regionPos) const
+{
+	stringstream path;
+	path << directory << "/r." << regionPos.x << "." << regionPos.y << "." << regionPos.z << ".region";
+	return path.str();
+}
+
+
+RegionFile *WorldStorage::getRegion(ivec3 regionPos, bool create)
+{
+	auto it = regions.find(regionPos);
+	if (it != regions.end())
+	{
+		it->second.lastUse = ++nrRegionUses;
+		return it->second.file.get();
+	}
+
+	bool listed = find(regionPositions.begin(), regionPositions.end(), regionPos) != regionPositions.end();
+	if (! listed && ! create)
+		return NULL;
+
+	// Close the least recently used region file, so flying through the world doesn't use up file handles
+	if (regions.size() >= MAX_OPEN_REGIONS)
+	{
+		auto oldest = regions.begin();
+		for (auto entry = regions.begin(); entry != regions.end(); ++entry)
+		{
+			if (entry->second.lastUse < oldest->second.lastUse)
+				oldest = entry;
+		}
+		oldest->second.file->flush();
+		regions.erase(oldest);
+	}
+
+	OpenRegion &openRegion = regions[regionPos];
+	openRegion.lastUse = ++nrRegionUses;
+	unique_ptr<RegionFile> &region = openRegion.file;
+	region.reset(new RegionFile());
+	if (! region->open(regionPath(regionPos), regionPos))
+	{
+		regions.erase(regionPos);
+		return NULL;
+	}
+	region->setKeepEmptyChunks(seed != 0);
+
+	// New regions are added to the level file
+	if (! listed)
+	{
+		regionPositions.push_back(regionPos);
+		writeLevel();
+	}
+
+	return region.get();
+}
+
+
+bool WorldStorage::setSeed(uint32_t seed)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	this->seed = seed;
+	for (const auto &region : regions)
+		region.second.file->setKeepEmptyChunks(seed != 0);
+	return writeLevel();
+}
+
+
+bool WorldStorage::hasChunk(ivec3 chunkPos)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	RegionFile *region = getRegion(RegionFile::regionPosOf(chunkPos), false);
+	return region && region->hasChunk(RegionFile::slotOf(chunkPos));
+}
+
+
+bool WorldStorage::loadChunk(ivec3 chunkPos, Chunk &chunk)
+{
+	vector<uint8_t> payload;
+	bool corrupted;
+	{
+		lock_guard<recursive_mutex> lock(storageMutex);
+
+		RegionFile *region = getRegion(RegionFile::regionPosOf(chunkPos), false);
+		int slot = RegionFile::slotOf(chunkPos);
+		if (! region || ! region->hasChunk(slot))
+			return false;
+		corrupted = ! region->readPayload(slot, payload);
+	}
+
+	// Decoding doesn't need the region file
+	if (corrupted || ! decodeChunk(payload.data(), payload.size(), chunk.mutableBlocks()))
+	{
+		std::cerr << "ERROR::WORLD::CORRUPTED_CHUNK: " << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z << endl;
+		return false;
+	}
+
+	chunk.modified = false;
+	return true;
+}
+
+
+bool WorldStorage::saveChunk(ivec3 chunkPos, Chunk &chunk)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	// Don't create a region file just to store an empty chunk, unless it would be generated again
+	ivec3 regionPos = RegionFile::regionPosOf(chunkPos);
+	bool create = ! chunk.isEmpty() || seed != 0;
+	RegionFile *region = getRegion(regionPos, create);
+	if (! region)
+	{
+		// An empty chunk in a region without a file has no stored version to replace. Otherwise the
+		// region file couldn't be opened, the chunk stays modified so it's saved again later.
+		bool listed = find(regionPositions.begin(), regionPositions.end(), regionPos) != regionPositions.end();
+		if (create || listed)
+		{
+			std::cerr << "ERROR::WORLD::CHUNK_COULD_NOT_BE_SAVED: " << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z << endl;
+			return false;
+		}
+		chunk.modified = false;
+		return true;
+	}
+
+	if (! region->writeChunk(RegionFile::slotOf(chunkPos), chunk.blocks()))
+	{
+		std::cerr << "ERROR::WORLD::CHUNK_COULD_NOT_BE_SAVED: " << chunkPos.x << ", " << chunkPos.y << ", " << chunkPos.z << endl;
+		return false;
+	}
+
+	chunk.modified = false;
+	return true;
+}
+
+
+size_t WorldStorage::loadWorld(World &world)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	size_t nrLoaded = 0;
+
+	for (size_t i = 0; i < regionPositions.size(); i++)
+	{
+		RegionFile *region = getRegion(regionPositions[i], false);
+		if (! region)
+			continue;
+
+		for (int slot = 0; slot < REGION_SLOTS; slot++)
+		{
+			if (! region->hasChunk(slot))
+				continue;
+
+			ivec3 chunkPos = region->chunkPosOf(slot);
+			unique_ptr<Chunk> chunk(new Chunk());
+			if (region->readChunk(slot, chunk->mutableBlocks()))
+			{
+				world.setChunk(chunkPos, std::move(chunk));
+				nrLoaded++;
+			}
+			else
+			{
+				world.removeChunk(chunkPos);
+			}
+		}
+	}
+
+	return nrLoaded;
+}
+
+
+size_t WorldStorage::saveWorld(World &world)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	size_t nrSaved = 0;
+
+	for (const ChunkMap::value_type &entry : world.getChunks())
+	{
+		if (entry.second->modified && saveChunk(entry.first, *entry.second))
+			nrSaved++;
+	}
+
+	flush();
+	return nrSaved;
+}
+
+
+size_t WorldStorage::commitChunks(const vector<ChunkSnapshot> &snapshots, vector<ivec3> &failedChunks)
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	// Group the chunks by region
+	unordered_map<ivec3, vector<const ChunkSnapshot*>, ChunkPosHash> regionChunks;
+	for (const ChunkSnapshot &snapshot : snapshots)
+		regionChunks[RegionFile::regionPosOf(snapshot.pos)].push_back(&snapshot);
+
+	size_t nrSaved = 0;
+	for (const auto &entry : regionChunks)
+	{
+		vector<int> slots;
+		vector<const BlockId*> blocks;
+		bool empty = true;
+		for (const ChunkSnapshot *snapshot : entry.second)
+		{
+			slots.push_back(RegionFile::slotOf(snapshot->pos));
+			blocks.push_back(snapshot->blocks->ids);
+			for (int i = 0; i < CHUNK_VOLUME && empty; i++)
+				empty = (snapshot->blocks->ids[i] == AIR);
+		}
+
+		// Don't create a region file just to store empty chunks, unless they would be generated again
+		RegionFile *region = getRegion(entry.first, ! empty || seed != 0);
+		if (! region && empty)
+		{
+			nrSaved += entry.second.size();
+			continue;
+		}
+
+		if (! region || ! region->commitChunks(slots, blocks))
+		{
+			std::cerr << "ERROR::WORLD::REGION_COULD_NOT_BE_SAVED: " << entry.first.x << ", " << entry.first.y << ", " << entry.first.z << endl;
+			for (const ChunkSnapshot *snapshot : entry.second)
+				failedChunks.push_back(snapshot->pos);
+			continue;
+		}
+		nrSaved += entry.second.size();
+	}
+
+	return nrSaved;
+}
+
+
+void WorldStorage::flush()
+{
+	lock_guard<recursive_mutex> lock(storageMutex);
+
+	for (const auto &region : regions)
+		region.second.file->flush();
+}
+
+
+bool WorldStorage::readLevel()
+{
+	ifstream in(directory + "/level.dat", ios::binary);
+	if (! in)
+		return false;
+
+	uint32_t magic = 0, version = 0, levelSeed = 0, nrRegions = 0;
+	in.read((char*)&magic, sizeof(magic));
+	in.read((char*)&version, sizeof(version));
+	if (version >= 2)
+		in.read((char*)&levelSeed, sizeof(levelSeed));
+	in.read((char*)&nrRegions, sizeof(nrRegions));
+	if (! in || magic != LEVEL_MAGIC || version < 1 || version > LEVEL_VERSION)
+	{
+		std::cerr << "ERROR::WORLD::INVALID_LEVEL_FILE: " << directory << endl;
+		return false;
+	}
+
+	seed = levelSeed;
+	regionPositions.clear();
+	for (uint32_t i = 0; i < nrRegions; i++)
+	{
+		int32_t pos[3];
+		if (! in.read((char*)pos, sizeof(pos)))
+			return false;
+		regionPositions.push_back(ivec3(pos[0], pos[1], pos[2]));
+	}
+
+	return true;
+}
+
+
+bool WorldStorage::writeLevel() const
+{
+	// Replace the level file atomically, it's the only index of the region files
+	vector<int32_t> level;
+	level.push_back((int32_t)LEVEL_MAGIC);
+	level.push_back((int32_t)LEVEL_VERSION);
+	level.push_back((int32_t)seed);
+	level.push_back((int32_t)regionPositions.size());
+	for (const ivec3 &regionPos : regionPositions)
+	{
+		level.push_back(regionPos.x);
+		level.push_back(regionPos.y);
+		level.push_back(regionPos.z);
+	}
+
+	return writeFileAtomically(directory + "/level.dat", level.data(), level.size() * sizeof(int32_t));
+}
\ No newline at end of file
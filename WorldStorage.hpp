@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <vector>
+
+#include "World.hpp"
+#include "RegionFile.hpp"
+
+using namespace std;
+
+
+
+// Saved world in a directory: one region file per region that contains chunks and a level file
+// listing these regions. Chunks are loaded at random and saved incrementally. At most
+// MAX_OPEN_REGIONS region files are kept open, the least recently used one is closed for the next.
+class WorldStorage
+{
+	private:
+		struct OpenRegion {
+			unique_ptr<RegionFile> file;
+			uint64_t lastUse;
+		};
+
+		static const size_t MAX_OPEN_REGIONS = 64;
+
+		string directory;
+		recursive_mutex storageMutex;   // Chunks may be saved by a background thread
+		unordered_map<ivec3, OpenRegion, ChunkPosHash> regions;   // Open region files
+		uint64_t nrRegionUses;
+		vector<ivec3> regionPositions;                            // All regions listed in the level file
+		uint32_t seed;                                            // Terrain seed, 0 for worlds without terrain
+
+		// The returned region file may be closed when more region files are opened
+		RegionFile *getRegion(ivec3 regionPos, bool create);
+		string regionPath(ivec3 regionPos) const;
+		bool readLevel();
+		bool writeLevel() const;
+
+	public:
+		WorldStorage(const string &directory);
+
+		// Whether a saved world exists in the directory
+		bool exists() const { return ! regionPositions.empty() || seed != 0; }
+
+		// Seed of the generated terrain, chunks that aren't stored are generated from it
+		uint32_t getSeed() const { return seed; }
+		bool setSeed(uint32_t seed);
+
+		// Whether the chunk is stored
+		bool hasChunk(ivec3 chunkPos);
+
+		// Load a single chunk, returns false if it isn't stored. Chunks may be loaded from several
+		// threads at once, only reading the payload is serialized.
+		bool loadChunk(ivec3 chunkPos, Chunk &chunk);
+
+		// Store a single chunk and clear its modified flag
+		bool saveChunk(ivec3 chunkPos, Chunk &chunk);
+
+		// Load all stored chunks into the world, returns the number of chunks loaded
+		size_t loadWorld(World &world);
+
+		// Store all modified chunks of the world, returns the number of chunks written
+		size_t saveWorld(World &world);
+
+		// Store the snapshots, each region is written atomically as a whole. Returns the number of
+		// chunks written, failed chunks are added to failedChunks.
+		size_t commitChunks(const vector<ChunkSnapshot> &snapshots, vector<ivec3> &failedChunks);
+
+		// Flush all open region files
+		void flush();
+};
\ No newline at end of file
@@ -1,5 +1,13 @@
 #version 330 core
 
+// Compile-time variant switches (injected by ShaderVariants):
+//   SPOTLIGHT_ON       - the flashlight contributes to the lighting
+//   NO_SPECULAR        - the material has no specular map, so specular highlights are skipped
+//   NR_POINT_LIGHTS n  - size of the point light array (upper bound of the active lamp count)
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 100
+#endif
+
 struct DirLight {
 	vec3 direction;   // Direction vector from light to fragment     
 
@@ -50,10 +58,13 @@ in vec2 TexCoords;
 out vec4 fragColor;
 
 uniform DirLight dirLight;
-uniform PointLight pointLights[100];
+#if NR_POINT_LIGHTS > 0
+uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform int nrPointLights;
+#endif
+#ifdef SPOTLIGHT_ON
 uniform SpotLight spotLight;
-uniform bool spotLightOn;
+#endif
 uniform Material material;
 uniform vec3 camPos;
 
@@ -76,18 +87,29 @@ void main()
 	vec3 normal = normalize(Normal);
 	vec3 camDir = normalize(camPos - FragPos);   // Direction vector from fragment to camera
 	vec3 diffTexelColor = vec3(texture(material.diffuseTexture, TexCoords));
+#ifdef NO_SPECULAR
+	vec3 specTexelColor = vec3(0.0f);
+#else
 	vec3 specTexelColor = vec3(texture(material.specularTexture, TexCoords));
+#endif
 
 	// Directional light
 	vec3 result = calcDirLightColor(dirLight, normal, camDir, diffTexelColor, specTexelColor);
 
-	// Point light
-	for (int i = 0; i < nrPointLights; i++)
+	// Point light (constant loop bound, the lamps beyond nrPointLights are unused array slots)
+#if NR_POINT_LIGHTS > 0
+	for (int i = 0; i < NR_POINT_LIGHTS; i++)
+	{
+		if (i >= nrPointLights)
+			break;
 		result += calcPointLightColor(pointLights[i], normal, camDir, diffTexelColor, specTexelColor);
+	}
+#endif
 
 	// Spotlight
-	if (spotLightOn)
-		result += calcSpotLightColor(spotLight, normal, camDir, diffTexelColor, specTexelColor);
+#ifdef SPOTLIGHT_ON
+	result += calcSpotLightColor(spotLight, normal, camDir, diffTexelColor, specTexelColor);
+#endif
 
 	// Final color
 	fragColor = vec4(result, 1.0f);
@@ -157,9 +179,13 @@ vec3 calcDiffuseColor(vec3 normal, vec3 lightDir, vec3 lightDiffuse, vec3 diffTe
 
 vec3 calcSpecularColor(vec3 normal, vec3 lightDir, vec3 camDir, vec3 lightSpecular, vec3 specTexelColor) 
 {
+#ifdef NO_SPECULAR
+	return vec3(0.0f);
+#else
 	vec3 reflectDir = reflect(-lightDir, normal);
 	float spec = pow(max(dot(camDir, reflectDir), 0.0f), material.shininess);
 	return lightSpecular * spec * specTexelColor; 
+#endif
 }
 
 
@@ -6,11 +6,36 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <random>
 #include <vector>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <cstring>
 
 #include "Shader.hpp"
+#include "ShaderVariants.hpp"
 #include "Texture.hpp"
+#include "TextureLoader.hpp"
 #include "Camera.hpp"
 #include "objects.hpp"
+#include "AssetPack.hpp"
+#include "World.hpp"
+#include "WorldStorage.hpp"
+#include "Autosave.hpp"
+#include "EditJournal.hpp"
+#include "ChunkStreamer.hpp"
+#include "TerrainGenerator.hpp"
+#include "ChunkCompressor.hpp"
+#include "SimulationThread.hpp"
+#include "SnapshotBuffer.hpp"
+#include "TickScheduler.hpp"
+#include "ChunkTicker.hpp"
+#include "FluidSimulation.hpp"
+#include "PlayerPhysics.hpp"
+#include "RayCaster.hpp"
+#include "Entities.hpp"
+#include "Profiling.hpp"
+#include "Hash.hpp"
+#include "Benchmarks.hpp"
 #include "stb_image.h"
 
 using namespace std;
@@ -33,7 +58,21 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 // Movement
 float deltaTime = 0.0f;   // Time between this and the last frame
 bool keysPressed[1024];   // Allows movement in multiple directions in one frame
-void moveCam();           // Executes the camera movement
+void moveCam(Camera &camera, const bool *keys, bool walk, float dt);   // Executes the camera movement of a simulation tick
+
+// Walking: the camera sits at the eyes of the player's body, which collides with the blocks (see PlayerPhysics).
+// Otherwise the camera flies through the world.
+bool walking = false;   // Toggled with F
+bool isPlayerSolid(ivec3 cell);
+PlayerPhysics playerPhysics(isPlayerSolid);
+PlayerBody player;
+bool playerWalking = false;   // Walking in the last simulation tick
+
+// Simulation, advanced in fixed ticks on its own thread (see SimulationThread)
+vec3 simulatedCamPos;     // Camera position after the last tick
+vec3 previousCamPos;      // Camera position before the last tick, the camera is shown in between
+void simulationTick(float dt);
+void publishSnapshot(double simulatedTime, bool autosaveRunning);   // Hands the state over to the render thread
 
 bool firstMouse = true;
 float lastX; 
@@ -41,6 +80,7 @@ float lastY;
 
 Camera cam(vec3(0.0f, 0.0f, 3.0f), STUCK_ON_WORLD_Y);
 float hitRange = 10.0f;
+int viewDistance = 10;   // Radius in chunks that is kept loaded around the camera, also sets the far plane
 
 
 
@@ -68,13 +108,52 @@ unsigned char currentDaytime = 0;
 // Spotlight
 GLboolean spotlightOn = GL_FALSE;
 
-// Gravity
-void doGravity();
-
-
+// Lighting shader variants
+string lightingDefines(bool specularMap);              // #defines of the variant for the current lighting state
+void setLightingUniforms(const Shader &blockShader);   // Sets the per-frame light uniforms
 
-// Blocks and Lamps
-Texture textures[13];
+// Gravity
+void doGravity(float dt);
+void dropIfUnsupported(ivec3 pos);   // Starts a gravity block falling if there is no block below it
+
+// Block ticks, updates of single blocks scheduled for a later simulation tick (see TickScheduler). Gravity
+// blocks are checked once a block around them changed, chunks with soil get random ticks in which grass spreads.
+// The random ticks due in a tick run in parallel (see ChunkTicker).
+enum BlockTickType { GRAVITY_TICK, RANDOM_TICK };
+TickScheduler blockTicks;
+ChunkTicker *chunkTicker = NULL;                      // Set up in main
+unordered_set<ivec3, ChunkPosHash> randomTickChunks;   // Chunks with a random tick scheduled
+void doBlockTicks();
+void scheduleRandomTick(ivec3 chunkPos);
+bool needsRandomTicks(ivec3 chunkPos);
+void randomTick(ChunkRegion &region);
+
+
+
+// Asset pack
+const char *assetPackPath = "./assets.pak";
+int packAssets(int argc, char **argv);   // Packing tool, see below
+
+
+
+// Blocks, Lamps and Fluids
+Texture textures[NR_TEXTURES];
+const char *texturePaths[NR_TEXTURES] = {
+	"./noSpecular.png",
+	"./grassDiffuse.png",
+	"./stone_tiles_diff.jpg",
+	"./slab_tiles_diff.jpg",
+	"./dark_wood_diff.jpg",
+	"./concrete_wall_diff.jpg",
+	"./pavement_diff.jpg",
+	"./green_paper_lantern.jpg",
+	"./slab_tiles_spec.jpg",
+	"./white_paper_lantern.jpg",
+	"./moss_diff.jpg",
+	"./metal_panel_diff.jpg",
+	"./metal_panel_diff.jpg",
+	"./water_diff.png"
+};
 
 struct BlockType {
 	short diffTexIdx;   // Index of the Texture object in the textures array
@@ -96,12 +175,19 @@ BlockType blockTypes[] = {
 
 short nrBlockTypes = 8;
 
-struct Block {
-	vec3 position;
-	BlockType type;
-};
+// Grass spreads onto pavement and concrete
+const BlockId GRASS = 1;
+const BlockId CONCRETE = 5;
+const BlockId PAVEMENT = 6;
 
-vector<Block> blocks;   // Contains all blocks set in the scene
+// The blocks and lamps set in the scene are stored in the world grid as block ids:
+// 0 is air, 1 to nrBlockTypes are the block types, the following ids are the lamp types and after them
+// the fluid types
+World world;
+EditJournal journal;                     // Write-ahead log of the edits not yet saved in the region files
+void editBlock(ivec3 pos, BlockId id);   // Changes a block of the world and journals the edit
+void blockEdited(ivec3 pos, BlockId oldId, BlockId id);   // Journals a change already made to the world
+ChunkStreamer *streamer = NULL;          // Loads and evicts chunks around the camera (set up in main)
 
 struct LampType {
 	short texIdx;   // Index of the Texture object in the textures array   
@@ -127,7 +213,111 @@ struct Lamp {
 	LampType type;
 };
 
-vector<Lamp> lamps;   // Contains all lamps set in the scene
+vector<Lamp> lamps;   // Contains all lamps set in the scene (kept in sync with the world grid)
+void collectLamps();  // Rebuilds the lamps from the world grid
+
+// Fluid blocks of the world are sources, the fluid flowing from them is simulated separately
+struct FluidType {
+	short texIdx;   // Index of the Texture object in the textures array
+	GLfloat shininess;
+};
+
+FluidType fluidTypes[] = {
+	{ 13, 90.0f }   // Water
+};
+
+short nrFluidTypes = 1;
+
+const BlockId WATER = 11;   // First id after the lamps
+FluidSimulation fluids(WATER);
+const int fluidInterval = 6;   // Ticks between the steps of the fluid simulation
+void stepFluids();
+
+struct FluidBlock {
+	vec3 position;
+	float height;   // Part of the cell filled with fluid
+	BlockId id;
+};
+
+struct Block {
+	vec3 position;
+	BlockId id;
+};
+
+// Dynamic objects of the simulation. Gravity blocks that are currently falling, and therefore not part of
+// the world grid, are entities with a Transform, a Velocity and a GravityBlock until they land.
+EntityRegistry entities;
+
+struct GravityBlock {
+	BlockId id;
+};
+
+// Falling block as handed to the render thread
+struct FallingBlock {
+	vec3 position;           // Position after the last tick
+	vec3 previousPosition;   // Position before the last tick, the block is shown in between
+	BlockId id;
+};
+
+// Generated terrain has far more blocks than are ever visible, so only the blocks with a side that isn't
+// covered by another block are drawn. They are cached per chunk along with the chunk's lamps; the
+// simulation thread builds the caches, the render thread draws them.
+struct ChunkCache {
+	vector<Block> blocks;
+	vector<Lamp> lamps;
+	vector<FluidBlock> fluids;
+};
+
+typedef unordered_map<ivec3, shared_ptr<const ChunkCache>, ChunkPosHash> ChunkCacheMap;
+
+unordered_set<ivec3, ChunkPosHash> cachedChunks;    // Chunks the render thread has a cache of
+unordered_set<ivec3, ChunkPosHash> staleChunks;     // Chunks whose cache has to be rebuilt
+unordered_set<ivec3, ChunkPosHash> gravityChunks;   // Chunks loaded since the last gravity check
+void syncChunkCaches();                             // Marks the chunks loaded or evicted since the last call as stale
+void updateChunkCaches(ChunkCacheMap &changed);     // Rebuilds the stale caches (NULL for evicted chunks)
+
+// Immutable state of the simulation drawn by the render thread, published after every iteration of the
+// simulation thread. The render thread always takes the latest one, the chunk caches changed in the
+// snapshots it skipped are carried over.
+struct RenderSnapshot {
+	double simulatedTime;   // Point in time the simulation reached (see SimulationThread::now)
+	vec3 camPos;
+	vec3 previousCamPos;
+	vector<FallingBlock> fallingBlocks;
+	ChunkCacheMap changedCaches;
+	bool autosaveRunning;
+};
+
+SnapshotBuffer<RenderSnapshot> renderSnapshots;
+ChunkCacheMap chunkCaches;   // Caches drawn by the render thread
+
+// Input of the render thread, handed over to the simulation thread after every frame
+struct EditCommand {
+	vec3 origin;      // Camera ray of the click
+	vec3 direction;
+	BlockId id;       // Placed in front of the block hit, AIR destroys the block hit
+};
+
+struct SimulationInput {
+	bool keysPressed[1024];
+	bool walking;
+	Camera camera;              // Orientation and speed, the simulation moves its own position
+	vector<EditCommand> edits;
+};
+
+mutex simulationInputMutex;
+SimulationInput simulationInput = { {}, false, Camera(vec3(0.0f), STUCK_ON_WORLD_Y), {} };
+vector<EditCommand> pendingEdits;   // Clicks of the current frame
+
+const ivec3 neighbourDirections[6] = {
+	ivec3(1, 0, 0), ivec3(-1, 0, 0), ivec3(0, 1, 0), ivec3(0, -1, 0), ivec3(0, 0, 1), ivec3(0, 0, -1)
+};
+
+inline bool isFluid(BlockId id) { return id > nrBlockTypes + nrLampTypes; }
+inline bool isLamp(BlockId id) { return id > nrBlockTypes && ! isFluid(id); }
+inline const BlockType &blockTypeOf(BlockId id) { return blockTypes[id - 1]; }
+inline const FluidType &fluidTypeOf(BlockId id) { return fluidTypes[id - 1 - nrBlockTypes - nrLampTypes]; }
+inline const LampType &lampTypeOf(BlockId id) { return lampTypes[id - 1 - nrBlockTypes]; }
 
 
 
@@ -145,16 +335,36 @@ struct Intersection {
 	vec3 normal;
 };
 
+RayCaster rayCaster(world);   // Walks the rays through the world grid
+
 Intersection calcIntersectionRayCube(vec3 rayOrigin, vec3 rayDir, float rayRange, vec3 cubePos);
-void setCube();
-void destroyCube();
+bool raycastCubes(vec3 rayOrigin, vec3 rayDir, vec3 &hitCubePos, Intersection &hitIntersection, Entity &hitFallingBlock);
+void setCube(vec3 rayOrigin, vec3 rayDir, BlockId id);
+void destroyCube(vec3 rayOrigin, vec3 rayDir);
 
 
 
 
 
-int main()
+int main(int argc, char **argv)
 {
+	// Run the packing tool or a benchmark instead of the game
+	if (argc >= 2 && string(argv[1]) == "--pack")
+		return packAssets(argc, argv);
+	if (argc >= 3 && string(argv[1]) == "--bench")
+		return runBenchmark(argv[2]);
+
+	// Switches for comparing the startup time without the caches
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--no-shader-cache")
+			Shader::setBinaryCacheEnabled(false);
+		else if (string(argv[i]) == "--no-texture-cache")
+			TextureLoader::setCacheEnabled(false);
+		else
+			std::cerr << "ERROR::MAIN::UNKNOWN_OPTION: " << argv[i] << endl;
+	}
+
 	/* -------------------------------------------------------------------------------- */
 	/*                                      SET UP                                      */
 	/* -------------------------------------------------------------------------------- */
@@ -206,48 +416,109 @@ int main()
 
 
 
+	// Assets are read from the asset pack if there is one, otherwise from the loose files
+	if (mountAssetPack(assetPackPath))
+		std::cout << "Mounted " << assetPackPath << " (" << mountedAssetPack().size() << " assets, content hash "
+			<< std::hex << mountedAssetPack().contentHash() << std::dec << ")" << endl;
+
 	// Shaders
-	const Shader blockShader("./lighting.vert", "./lighting.frag");
+	double shaderStartTime = glfwGetTime();
+	ShaderVariants blockShaders("./lighting.vert", "./lighting.frag", [](const Shader &blockShader)
+	{
+		// Set constant uniforms
+		blockShader.setUniform("spotLight.innerCutOff", cos(radians(5.0f)));
+		blockShader.setUniform("spotLight.outerCutOff", cos(radians(13.5f)));
+		blockShader.setUniform("spotLight.ambient", vec3(0.2f, 0.2f, 0.2f));
+		blockShader.setUniform("spotLight.diffuse", vec3(0.9f, 0.9f, 0.9f));
+		blockShader.setUniform("spotLight.specular", vec3(1.0f, 1.0f, 1.0f));
+		blockShader.setUniform("spotLight.constant", 1.0f);
+		blockShader.setUniform("spotLight.linear", 0.09f);
+		blockShader.setUniform("spotLight.quadratic", 0.032f);
+	});
 	const Shader lampShader("./lamp.vert", "./lamp.frag");
 	const Shader crosshairShader("./crosshair.vert", "./crosshair.frag");
+	// Build the variants needed for the first frame, all others are built when first needed
+	blockShaders.get(lightingDefines(false));
+	blockShaders.get(lightingDefines(true));
+	int nrCachedShaders = lampShader.isFromBinaryCache() + crosshairShader.isFromBinaryCache();
+	std::cout << "Shader creation took " << (glfwGetTime() - shaderStartTime) * 1000.0 << " ms ("
+		<< nrCachedShaders << "/2 loaded from the program binary cache" << (Shader::isBinaryCacheEnabled() ? "" : " (disabled)")
+		<< ", lighting variants below)" << endl;
+	blockShaders.printStats();
 	
-	// Textures
-	textures[0] = Texture("./noSpecular.png");
-	textures[1] = Texture("./grassDiffuse.png");
-	textures[2] = Texture("./stone_tiles_diff.jpg");
-	textures[3] = Texture("./slab_tiles_diff.jpg");
-	textures[4] = Texture("./dark_wood_diff.jpg");
-	textures[5] = Texture("./concrete_wall_diff.jpg");
-	textures[6] = Texture("./pavement_diff.jpg");
-	textures[7] = Texture("./green_paper_lantern.jpg"); 
-	textures[8] = Texture("./slab_tiles_spec.jpg");
-	textures[9] = Texture("./white_paper_lantern.jpg"); 
-	textures[10] = Texture("./moss_diff.jpg");
-	textures[11] = Texture("./metal_panel_diff.jpg");
-	textures[12] = Texture("./metal_panel_diff.jpg");
+	// Textures (decoded in parallel, shared images are only loaded once)
+	TextureLoader textureLoader;
+	for (const char *texturePath : texturePaths)
+		textureLoader.add(texturePath);
+	textureLoader.load();
+	for (int i = 0; i < NR_TEXTURES; i++)
+		textures[i] = textureLoader.get(texturePaths[i]);
+	textureLoader.printTimings();
 	
-	// Generate blocks for the launch platform
-	for (float i = -10.0f; i <= 10.0f; i++)        
+	// Open the saved world or start a new one with a random terrain seed (worlds saved before there
+	// was terrain have no seed and no generator)
+	WorldStorage worldStorage("./world");
+	if (! worldStorage.exists())
 	{
-		for (float j = -10.0f; j <= 10.0f; j++)   
+		random_device seeder;
+		uint32_t seed = 0;
+		while (seed == 0)
+			seed = seeder();
+		worldStorage.setSeed(seed);
+	}
+	TerrainGenerator terrain(worldStorage.getSeed());
+	function<void(ivec3, BlockId*)> generator;
+	if (worldStorage.getSeed() != 0)
+		generator = [&terrain](ivec3 chunkPos, BlockId *blocks) { terrain.generate(chunkPos, blocks); };
+
+	// Edits that weren't saved before a crash are replayed from the journal
+	journal.open("./world/edits.journal", world, &worldStorage, generator);
+	if (journal.getNrReplayed() > 0)
+		std::cout << "Replayed " << journal.getNrReplayed() << " edits from the journal" << endl;
+
+	// Modified chunks are saved in the background every 30 seconds, which also compacts the journal
+	Autosave autosave(worldStorage, 30.0, &journal);
+
+	cam.pos = vec3(0.0f, worldStorage.getSeed() != 0 ? terrain.surfaceHeight(0, 0) + 2.0f : 2.0f, 0.0f);
+	simulatedCamPos = previousCamPos = cam.pos;
+	simulationInput.camera = cam;
+
+	// Only the chunks around the camera are loaded (or generated), those in view before the first frame
+	ChunkStreamer chunkStreamer(worldStorage, autosave, viewDistance, viewDistance + 2);
+	chunkStreamer.setGenerator(generator);
+	streamer = &chunkStreamer;
+	double worldStartTime = glfwGetTime();
+	chunkStreamer.update(world, cam.pos, cam.front, glfwGetTime());
+	chunkStreamer.waitForLoads(world);
+
+	// Chunks not accessed for 10 seconds are compressed in memory, as are the least recently used ones
+	// beyond 8 MB of block storage
+	ChunkCompressor chunkCompressor(8 << 20, 10.0);
+
+	// From here on the world belongs to the simulation thread, the render thread only sees its snapshots.
+	// Gravity and the camera movement run at 60 ticks per second; after the ticks, the modified chunks are
+	// handed over to the autosave writer, the chunks around the camera are streamed and the cold ones compressed.
+	ChunkTicker ticker;
+	chunkTicker = &ticker;
+	SimulationThread simulation(60.0);
+	syncChunkCaches();
+	publishSnapshot(simulation.now(), false);
+	simulation.start(simulationTick, [&](double simulatedTime)
+	{
+		vec3 camFront;
 		{
-			blocks.push_back({ vec3(i, 0.0f, j), blockTypes[6] });
+			lock_guard<mutex> lock(simulationInputMutex);
+			camFront = simulationInput.camera.front;
 		}
-	}
 
-	cam.pos = vec3(0.0f, 2.0f, 0.0f);
+		autosave.update(world, simulatedTime);
+		if (chunkStreamer.update(world, simulatedCamPos, camFront, simulatedTime))
+			syncChunkCaches();
+		chunkCompressor.update(world, simulatedTime);
 
-	// Set constant uniforms
-	blockShader.use();
-	blockShader.setUniform("spotLight.innerCutOff", cos(radians(5.0f)));
-	blockShader.setUniform("spotLight.outerCutOff", cos(radians(13.5f)));
-	blockShader.setUniform("spotLight.ambient", vec3(0.2f, 0.2f, 0.2f));
-	blockShader.setUniform("spotLight.diffuse", vec3(0.9f, 0.9f, 0.9f));
-	blockShader.setUniform("spotLight.specular", vec3(1.0f, 1.0f, 1.0f));
-	blockShader.setUniform("spotLight.constant", 1.0f);
-	blockShader.setUniform("spotLight.linear", 0.09f);
-	blockShader.setUniform("spotLight.quadratic", 0.032f);
-	
+		publishSnapshot(simulatedTime, autosave.isWriting());
+	});
+	std::cout << "Loaded " << world.nrChunks() << " chunks in " << (glfwGetTime() - worldStartTime) * 1000.0 << " ms" << endl;
 
 
 	
@@ -262,6 +533,11 @@ int main()
 	float currentFrame;       // Point in time of the current frame
 	float lastFrame = 0.0f;   // Point in time of the last frame
 
+	vector<Block> blockBatches[2];   // Blocks to draw without and with specular map
+
+	LatencyStats frameTimes;            // ms, frames without a running autosave
+	LatencyStats autosaveFrameTimes;    // ms, frames while the autosave writer was running
+
 	while (! glfwWindowShouldClose(window))
 	{
 		// Clear screen
@@ -269,66 +545,111 @@ int main()
 		glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// Take over the latest snapshot of the simulation with the chunk caches it changed
+		if (renderSnapshots.acquire())
+		{
+			for (const ChunkCacheMap::value_type &entry : renderSnapshots.latest().changedCaches)
+			{
+				if (entry.second)
+					chunkCaches[entry.first] = entry.second;
+				else
+					chunkCaches.erase(entry.first);
+			}
+			if (! renderSnapshots.latest().changedCaches.empty())
+				collectLamps();
+		}
+		const RenderSnapshot &snapshot = renderSnapshots.latest();
+
+		// The camera and the falling blocks are shown between their positions of the last two ticks
+		float alpha = simulation.alpha(snapshot.simulatedTime, simulation.now());
+		cam.pos = mix(snapshot.previousCamPos, snapshot.camPos, alpha);
+
 
 
-		projection = glm::perspective(radians(cam.fov), (float)WIDTH / (float)HEIGHT, 0.1f, 150.0f);
+		projection = glm::perspective(radians(cam.fov), (float)WIDTH / (float)HEIGHT, 0.1f, (float)(viewDistance * CHUNK_SIZE));
 		view = cam.getViewMatrix();
 	
 		/* -------------------------------------------------------------------------------- */
 		/*                                    DRAW BLOCKS                                   */
 		/* -------------------------------------------------------------------------------- */
 
-		blockShader.use();
-
-		// Directional light
-		blockShader.setUniform("dirLight.direction", daytimes[currentDaytime].dirLightDir);
-		blockShader.setUniform("dirLight.ambient", daytimes[currentDaytime].dirLightAmbient);
-		blockShader.setUniform("dirLight.diffuse", daytimes[currentDaytime].dirLightDiffuse);
-		blockShader.setUniform("dirLight.specular", daytimes[currentDaytime].dirLightSpecular);
-
-		// Point lights
-		int nrLamps = static_cast<int>(lamps.size());
-		blockShader.setUniform("nrPointLights", nrLamps);
-		for (int i = 0; i < nrLamps; i++)
+		// The lighting shader is specialized for the current lighting state and for whether the
+		// material has a specular map, so the blocks are drawn in one batch per variant
+		blockBatches[0].clear();
+		blockBatches[1].clear();
+		for (const ChunkCacheMap::value_type &entry : chunkCaches)
 		{
-			blockShader.setUniform("pointLights[" + to_string(i) + "].position", lamps[i].position); 
-			blockShader.setUniform("pointLights[" + to_string(i) + "].ambient", lamps[i].type.ambient);
-			blockShader.setUniform("pointLights[" + to_string(i) + "].diffuse", lamps[i].type.diffuse);
-			blockShader.setUniform("pointLights[" + to_string(i) + "].specular", lamps[i].type.specular);
-			blockShader.setUniform("pointLights[" + to_string(i) + "].constant", lamps[i].type.constant);
-			blockShader.setUniform("pointLights[" + to_string(i) + "].linear", lamps[i].type.linear);
-			blockShader.setUniform("pointLights[" + to_string(i) + "].quadratic", lamps[i].type.quadratic);
+			for (const Block& block : entry.second->blocks)
+				blockBatches[blockTypeOf(block.id).specTexIdx != 0].push_back(block);
 		}
-		
-		// Spotlight
-		blockShader.setUniform("spotLightOn", spotlightOn);
-		blockShader.setUniform("spotLight.position", cam.pos);
-		blockShader.setUniform("spotLight.direction", cam.front);
+		for (const FallingBlock& block : snapshot.fallingBlocks)
+		{
+			vec3 position = mix(block.previousPosition, block.position, alpha);
+			blockBatches[blockTypeOf(block.id).specTexIdx != 0].push_back({ position, block.id });
+		}
+
+		for (bool specularMap : { false, true })
+		{
+			if (blockBatches[specularMap].empty())
+				continue;
+
+			const Shader &blockShader = blockShaders.begin(lightingDefines(specularMap));
+			setLightingUniforms(blockShader);
+
+			// Draw blocks
+			for (const Block& block : blockBatches[specularMap]) 
+			{
+				const BlockType &type = blockTypeOf(block.id);
+
+				// Translate
+				model = glm::mat4(1.0f);
+				model = glm::translate(model, block.position);
+
+				// Transformation matrices
+				transform = projection * view * model; 
+				blockShader.setUniform("modelMat", model);
+				blockShader.setUniform("transformMat", transform); 
+
+				// Material
+				textures[type.diffTexIdx].bindToTexUnit(GL_TEXTURE0);
+				textures[type.specTexIdx].bindToTexUnit(GL_TEXTURE1);
+				blockShader.setUniform("material.diffuseTexture", 0);
+				blockShader.setUniform("material.specularTexture", 1);
+				blockShader.setUniform("material.shininess", type.shininess);
+
+				drawBlock(); 
+			}
 
-		// Camera position
-		blockShader.setUniform("camPos", cam.pos);
+			blockShaders.end();
+		}
 
-		// Draw blocks
-		for (const Block& block : blocks) 
+		// Draw fluids, cells that aren't full are lowered to their level
+		const Shader &fluidShader = blockShaders.begin(lightingDefines(false));
+		setLightingUniforms(fluidShader);
+		for (const ChunkCacheMap::value_type &entry : chunkCaches)
 		{
-			// Translate
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, block.position);
+			for (const FluidBlock& fluid : entry.second->fluids)
+			{
+				const FluidType &type = fluidTypeOf(fluid.id);
 
-			// Transformation matrices
-			transform = projection * view * model; 
-			blockShader.setUniform("modelMat", model);
-			blockShader.setUniform("transformMat", transform); 
+				model = glm::mat4(1.0f);
+				model = glm::translate(model, fluid.position - vec3(0.0f, (1.0f - fluid.height) / 2.0f, 0.0f));
+				model = glm::scale(model, vec3(1.0f, fluid.height, 1.0f));
+
+				transform = projection * view * model;
+				fluidShader.setUniform("modelMat", model);
+				fluidShader.setUniform("transformMat", transform);
 
-			// Material
-			textures[block.type.diffTexIdx].bindToTexUnit(GL_TEXTURE0);
-			textures[block.type.specTexIdx].bindToTexUnit(GL_TEXTURE1);
-			blockShader.setUniform("material.diffuseTexture", 0);
-			blockShader.setUniform("material.specularTexture", 1);
-			blockShader.setUniform("material.shininess", block.type.shininess);
+				textures[type.texIdx].bindToTexUnit(GL_TEXTURE0);
+				textures[0].bindToTexUnit(GL_TEXTURE1);
+				fluidShader.setUniform("material.diffuseTexture", 0);
+				fluidShader.setUniform("material.specularTexture", 1);
+				fluidShader.setUniform("material.shininess", type.shininess);
 
-			drawBlock(); 
+				drawBlock();
+			}
 		}
+		blockShaders.end();
 
 		/* -------------------------------------------------------------------------------- */
 		/*                                    DRAW LAMPS                                    */
@@ -371,14 +692,25 @@ int main()
 		// Calculate delta time
 		currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
+		if (lastFrame > 0.0f)
+		{
+			if (snapshot.autosaveRunning)
+				autosaveFrameTimes.add(deltaTime * 1000.0);
+			else
+				frameTimes.add(deltaTime * 1000.0);
+		}
 		lastFrame = currentFrame;
 
-		// Gravity
-		doGravity();
-
-		// Respond to user input
+		// Respond to user input and hand it over to the simulation
 		glfwPollEvents();
-		moveCam();
+		{
+			lock_guard<mutex> lock(simulationInputMutex);
+			memcpy(simulationInput.keysPressed, keysPressed, sizeof(keysPressed));
+			simulationInput.walking = walking;
+			simulationInput.camera = cam;
+			simulationInput.edits.insert(simulationInput.edits.end(), pendingEdits.begin(), pendingEdits.end());
+		}
+		pendingEdits.clear();
 	}
 
 
@@ -387,6 +719,42 @@ int main()
 	/*                                     CLEAN UP                                     */
 	/* -------------------------------------------------------------------------------- */
 	
+	blockShaders.printStats();
+
+	// The world is back in the hands of the main thread once the simulation has stopped
+	simulation.stop();
+	simulation.printStats();
+	fluids.printStats();
+	ticker.printStats();
+	JobSystem::shared().printStats();
+
+	// Blocks still falling land where they are, then only the modified chunks are saved
+	vector<Entity> landed;
+	entities.forEach<Transform, GravityBlock>([&landed](Entity entity, Transform &transform, GravityBlock &block)
+	{
+		ivec3 cell = cellOf(transform.position);
+		while (world.getBlock(cell) != AIR)
+			cell.y++;
+		editBlock(cell, block.id);
+		landed.push_back(entity);
+	});
+	for (Entity entity : landed)
+		entities.destroy(entity);
+
+	double saveStartTime = glfwGetTime();
+	size_t nrSavedChunks = autosave.saveNow(world);
+	journal.close();
+	std::cout << "Saved " << nrSavedChunks << " modified chunks in " << (glfwGetTime() - saveStartTime) * 1000.0
+		<< " ms" << endl;
+
+	// Frame time spikes with and without the autosave writer running
+	autosave.printStats();
+	journal.printStats();
+	chunkStreamer.printStats(world);
+	chunkCompressor.printStats(world);
+	frameTimes.print("Frame times", "ms");
+	autosaveFrameTimes.print("Frame times during autosave", "ms");
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	return 0;
@@ -396,6 +764,56 @@ int main()
 
 
 
+// Usage: --pack [pack path] [asset files...]
+// Without asset files, all shaders and textures used by the game are packed. The mip chains of the
+// packed textures are cooked into the texture cache as well, so the first start doesn't cook them.
+int packAssets(int argc, char **argv)
+{
+	string packPath = (argc >= 3) ? argv[2] : assetPackPath;
+
+	vector<string> paths;
+	for (int i = 3; i < argc; i++)
+		paths.push_back(argv[i]);
+
+	if (paths.empty())
+	{
+		const char *shaderPaths[] = {
+			"./lighting.vert", "./lighting.frag", "./lamp.vert", "./lamp.frag", "./crosshair.vert", "./crosshair.frag"
+		};
+		paths.insert(paths.end(), begin(shaderPaths), end(shaderPaths));
+		paths.insert(paths.end(), begin(texturePaths), end(texturePaths));
+	}
+
+	if (! AssetPack::build(packPath, paths))
+		return -1;
+
+	AssetPack pack;
+	if (! pack.open(packPath))
+		return -1;
+	std::cout << "Packed " << pack.size() << " assets into " << packPath << " (content hash " << std::hex
+		<< pack.contentHash() << std::dec << ")" << endl;
+
+	int nrCooked = 0;
+	for (const string &path : paths)
+	{
+		size_t extension = path.find_last_of('.');
+		string type = (extension == string::npos) ? "" : path.substr(extension);
+		if (type != ".png" && type != ".jpg")
+			continue;
+
+		CookedTexture texture;
+		if (! texture.load(path, true))
+		{
+			std::cerr << "ERROR::PACK::TEXTURE_COULD_NOT_BE_COOKED: " << path << endl;
+			return -1;
+		}
+		nrCooked += ! texture.fromCache;
+	}
+	std::cout << "Cooked the mip chains of " << nrCooked << " textures into the texture cache" << endl;
+	return 0;
+}
+
+
 void error_callback(int error, const char *description)
 {
 	std::cerr << description << endl;
@@ -432,6 +850,10 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		if (currentDaytime == nrDaytimes)
 			currentDaytime = 0;
 	}
+	else if (key == GLFW_KEY_F && action == GLFW_RELEASE)
+	{
+		walking = ! walking;
+	}
 	else if (key >= 0 && key <= 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -442,35 +864,167 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 }
 
 
-void moveCam()
+void simulationTick(float dt)
+{
+	// Input handed over by the render thread since the last tick
+	unique_lock<mutex> lock(simulationInputMutex);
+	Camera camera = simulationInput.camera;
+	bool keys[1024];
+	memcpy(keys, simulationInput.keysPressed, sizeof(keys));
+	bool walk = simulationInput.walking;
+	vector<EditCommand> edits;
+	edits.swap(simulationInput.edits);
+	lock.unlock();
+
+	for (const EditCommand &edit : edits)
+	{
+		if (edit.id == AIR)
+			destroyCube(edit.origin, edit.direction);
+		else
+			setCube(edit.origin, edit.direction, edit.id);
+	}
+
+	// The camera moves on from its simulated position, not from the interpolated one shown
+	previousCamPos = simulatedCamPos;
+	camera.pos = simulatedCamPos;
+	moveCam(camera, keys, walk, dt);
+	simulatedCamPos = camera.pos;
+
+	doBlockTicks();
+	if (blockTicks.getCurrentTick() % fluidInterval == 0)
+		stepFluids();
+	entities.forEach<Transform>([](Entity, Transform &transform) { transform.previousPosition = transform.position; });
+	doGravity(dt);
+}
+
+
+void moveCam(Camera &camera, const bool *keys, bool walk, float dt)
 {
-	if (keysPressed[GLFW_KEY_W])
+	if (walk)
 	{
-		cam.move(FORWARD, deltaTime);
+		// The body starts at rest below the camera when the player lands from flying
+		if (! playerWalking)
+		{
+			player.position = camera.pos - vec3(0.0f, playerPhysics.eyeHeight, 0.0f);
+			player.velocity = vec3(0.0f);
+			player.onGround = false;
+		}
+
+		vec3 forward = normalize(vec3(camera.front.x, 0.0f, camera.front.z));
+		vec3 right = normalize(vec3(camera.right.x, 0.0f, camera.right.z));
+		vec3 direction(0.0f);
+		if (keys[GLFW_KEY_W])
+			direction += forward;
+		if (keys[GLFW_KEY_S])
+			direction -= forward;
+		if (keys[GLFW_KEY_A])
+			direction -= right;
+		if (keys[GLFW_KEY_D])
+			direction += right;
+		vec3 walkVelocity = length(direction) > 0.0f ? normalize(direction) * camera.movementSpeed : vec3(0.0f);
+
+		playerPhysics.step(player, walkVelocity, keys[GLFW_KEY_SPACE], dt);
+		camera.pos = player.position + vec3(0.0f, playerPhysics.eyeHeight, 0.0f);
+		playerWalking = true;
+		return;
 	}
-	if (keysPressed[GLFW_KEY_S])
+	playerWalking = false;
+
+	if (keys[GLFW_KEY_W])
+	{
+		camera.move(FORWARD, dt);
+	}
+	if (keys[GLFW_KEY_S])
 	{
-		cam.move(BACKWARD, deltaTime);
+		camera.move(BACKWARD, dt);
 	}
-	if (keysPressed[GLFW_KEY_A])
+	if (keys[GLFW_KEY_A])
 	{
-		cam.move(LEFT, deltaTime);
+		camera.move(LEFT, dt);
 	}
-	if (keysPressed[GLFW_KEY_D])
+	if (keys[GLFW_KEY_D])
 	{
-		cam.move(RIGHT, deltaTime);
+		camera.move(RIGHT, dt);
 	}
-	if (keysPressed[GLFW_KEY_SPACE])
+	if (keys[GLFW_KEY_SPACE])
 	{
-		cam.move(UP, deltaTime);
+		camera.move(UP, dt);
 	}
-	if (keysPressed[GLFW_KEY_LEFT_SHIFT])
+	if (keys[GLFW_KEY_LEFT_SHIFT])
 	{
-		cam.move(DOWN, deltaTime);
+		camera.move(DOWN, dt);
 	}
 }
 
 
+bool isPlayerSolid(ivec3 cell)
+{
+	// The bottom of the world and the chunks not loaded yet are solid, so the player can't fall out of the world
+	if (cell.y < 0 || ! streamer->isReady(world, chunkPosOf(cell)))
+		return true;
+	BlockId id = world.getBlock(cell);
+	return id != AIR && ! isFluid(id);
+}
+
+
+string lightingDefines(bool specularMap)
+{
+	string defines;
+
+	if (spotlightOn)
+		defines += "#define SPOTLIGHT_ON\n";
+	if (! specularMap)
+		defines += "#define NO_SPECULAR\n";
+
+	// The lamp count is rounded up to a bucket (0, 1, 2, 4, ..., 64, 100), so placing or
+	// destroying a lamp only rarely requires a new variant
+	int nrLamps = static_cast<int>(lamps.size());
+	int nrPointLights = 0;
+	if (nrLamps > 0)
+	{
+		nrPointLights = 1;
+		while (nrPointLights < nrLamps)
+			nrPointLights *= 2;
+		if (nrPointLights > 100)
+			nrPointLights = 100;
+	}
+	defines += "#define NR_POINT_LIGHTS " + to_string(nrPointLights) + "\n";
+
+	return defines;
+}
+
+
+void setLightingUniforms(const Shader &blockShader)
+{
+	// Directional light
+	blockShader.setUniform("dirLight.direction", daytimes[currentDaytime].dirLightDir);
+	blockShader.setUniform("dirLight.ambient", daytimes[currentDaytime].dirLightAmbient);
+	blockShader.setUniform("dirLight.diffuse", daytimes[currentDaytime].dirLightDiffuse);
+	blockShader.setUniform("dirLight.specular", daytimes[currentDaytime].dirLightSpecular);
+
+	// Point lights
+	int nrLamps = static_cast<int>(lamps.size());
+	blockShader.setUniform("nrPointLights", nrLamps);
+	for (int i = 0; i < nrLamps; i++)
+	{
+		blockShader.setUniform("pointLights[" + to_string(i) + "].position", lamps[i].position); 
+		blockShader.setUniform("pointLights[" + to_string(i) + "].ambient", lamps[i].type.ambient);
+		blockShader.setUniform("pointLights[" + to_string(i) + "].diffuse", lamps[i].type.diffuse);
+		blockShader.setUniform("pointLights[" + to_string(i) + "].specular", lamps[i].type.specular);
+		blockShader.setUniform("pointLights[" + to_string(i) + "].constant", lamps[i].type.constant);
+		blockShader.setUniform("pointLights[" + to_string(i) + "].linear", lamps[i].type.linear);
+		blockShader.setUniform("pointLights[" + to_string(i) + "].quadratic", lamps[i].type.quadratic);
+	}
+	
+	// Spotlight
+	blockShader.setUniform("spotLight.position", cam.pos);
+	blockShader.setUniform("spotLight.direction", cam.front);
+
+	// Camera position
+	blockShader.setUniform("camPos", cam.pos);
+}
+
+
 void mouse_callback(GLFWwindow *window, double xpos, double ypos)
 {
 	if (firstMouse)
@@ -493,7 +1047,7 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 {
 	if (yoffset < 0)
 	{
-		if (selectedBlockLampType == (nrBlockTypes + nrLampTypes - 1))
+		if (selectedBlockLampType == (nrBlockTypes + nrLampTypes + nrFluidTypes - 1))
 			selectedBlockLampType = 0;
 		else
 			selectedBlockLampType++;
@@ -501,7 +1055,7 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 	else if (yoffset > 0)
 	{
 		if (selectedBlockLampType == 0)
-			selectedBlockLampType = nrBlockTypes + nrLampTypes - 1;
+			selectedBlockLampType = nrBlockTypes + nrLampTypes + nrFluidTypes - 1;
 		else
 			selectedBlockLampType--;
 	}
@@ -519,7 +1073,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	{
 		if (currentTime - lastClickTime >= clickInterval)
 		{
-			setCube();
+			pendingEdits.push_back({ cam.pos, cam.front, (BlockId)(selectedBlockLampType + 1) });
 			lastClickTime = currentTime;
 		}
 	}
@@ -527,110 +1081,299 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 	{
 		if (currentTime - lastClickTime >= clickInterval)
 		{
-			destroyCube();
+			pendingEdits.push_back({ cam.pos, cam.front, AIR });
 			lastClickTime = currentTime;
 		}
 	}
 }
 
 
-void setCube()
+bool raycastCubes(vec3 rayOrigin, vec3 rayDir, vec3 &hitCubePos, Intersection &hitIntersection, Entity &hitFallingBlock)
 {
-	glm::vec3 newCubePos(std::numeric_limits<float>::infinity());
 	glm::vec3 nearestIntersectionPoint(std::numeric_limits<float>::infinity());
-	Intersection intersection;
+	hitFallingBlock = NO_ENTITY;
 
-	// Calculate new cube position
-	for (const Block& block : blocks)
+	// First occupied cell of the world grid along the ray
+	RayHit hit = rayCaster.cast({ rayOrigin, rayDir, hitRange });
+	if (hit.hit)
 	{
-		// Skip blocks that are too far away (for the performance)
-		if (glm::length(cam.pos - block.position) > hitRange)
-			continue;
-
-		intersection = calcIntersectionRayCube(cam.pos, cam.front, hitRange, block.position);
-		if (glm::length(cam.pos - intersection.point) < glm::length(cam.pos - nearestIntersectionPoint))
-		{
-			nearestIntersectionPoint = intersection.point;
-			newCubePos = block.position + intersection.normal;
-		}
+		nearestIntersectionPoint = rayOrigin + normalize(rayDir) * hit.distance;
+		hitCubePos = vec3(hit.cell);
+		hitIntersection = { nearestIntersectionPoint, vec3(hit.normal) };
 	}
-	for (const Lamp& lamp : lamps)
+
+	// Test the falling blocks
+	entities.forEach<Transform, GravityBlock>([&](Entity entity, Transform &transform, GravityBlock &)
 	{
-		// Skip lamps that are too far away (for the performance)
-		if (glm::length(cam.pos - lamp.position) > hitRange)
-			continue;
+		// Skip blocks that are too far away (for the performance)
+		if (glm::length(rayOrigin - transform.position) > hitRange)
+			return;
 
-		intersection = calcIntersectionRayCube(cam.pos, cam.front, hitRange, lamp.position);
-		if (glm::length(cam.pos - intersection.point) < glm::length(cam.pos - nearestIntersectionPoint))
+		Intersection intersection = calcIntersectionRayCube(rayOrigin, rayDir, hitRange, transform.position);
+		if (glm::length(rayOrigin - intersection.point) < glm::length(rayOrigin - nearestIntersectionPoint))
 		{
 			nearestIntersectionPoint = intersection.point;
-			newCubePos = lamp.position + intersection.normal;
+			hitCubePos = transform.position;
+			hitIntersection = intersection;
+			hitFallingBlock = entity;
 		}
-	}
+	});
+
+	return nearestIntersectionPoint.x != std::numeric_limits<float>::infinity();
+}
 
-	// Return if no new cube position could be calculated
-	if (newCubePos.x == std::numeric_limits<float>::infinity())
+
+void setCube(vec3 rayOrigin, vec3 rayDir, BlockId id)
+{
+	glm::vec3 hitCubePos;
+	Intersection intersection;
+	Entity hitFallingBlock;
+
+	// Calculate new cube position
+	if (! raycastCubes(rayOrigin, rayDir, hitCubePos, intersection, hitFallingBlock))
 		return;
+	ivec3 newCell = cellOf(hitCubePos + intersection.normal);
 
-	for (const Block& block : blocks)
-	{
-		if (block.position == newCubePos)
-			return;
-	}
-	for (const Lamp& lamp : lamps)
+	// Return if the position is already occupied
+	if (world.getBlock(newCell) != AIR)
+		return;
+	bool occupied = false;
+	entities.forEach<Transform, GravityBlock>([&](Entity, Transform &transform, GravityBlock &)
 	{
-		if (lamp.position == newCubePos)
-			return;
-	}
+		occupied = occupied || cellOf(transform.position) == newCell;
+	});
+	if (occupied)
+		return;
 		
 	// Set new block or lamp
-	if (selectedBlockLampType < nrBlockTypes)
-		blocks.push_back({ newCubePos, blockTypes[selectedBlockLampType] });
-	else
-		lamps.push_back({ newCubePos, lampTypes[selectedBlockLampType - nrBlockTypes] });
+	editBlock(newCell, id);
 }
 
-void destroyCube()
+void destroyCube(vec3 rayOrigin, vec3 rayDir)
 {
-	int hitBlockIdx = -1;
-	int hitLampIdx = -1;
-	glm::vec3 nearestIntersectionPoint(std::numeric_limits<float>::infinity());
+	glm::vec3 hitCubePos;
 	Intersection intersection;
+	Entity hitFallingBlock;
 
 	// Calculate which cube was hit
-	for (int i = 0; i < blocks.size(); i++)
+	if (! raycastCubes(rayOrigin, rayDir, hitCubePos, intersection, hitFallingBlock))
+		return;
+
+	if (hitFallingBlock != NO_ENTITY)
 	{
-		// Skip blocks that are too far away (for the performance)
-		if (glm::length(cam.pos - blocks[i].position) > hitRange)
-			continue;
+		entities.destroy(hitFallingBlock);
+		return;
+	}
+
+	editBlock(cellOf(hitCubePos), AIR);
+}
+
+
+void editBlock(ivec3 pos, BlockId id)
+{
+	BlockId oldId = world.getBlock(pos);
+	if (oldId == id)
+		return;
+
+	world.setBlock(pos, id);
+	blockEdited(pos, oldId, id);
+}
 
-		intersection = calcIntersectionRayCube(cam.pos, cam.front, hitRange, blocks[i].position);
-		if (glm::length(cam.pos - intersection.point) < glm::length(cam.pos - nearestIntersectionPoint))
+
+void blockEdited(ivec3 pos, BlockId oldId, BlockId id)
+{
+	journal.append(pos, oldId, id);
+
+	// The block may uncover or hide blocks of the neighbouring chunks and the block above may lose its support
+	staleChunks.insert(chunkPosOf(pos));
+	for (const ivec3 &direction : neighbourDirections)
+		staleChunks.insert(chunkPosOf(pos + direction));
+	blockTicks.schedule(pos, GRAVITY_TICK, 1);
+	blockTicks.schedule(pos + ivec3(0, 1, 0), GRAVITY_TICK, 1);
+	if (id == GRASS || id == CONCRETE || id == PAVEMENT)
+		scheduleRandomTick(chunkPosOf(pos));
+	fluids.blockChanged(pos, id);
+}
+
+
+void syncChunkCaches()
+{
+	for (const ivec3 &chunkPos : cachedChunks)
+	{
+		if (! world.getChunk(chunkPos))
 		{
-			nearestIntersectionPoint = intersection.point;
-			hitBlockIdx = i;
-			hitLampIdx = -1;
+			staleChunks.insert(chunkPos);
+			fluids.chunkUnloaded(chunkPos);
 		}
 	}
-	for (int i = 0; i < lamps.size(); i++)
+
+	// Blocks at the borders of the neighbours of a new chunk may be covered now
+	for (const ChunkMap::value_type &entry : world.getChunks())
 	{
-		// Skip lamps that are too far away (for the performance)
-		if (glm::length(cam.pos - lamps[i].position) > hitRange)
+		if (cachedChunks.count(entry.first))
 			continue;
+		staleChunks.insert(entry.first);
+		for (const ivec3 &direction : neighbourDirections)
+			staleChunks.insert(entry.first + direction);
+		gravityChunks.insert(entry.first);
+		scheduleRandomTick(entry.first);
+		fluids.chunkLoaded(world, entry.first);
+	}
+}
+
+
+void stepFluids()
+{
+	vector<FluidChange> changes;
+	fluids.step(world, [](ivec3 chunkPos) { return streamer->isReady(world, chunkPos); }, changes);
+
+	for (const FluidChange &change : changes)
+	{
+		// Fluid that became a source persists like a placed one
+		if (change.newLevel == FluidSimulation::SOURCE && world.getBlock(change.pos) != WATER)
+			editBlock(change.pos, WATER);
+
+		staleChunks.insert(chunkPosOf(change.pos));
+		for (const ivec3 &direction : neighbourDirections)
+			staleChunks.insert(chunkPosOf(change.pos + direction));
+	}
+}
 
-		intersection = calcIntersectionRayCube(cam.pos, cam.front, hitRange, lamps[i].position);
-		if (glm::length(cam.pos - intersection.point) < glm::length(cam.pos - nearestIntersectionPoint))
+
+void updateChunkCaches(ChunkCacheMap &changed)
+{
+	// Air, lamps, fluids and cells of chunks that aren't loaded don't cover a block, the bottom of the world does
+	auto coversBlock = [](BlockId id) { return id != AIR && ! isLamp(id) && ! isFluid(id); };
+	auto coversChunk = [](const Chunk *chunk)
+	{
+		if (! chunk || ! chunk->summary().isFull())
+			return false;
+		for (BlockId id = nrBlockTypes + 1; id <= nrBlockTypes + nrLampTypes + nrFluidTypes; id++)
 		{
-			nearestIntersectionPoint = intersection.point;
-			hitLampIdx = i;
-			hitBlockIdx = -1;
+			if (chunk->summary().contains(id))
+				return false;
+		}
+		return true;
+	};
+
+	for (const ivec3 &chunkPos : staleChunks)
+	{
+		const Chunk *chunk = world.getChunk(chunkPos);
+		if (! chunk && ! fluids.hasFluid(chunkPos))
+		{
+			if (cachedChunks.erase(chunkPos) > 0)
+				changed[chunkPos] = NULL;
+			continue;
+		}
+
+		// Caches are never changed once they're published, a stale one is replaced by a new one
+		shared_ptr<ChunkCache> cache = make_shared<ChunkCache>();
+		changed[chunkPos] = cache;
+		cachedChunks.insert(chunkPos);
+
+		// Fluid is drawn where it isn't covered by a block or by more fluid
+		if (fluids.hasFluid(chunkPos))
+		{
+			for (int i = 0; i < CHUNK_VOLUME; i++)
+			{
+				ivec3 pos = blockPosOf(chunkPos, i);
+				uint8_t level = fluids.getLevel(pos);
+				if (level == 0)
+					continue;
+
+				for (const ivec3 &direction : neighbourDirections)
+				{
+					if (pos.y + direction.y < 0 || coversBlock(world.getBlock(pos + direction)) || fluids.getLevel(pos + direction) > 0)
+						continue;
+					float height = level >= FluidSimulation::FALLING ? 1.0f : level / (float)(FluidSimulation::MAX_FLOW + 1);
+					cache->fluids.push_back({ vec3(pos), height, WATER });
+					break;
+				}
+			}
+		}
+		if (! chunk)
+			continue;
+
+		// Solid chunks enclosed by solid chunks have nothing to draw
+		const ChunkSummary &summary = chunk->summary();
+		if (summary.isEmpty())
+			continue;
+		if (coversChunk(chunk))
+		{
+			bool enclosed = true;
+			for (const ivec3 &direction : neighbourDirections)
+			{
+				if (! (chunkPos.y == 0 && direction.y < 0) && ! coversChunk(world.getChunk(chunkPos + direction)))
+				{
+					enclosed = false;
+					break;
+				}
+			}
+			if (enclosed)
+				continue;
+		}
+
+		// Only the occupied layers are visited
+		int end = (summary.maxY() + 1) * CHUNK_SIZE * CHUNK_SIZE;
+		for (int i = summary.minY() * CHUNK_SIZE * CHUNK_SIZE; i < end; i++)
+		{
+			BlockId id = chunk->get(i);
+			if (id == AIR)
+				continue;
+
+			ivec3 pos = blockPosOf(chunkPos, i);
+			if (isLamp(id))
+			{
+				cache->lamps.push_back({ vec3(pos), lampTypeOf(id) });
+				continue;
+			}
+			if (isFluid(id))
+				continue;
+
+			// Neighbours within the chunk are read directly, the others through the world
+			ivec3 local = pos - chunkPos * CHUNK_SIZE;
+			for (const ivec3 &direction : neighbourDirections)
+			{
+				ivec3 neighbour = local + direction;
+				bool inside = all(greaterThanEqual(neighbour, ivec3(0))) && all(lessThan(neighbour, ivec3(CHUNK_SIZE)));
+				if (pos.y + direction.y < 0 ||
+					coversBlock(inside ? chunk->get(blockIndexOf(neighbour)) : world.getBlock(pos + direction)))
+					continue;
+				cache->blocks.push_back({ vec3(pos), id });
+				break;
+			}
 		}
 	}
+	staleChunks.clear();
+}
+
 
-	if (hitBlockIdx >= 0)
-		blocks.erase(blocks.begin() + hitBlockIdx);
-	if (hitLampIdx >= 0)
-		lamps.erase(lamps.begin() + hitLampIdx);
+void publishSnapshot(double simulatedTime, bool autosaveRunning)
+{
+	RenderSnapshot &snapshot = renderSnapshots.writeSlot();
+	snapshot.simulatedTime = simulatedTime;
+	snapshot.camPos = simulatedCamPos;
+	snapshot.previousCamPos = previousCamPos;
+	snapshot.fallingBlocks.clear();
+	entities.forEach<Transform, GravityBlock>([&snapshot](Entity, Transform &transform, GravityBlock &block)
+	{
+		snapshot.fallingBlocks.push_back({ transform.position, transform.previousPosition, block.id });
+	});
+	snapshot.autosaveRunning = autosaveRunning;
+	updateChunkCaches(snapshot.changedCaches);
+
+	// If the render thread skipped the last snapshot, the next one is written over it and keeps its changed caches
+	if (renderSnapshots.publish())
+		renderSnapshots.writeSlot().changedCaches.clear();
+}
+
+
+void collectLamps()
+{
+	lamps.clear();
+
+	for (const ChunkCacheMap::value_type &entry : chunkCaches)
+		lamps.insert(lamps.end(), entry.second->lamps.begin(), entry.second->lamps.end());
 }
 
 
@@ -676,43 +1419,175 @@ Intersection calcIntersectionRayCube(vec3 rayOrigin, vec3 rayDir, float rayRange
 
 float gravity = 4.25f;   
 
-void doGravity()
+void doGravity(float dt)
 {
-	for (Block& block : blocks)
+	// Gravity blocks without a block below them are taken out of the world grid and start falling. Only
+	// the chunks loaded since the last check are scanned, edits schedule a gravity tick for the blocks around them.
+	unordered_set<ivec3, ChunkPosHash> checkedChunks;
+	checkedChunks.swap(gravityChunks);
+	for (const ivec3 &chunkPos : checkedChunks)
 	{
-		if (! block.type.gravity || block.position.y == 0)
+		const Chunk *chunk = world.getChunk(chunkPos);
+		if (! chunk)
 			continue;
 
-		int targetY = 0;
+		// Chunks without gravity blocks are skipped as a whole
+		bool hasGravityBlocks = false;
+		for (BlockId id = 1; id <= nrBlockTypes; id++)
+			hasGravityBlocks = hasGravityBlocks || (chunk->summary().contains(id) && blockTypeOf(id).gravity);
+		if (! hasGravityBlocks)
+			continue;
 
-		for (const Block& otherBlock : blocks)
+		for (int i = 0; i < CHUNK_VOLUME; i++)
 		{
-			if (block.position.x == otherBlock.position.x &&
-				block.position.z == otherBlock.position.z &&
-				otherBlock.position.y < block.position.y &&
-				otherBlock.position.y >= targetY)
-			{
-				targetY = otherBlock.position.y + 1;
-			}
+			BlockId id = chunk->get(i);
+			if (id != AIR && id <= nrBlockTypes && blockTypeOf(id).gravity)
+				dropIfUnsupported(blockPosOf(chunkPos, i));
 		}
-		for (const Lamp& otherLamp : lamps)
+	}
+
+	// Falling blocks fall onto the highest block below them (or onto y = 0) and become part of the grid again.
+	// The landed entities are destroyed after the iteration.
+	vector<Entity> landed;
+	entities.forEach<Transform, Velocity, GravityBlock>([&landed, dt](Entity entity, Transform &transform, Velocity &velocity, GravityBlock &block)
+	{
+		int targetY = 0;
+		ivec3 cell = cellOf(transform.position);
+		for (int y = (int)ceil(transform.position.y) - 1; y >= 0; y--)
 		{
-			if (block.position.x == otherLamp.position.x &&
-				block.position.z == otherLamp.position.z &&
-				otherLamp.position.y < block.position.y &&
-				otherLamp.position.y >= targetY)
+			if (world.getBlock(ivec3(cell.x, y, cell.z)) != AIR)
 			{
-				targetY = otherLamp.position.y + 1;
+				targetY = y + 1;
+				break;
 			}
 		}
 
-		if (block.position.y > targetY)
+		transform.position += velocity.linear * dt;
+
+		// Check that the block didn't fall below targetY
+		if (transform.position.y <= targetY)
 		{
-			block.position.y -= gravity * deltaTime;
+			// Blocks falling on top of each other land on the next free cell
+			cell.y = targetY;
+			while (world.getBlock(cell) != AIR)
+				cell.y++;
+			editBlock(cell, block.id);
+			landed.push_back(entity);
+		}
+	});
+	for (Entity entity : landed)
+		entities.destroy(entity);
+}
+
+
+void dropIfUnsupported(ivec3 pos)
+{
+	BlockId id = world.getBlock(pos);
+	if (id == AIR || id > nrBlockTypes || ! blockTypeOf(id).gravity)
+		return;
 
-			// Check that the block didn't fall below targetY
-			if (block.position.y < targetY)
-				block.position.y = targetY;
+	ivec3 below = pos - ivec3(0, 1, 0);
+	if (pos.y <= 0 || world.getBlock(below) != AIR)
+		return;
+
+	// Blocks above chunks that are still loading check again later
+	if (! streamer->isReady(world, chunkPosOf(below)))
+	{
+		blockTicks.schedule(pos, GRAVITY_TICK, 10);
+		return;
+	}
+
+	editBlock(pos, AIR);
+	entities.create(Transform{ vec3(pos), vec3(pos) }, Velocity{ vec3(0.0f, -gravity, 0.0f) }, GravityBlock{ id });
+}
+
+
+void doBlockTicks()
+{
+	vector<ScheduledTick> due;
+	blockTicks.advance(due);
+	vector<ivec3> randomTickDue;
+	for (const ScheduledTick &tick : due)
+	{
+		if (tick.type == GRAVITY_TICK)
+			dropIfUnsupported(tick.pos);
+		else if (tick.type == RANDOM_TICK)
+		{
+			// Only chunks with soil next to grass keep getting random ticks, the others get one again when they're edited
+			randomTickChunks.erase(tick.pos);
+			if (! needsRandomTicks(tick.pos))
+				continue;
+			scheduleRandomTick(tick.pos);
+			randomTickDue.push_back(tick.pos);
+		}
+	}
+
+	vector<BlockChange> changes;
+	chunkTicker->tick(world, randomTickDue, randomTick, changes);
+	for (const BlockChange &change : changes)
+		blockEdited(change.pos, change.oldId, change.newId);
+}
+
+
+const int randomTickInterval = 30;   // Mean number of ticks between the random ticks of a chunk
+const int randomTickBlocks = 16;     // Blocks picked per random tick
+mt19937 randomTickGenerator(1);
+
+void scheduleRandomTick(ivec3 chunkPos)
+{
+	if (randomTickChunks.insert(chunkPos).second)
+		blockTicks.schedule(chunkPos, RANDOM_TICK, 1 + randomTickGenerator() % (2 * randomTickInterval));
+}
+
+
+bool needsRandomTicks(ivec3 chunkPos)
+{
+	const Chunk *chunk = world.getChunk(chunkPos);
+	if (! chunk || ! (chunk->summary().contains(PAVEMENT) || chunk->summary().contains(CONCRETE)))
+		return false;
+	bool grass = chunk->summary().contains(GRASS);
+	for (const ivec3 &direction : neighbourDirections)
+	{
+		const Chunk *neighbour = world.getChunk(chunkPos + direction);
+		grass = grass || (neighbour && neighbour->summary().contains(GRASS));
+	}
+	return grass;
+}
+
+
+void randomTick(ChunkRegion &region)
+{
+	// Runs in parallel with the random ticks of other chunks, so it only touches its region and draws
+	// from its own generator, seeded by the chunk and the tick
+	ivec3 chunkPos = region.getChunkPos();
+	uint64_t currentTick = blockTicks.getCurrentTick();
+	mt19937 generator((uint32_t)hashBytes(&currentTick, sizeof(currentTick), hashBytes(&chunkPos, sizeof(chunkPos))));
+
+	// Soil that is open to the sky turns into grass when there's grass next to it, on the same level or one up or down
+	const ChunkSummary &summary = region.getChunk()->summary();
+	int firstIdx = summary.minY() * CHUNK_SIZE * CHUNK_SIZE;
+	int nrIdxs = (summary.maxY() - summary.minY() + 1) * CHUNK_SIZE * CHUNK_SIZE;
+	for (int n = 0; n < randomTickBlocks; n++)
+	{
+		int i = firstIdx + generator() % nrIdxs;
+		ivec3 pos = blockPosOf(chunkPos, i);
+		BlockId id = region.getBlock(pos);
+		if ((id != PAVEMENT && id != CONCRETE) || region.getBlock(pos + ivec3(0, 1, 0)) != AIR)
+			continue;
+
+		bool nextToGrass = false;
+		for (int dy = -1; dy <= 1 && ! nextToGrass; dy++)
+		{
+			for (const ivec3 &direction : neighbourDirections)
+			{
+				if (direction.y == 0 && region.getBlock(pos + direction + ivec3(0, dy, 0)) == GRASS)
+				{
+					nextToGrass = true;
+					break;
+				}
+			}
 		}
+		if (nextToGrass)
+			region.setBlock(pos, GRASS);
 	}
 }
\ No newline at end of file